@@ -0,0 +1,48 @@
+import sys
+import json
+import argparse
+
+# Compare the JSON output of kernels-bench (-r json) against a stored baseline.
+# A benchmark is flagged as a regression if its mean is slower than the baseline by more than
+# the threshold, and the confidence intervals of both runs do not overlap.
+
+def load(path):
+        with open(path) as f:
+                return {b['name']: b for b in json.load(f)['benchmarks']}
+
+def main():
+        parser = argparse.ArgumentParser(description='Compare kernel benchmarks against a baseline')
+        parser.add_argument('baseline',help='JSON output of a previous run')
+        parser.add_argument('current',help='JSON output of the run to check')
+        parser.add_argument('--threshold',type=float,default=0.05,help='relative slowdown to flag, default 0.05')
+        args = parser.parse_args()
+
+        baseline = load(args.baseline)
+        current = load(args.current)
+        regressions = 0
+
+        print('%-45s %14s %14s %8s' % ('Benchmark','Baseline[ns]','Current[ns]','Change'))
+        for name, cur in current.items():
+                if name not in baseline:
+                        print('%-45s %14s %14.1f %8s' % (name,'-',cur['mean'],'new'))
+                        continue
+                base = baseline[name]
+                change = cur['mean'] / base['mean'] - 1
+                flag = ''
+                if change > args.threshold and cur['lower'] > base['upper']:
+                        flag = '  REGRESSION'
+                        regressions += 1
+                elif change < -args.threshold and cur['upper'] < base['lower']:
+                        flag = '  improved'
+                print('%-45s %14.1f %14.1f %+7.1f%%%s' % (name,base['mean'],cur['mean'],change*100,flag))
+
+        for name in baseline:
+                if name not in current:
+                        print('%-45s %14.1f %14s %8s' % (name,baseline[name]['mean'],'-','missing'))
+
+        if regressions > 0:
+                print('%d regression(s) above %.0f%%' % (regressions,args.threshold*100),file=sys.stderr)
+                sys.exit(1)
+
+if __name__ == '__main__':
+        main()
@@ -0,0 +1,70 @@
+#ifndef JSON_REPORTER_HPP
+#define JSON_REPORTER_HPP
+#include <ostream>
+#include <string>
+
+#include <catch.hpp>
+
+// Catch2 reporter writing one JSON document with the results of all BENCHMARKs, for comparison
+// against a stored baseline with compare.py. Select with `-r json` (and `-o <file>`).
+//
+// Durations are in nanoseconds per call; lower/upper are the bounds of the bootstrapped
+// confidence interval of the mean.
+
+class JsonReporter : public Catch::StreamingReporterBase<JsonReporter>
+{
+public:
+    using StreamingReporterBase::StreamingReporterBase;
+
+    static std::string getDescription() {
+        return "Reports benchmark results as JSON";
+    }
+
+    void testRunStarting(Catch::TestRunInfo const& info) override {
+        StreamingReporterBase::testRunStarting(info);
+        stream << "{\"benchmarks\":[";
+    }
+
+    void benchmarkEnded(Catch::BenchmarkStats<> const& stats) override {
+        stream << (_first ? "\n" : ",\n");
+        stream << "{\"name\":\"" << escape(stats.info.name) << "\""
+               << ",\"samples\":" << stats.info.samples
+               << ",\"iterations\":" << stats.info.iterations
+               << ",\"mean\":" << stats.mean.point.count()
+               << ",\"lower\":" << stats.mean.lower_bound.count()
+               << ",\"upper\":" << stats.mean.upper_bound.count()
+               << ",\"stddev\":" << stats.standardDeviation.point.count()
+               << ",\"outlier_variance\":" << stats.outlierVariance << "}";
+        _first = false;
+    }
+
+    void assertionStarting(Catch::AssertionInfo const&) override {}
+    bool assertionEnded(Catch::AssertionStats const&) override { return true; }
+
+    void benchmarkFailed(std::string const& error) override {
+        Catch::cerr() << "benchmark failed: " << error << std::endl;
+    }
+
+    void testRunEnded(Catch::TestRunStats const& stats) override {
+        stream << "\n]}\n";
+        StreamingReporterBase::testRunEnded(stats);
+    }
+
+private:
+    static std::string escape(const std::string &s) {
+        std::string r;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                r += '\\';
+            }
+            r += c;
+        }
+        return r;
+    }
+
+    bool _first = true;
+};
+
+CATCH_REGISTER_REPORTER("json", JsonReporter)
+
+#endif // JSON_REPORTER_HPP
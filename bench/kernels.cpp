@@ -0,0 +1,375 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "json-reporter.hpp"
+#include "../stencil/FDTD3d/stencil-parallel.h"
+#include "../stencil/include/stencil-tune.hpp"
+#include "../symmetrize/matrix/batch.h"
+#include "../symmetrize/matrix/dirty.h"
+#include "../symmetrize/matrix/interleaved.h"
+#include "../symmetrize/matrix/matrix.h"
+#include "../symmetrize/matrix/pairwise.h"
+#include "../symmetrize/matrix/symmatrix.h"
+#include "../symmetrize/matrix/tiled.h"
+#include "../symmetrize/matrix/trimatrix.h"
+#include "../symmetrize/matrix/view.h"
+
+// Microbenchmarks of the computational kernels, outside of the UPC++ programs. Every kernel is
+// run for a small (cache resident) and a large (memory bound) size; the size is part of the
+// benchmark name, so that results can be matched against a baseline (see compare.py).
+
+using namespace asc::pad_ws20::project;
+using index_t = std::ptrdiff_t;
+
+namespace
+{
+std::vector<float> random_floats(index_t n, int seed = 42) {
+    std::vector<float> v(n);
+    std::mt19937_64 rgen(seed);
+    for (auto& x : v) {
+        x = 0.5 + rgen() % 100;
+    }
+    return v;
+}
+
+std::string label(const char *kernel, index_t n) {
+    return std::string(kernel) + " n=" + std::to_string(n);
+}
+
+// Domain of dim^3 points including the halo, initialized as in FDTD3d/stencil-benchmark.cpp
+struct StencilData {
+    static constexpr int radius = 4;
+    int dim;
+    std::vector<float> Veven, Vodd, vsq, coeff;
+
+    explicit StencilData(int dim)
+        : dim(dim), Veven(dim * dim * dim, 0), Vodd(dim * dim * dim, 0), vsq(dim * dim * dim, 0),
+          coeff(radius + 1) {
+        int offset = 0;
+        for (int z = 0; z < dim; ++z) {
+            for (int y = 0; y < dim; ++y) {
+                for (int x = 0; x < dim; ++x, ++offset) {
+                    Veven[offset] = (x < dim / 2) ? x / float(dim) : y / float(dim);
+                    vsq[offset] = x * y * z / float(dim * dim * dim);
+                }
+            }
+        }
+        for (int i = 0; i <= radius; ++i) {
+            coeff[i] = 0.1f / (i + 1);
+        }
+    }
+};
+} // namespace
+
+TEST_CASE("reduction", "[reduction]") {
+    const index_t n = GENERATE(index_t(1) << 12, index_t(1) << 24);
+    std::vector<float> v = random_floats(n);
+
+    // Same loop as the partial sums in reduction/upcxx.cpp
+    BENCHMARK(label("reduction", n)) {
+        double psum(0);
+        for (index_t i = 0; i < n; ++i) {
+            psum += v[i];
+        }
+        return psum;
+    };
+    BENCHMARK(label("reduction (std::accumulate)", n)) {
+        return std::accumulate<std::vector<float>::iterator, double>(v.begin(), v.end(), 0.0);
+    };
+}
+
+TEST_CASE("SquareMatrix", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    SquareMatrix<float> M(elems.data(), n * n);
+
+    BENCHMARK(label("SquareMatrix::transpose_naive", n)) {
+        M.transpose_naive();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::transpose", n)) {
+        M.transpose();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::transpose_parallel", n)) {
+        M.transpose_parallel();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::transpose_recursive", n)) {
+        M.transpose_recursive();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::symmetrize_naive", n)) {
+        M.symmetrize_naive();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::symmetrize", n)) {
+        M.symmetrize();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::symmetrize_parallel", n)) {
+        M.symmetrize_parallel();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("SquareMatrix::symmetrize_recursive", n)) {
+        M.symmetrize_recursive();
+        return M(n - 1, 0);
+    };
+}
+
+TEST_CASE("TriMatrix", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    TriMatrix<float> M(elems.data(), n * n);
+
+    BENCHMARK(label("TriMatrix::transpose", n)) {
+        M.transpose();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("TriMatrix::symmetrize", n)) {
+        M.symmetrize();
+        return M(n - 1, 0);
+    };
+    // Packing of a row-major matrix into diagonal, lower and upper triangle
+    BENCHMARK(label("TriMatrix(row_major)", n)) {
+        return TriMatrix<float>(elems.data(), n * n);
+    };
+    BENCHMARK(label("TriMatrix::unpack", n)) {
+        M.unpack(elems.data());
+        return elems[n - 1];
+    };
+}
+
+TEST_CASE("TiledTriMatrix", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    TriMatrix<float> P(elems.data(), n * n);
+    TiledTriMatrix<float> M(P);
+    std::vector<float> x = random_floats(n, 7), y(n);
+
+    BENCHMARK(label("TiledTriMatrix::transpose", n)) {
+        M.transpose();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("TiledTriMatrix::symmetrize", n)) {
+        M.symmetrize();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("TiledTriMatrix::matvec", n)) {
+        M.matvec(x.data(), y.data());
+        return y[n - 1];
+    };
+    // Conversion from and to the packed triangles
+    BENCHMARK(label("TiledTriMatrix(TriMatrix)", n)) {
+        return TiledTriMatrix<float>(P);
+    };
+    BENCHMARK(label("TiledTriMatrix::unpack(TriMatrix)", n)) {
+        M.unpack(P);
+        return P(n - 1, 0);
+    };
+}
+
+// Both triangles in one stream, compared to TriMatrix::symmetrize() on two arrays
+TEST_CASE("InterleavedTriMatrix", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    TriMatrix<float> P(elems.data(), n * n);
+    InterleavedTriMatrix<float> M(P);
+
+    BENCHMARK(label("InterleavedTriMatrix::symmetrize", n)) {
+        M.symmetrize();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("InterleavedTriMatrix::symmetrize_parallel", n)) {
+        M.symmetrize_parallel();
+        return M(n - 1, 0);
+    };
+    BENCHMARK(label("InterleavedTriMatrix(TriMatrix)", n)) {
+        return InterleavedTriMatrix<float>(P);
+    };
+    BENCHMARK(label("InterleavedTriMatrix::unpack(TriMatrix)", n)) {
+        M.unpack(P);
+        return P(n - 1, 0);
+    };
+}
+
+TEST_CASE("SymMatrix", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    SymMatrix<float> S(TriMatrix<float>(elems.data(), n * n));
+    SquareMatrix<float> D(elems.data(), n * n);
+    D.symmetrize();
+    std::vector<float> x = random_floats(n, 7), y(n);
+
+    BENCHMARK(label("SymMatrix::spmv", n)) {
+        S.spmv(x.data(), y.data());
+        return y[n - 1];
+    };
+    BENCHMARK(label("SymMatrix::spmv_parallel", n)) {
+        S.spmv_parallel(x.data(), y.data());
+        return y[n - 1];
+    };
+    // Reference: dense product, reading all n*n elements
+    BENCHMARK(label("SquareMatrix (dense matvec)", n)) {
+        const float* a = D.elements();
+        for (index_t i = 0; i < n; ++i) {
+            float s = 0;
+            #pragma omp simd reduction(+:s)
+            for (index_t j = 0; j < n; ++j) {
+                s += a[i*n + j] * x[j];
+            }
+            y[i] = s;
+        }
+        return y[n - 1];
+    };
+}
+
+TEST_CASE("SymmetrizedView", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    TriMatrix<float> P(elems.data(), n * n);
+    SquareMatrix<float> D(elems.data(), n * n);
+    SymMatrix<float> S(n);
+    std::vector<float> out(n * n);
+
+    // Symmetrized copies, without writing back to the source matrix
+    BENCHMARK(label("SymmetrizedView<TriMatrix>::materialize (SymMatrix)", n)) {
+        SymmetrizedView(P).materialize(S.diag(), S.lower());
+        return S(n - 1, 0);
+    };
+    BENCHMARK(label("SymmetrizedView<TriMatrix>::materialize", n)) {
+        SymmetrizedView(P).materialize(out.data());
+        return out[n - 1];
+    };
+    BENCHMARK(label("SymmetrizedView<SquareMatrix>::materialize", n)) {
+        SymmetrizedView(D).materialize(out.data());
+        return out[n - 1];
+    };
+    // Read-once pipeline: row sums of the symmetrized matrix
+    BENCHMARK(label("SymmetrizedView<TriMatrix>::for_each_row", n)) {
+        float total = 0;
+        SymmetrizedView(P).for_each_row([&](index_t, const float* row) {
+            for (index_t j = 0; j < n; ++j) {
+                total += row[j];
+            }
+        });
+        return total;
+    };
+    BENCHMARK(label("SymmetrizedView<TriMatrix>::for_each_tile", n)) {
+        float total = 0;
+        SymmetrizedView(P).for_each_tile(64, [&](index_t, index_t, const float* tile) {
+            for (index_t k = 0; k < 64 * 64; ++k) {
+                total += tile[k];
+            }
+        });
+        return total;
+    };
+}
+
+TEST_CASE("incremental symmetrization", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    SquareMatrix<float> D(elems.data(), n * n);
+    TriMatrix<float> P(elems.data(), n * n);
+    D.symmetrize();
+    P.symmetrize();
+
+    // About 1% of the tiles, spread over the matrix
+    DirtyTiles dirty(n);
+    const index_t tiles = dirty.tile_rows() * dirty.tile_cols();
+    for (index_t k = 0; k < tiles; k += 100) {
+        dirty.mark((k / dirty.tile_cols()) * dirty.tile_dim(), (k % dirty.tile_cols()) * dirty.tile_dim());
+    }
+
+    BENCHMARK(label("SquareMatrix::symmetrize (1% dirty)", n)) {
+        D.symmetrize(dirty);
+        return D(n - 1, 0);
+    };
+    BENCHMARK(label("TriMatrix::symmetrize (1% dirty)", n)) {
+        P.symmetrize(dirty);
+        return P(n - 1, 0);
+    };
+}
+
+TEST_CASE("MatrixBatch", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(3), index_t(16));
+    const index_t count = 1 << 16;
+    std::vector<float> elems = random_floats(n * n * count);
+    MatrixBatch<float> B(elems.data(), n, count);
+    std::vector<SquareMatrix<float>> matrices;
+    for (index_t m = 0; m < count; ++m) {
+        matrices.emplace_back(elems.data() + m * n * n, n * n);
+    }
+
+    // 65536 matrices each, one allocation per matrix or one for the batch
+    BENCHMARK(label("SquareMatrix::symmetrize (65536 matrices)", n)) {
+        for (auto& M : matrices) {
+            M.symmetrize();
+        }
+        return matrices.back()(n - 1, 0);
+    };
+    BENCHMARK(label("MatrixBatch::symmetrize (65536 matrices)", n)) {
+        B.symmetrize();
+        return B(count - 1, n - 1, 0);
+    };
+    BENCHMARK(label("MatrixBatch::symmetrize_parallel (65536 matrices)", n)) {
+        B.symmetrize_parallel();
+        return B(count - 1, n - 1, 0);
+    };
+    BENCHMARK(label("MatrixBatch::transpose (65536 matrices)", n)) {
+        B.transpose();
+        return B(count - 1, n - 1, 0);
+    };
+}
+
+TEST_CASE("pairwise operations", "[symmetrize]") {
+    const index_t n = GENERATE(index_t(64), index_t(4096));
+    std::vector<float> elems = random_floats(n * n);
+    TriMatrix<float> P(elems.data(), n * n);
+    const index_t t = P.t();
+
+    BENCHMARK(label("apply_pair_op symmetrize", n)) {
+        apply_pair_op(pair_op::symmetrize, P.lower(), P.upper(), t);
+        return P(n - 1, 0);
+    };
+    BENCHMARK(label("apply_pair_op axpby", n)) {
+        apply_pair_op(pair_op::axpby, P.lower(), P.upper(), t, 0.5f, 0.5f);
+        return P(n - 1, 0);
+    };
+    // Checking symmetry before symmetrizing: two passes, or one
+    BENCHMARK(label("apply_pair_op asymmetry, then symmetrize", n)) {
+        double s = apply_pair_op(pair_op::asymmetry, P.lower(), P.upper(), t);
+        apply_pair_op(pair_op::symmetrize, P.lower(), P.upper(), t);
+        return s;
+    };
+    BENCHMARK(label("apply_pair_op symmetrize-asymmetry", n)) {
+        return apply_pair_op(pair_op::symmetrize_asymmetry, P.lower(), P.upper(), t);
+    };
+}
+
+TEST_CASE("stencil", "[stencil]") {
+    const int dim = GENERATE(32, 256);
+    const int r = StencilData::radius;
+    StencilData d(dim);
+    stencil_default_schedule();
+
+    BENCHMARK(label("stencil_parallel_step", dim)) {
+        stencil_parallel_step(r, dim - r, r, dim - r, r, dim - r, dim, dim, dim,
+                              d.coeff.data(), d.vsq.data(), d.Veven.data(), d.Vodd.data(), r);
+        return d.Vodd[dim * dim * dim / 2];
+    };
+    // Two time steps, so that Veven and Vodd are restored to their roles
+    BENCHMARK(label("loop_stencil_parallel", dim)) {
+        loop_stencil_parallel(0, 2, r, dim - r, r, dim - r, r, dim - r, dim, dim, dim,
+                              d.coeff.data(), d.vsq.data(), d.Veven.data(), d.Vodd.data(),
+                              dim, 8, 8, r);
+        return d.Veven[dim * dim * dim / 2];
+    };
+}
@@ -0,0 +1,147 @@
+#ifndef BENCH_STATS_HPP
+#define BENCH_STATS_HPP
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Statistics over the timed iterations of a benchmark, and parsing of --sweep specifications.
+// The arithmetic mean stays in the Time[s] column of the --bench output; the columns below are
+// appended after the existing ones.
+
+struct BenchStats {
+    std::size_t count = 0;
+    double mean = 0;
+    double median = 0;
+    double p10 = 0;    // 10th percentile
+    double p90 = 0;    // 90th percentile
+    double min = 0;
+    double max = 0;
+    double stddev = 0; // sample standard deviation
+};
+
+constexpr const char *bench_stats_columns = "Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]";
+
+// Percentile q (0 <= q <= 1) of sorted samples, interpolating linearly between ranks
+inline double
+bench_percentile(const std::vector<double> &sorted, double q)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    double pos = q * (sorted.size() - 1);
+    std::size_t lo = static_cast<std::size_t>(std::floor(pos));
+    std::size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+inline BenchStats
+bench_stats(std::vector<double> samples)
+{
+    BenchStats s;
+    s.count = samples.size();
+    if (samples.empty()) {
+        return s;
+    }
+    std::sort(samples.begin(), samples.end());
+    s.mean = std::accumulate(samples.begin(), samples.end(), 0.) / s.count;
+    s.median = bench_percentile(samples, 0.5);
+    s.p10 = bench_percentile(samples, 0.1);
+    s.p90 = bench_percentile(samples, 0.9);
+    s.min = samples.front();
+    s.max = samples.back();
+
+    if (s.count > 1) {
+        double sq = 0;
+        for (double t : samples) {
+            sq += (t - s.mean) * (t - s.mean);
+        }
+        s.stddev = std::sqrt(sq / (s.count - 1));
+    }
+    return s;
+}
+
+inline void
+bench_print_stats(std::FILE *stream, const BenchStats &s)
+{
+    std::fprintf(stream, ",%.12f,%.12f,%.12f,%.12f,%.12f,%.12f",
+                 s.median, s.p10, s.p90, s.min, s.max, s.stddev);
+}
+
+// Parse "min:max:factor" (factor defaults to 2). Returns nothing if the specification is malformed.
+inline std::optional<std::array<long long, 3>>
+bench_sweep_parse(const std::string &spec)
+{
+    std::istringstream iss(spec);
+    std::string field;
+    std::vector<long long> values;
+
+    while (std::getline(iss, field, ':')) {
+        try {
+            std::size_t pos = 0;
+            values.push_back(std::stoll(field, &pos, 0));
+            if (pos != field.size()) {
+                return std::nullopt;
+            }
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+    if (values.size() == 2) {
+        values.push_back(2);
+    }
+    if (values.size() != 3 || values[0] <= 0 || values[1] < values[0] || values[2] < 2) {
+        return std::nullopt;
+    }
+    return std::array<long long, 3>{ values[0], values[1], values[2] };
+}
+
+// Sizes min, min*factor, ... up to and including max
+inline std::optional<std::vector<std::ptrdiff_t>>
+bench_sweep_sizes(const std::string &spec)
+{
+    auto sweep = bench_sweep_parse(spec);
+    if (!sweep) {
+        return std::nullopt;
+    }
+    const auto [min, max, factor] = *sweep;
+    std::vector<std::ptrdiff_t> sizes;
+
+    for (long long n = min; n <= max; n *= factor) {
+        sizes.push_back(static_cast<std::ptrdiff_t>(n));
+    }
+    return sizes;
+}
+
+// 3D domains starting from min^3, multiplying the x-, y- and z-dimension by factor in turn
+// (as in stencil/benchmark.sh), up to the last domain of which no dimension exceeds max; this
+// is max^3 if max is min times a power of factor.
+inline std::optional<std::vector<std::array<std::ptrdiff_t, 3>>>
+bench_sweep_domains(const std::string &spec)
+{
+    auto sweep = bench_sweep_parse(spec);
+    if (!sweep) {
+        return std::nullopt;
+    }
+    const auto [min, max, factor] = *sweep;
+    std::array<std::ptrdiff_t, 3> dim = { min, min, min };
+    std::vector<std::array<std::ptrdiff_t, 3>> domains;
+
+    for (int axis = 0; ; axis = (axis + 1) % 3) {
+        domains.push_back(dim);
+        if (dim[axis] * factor > max) {
+            break;
+        }
+        dim[axis] *= factor;
+    }
+    return domains;
+}
+
+#endif // BENCH_STATS_HPP
@@ -0,0 +1,328 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <upcxx/upcxx.hpp>
+
+// Hardware performance counters through perf_event_open(2), collected around the timed kernels.
+//
+// Core events (cycles, instructions, last-level cache misses) count the calling thread and all
+// threads it creates afterwards (inherit), so counters must be opened before the first OpenMP
+// parallel region. Memory traffic is read from the uncore memory controllers (uncore_imc_*,
+// event cas_count_read/cas_count_write) where the kernel exposes them; these count the whole
+// socket, so they should be opened by a single rank per node (see PerfCounters::open()).
+// Counters which cannot be opened (missing hardware support, perf_event_paranoid, containers)
+// are reported as unavailable.
+
+enum class perf_counter : int {
+    cycles = 0,
+    instructions,
+    llc_misses,
+    dram_read_bytes,
+    dram_write_bytes,
+    count // amount of counters, not a counter
+};
+constexpr std::size_t perf_counter_count = static_cast<std::size_t>(perf_counter::count);
+
+inline const char*
+perf_counter_name(perf_counter c)
+{
+    switch (c) {
+        case perf_counter::cycles:           return "cycles";
+        case perf_counter::instructions:     return "instructions";
+        case perf_counter::llc_misses:       return "llc_misses";
+        case perf_counter::dram_read_bytes:  return "dram_read_bytes";
+        case perf_counter::dram_write_bytes: return "dram_write_bytes";
+        default:                             return "unknown";
+    }
+}
+
+namespace detail
+{
+inline int
+perf_event_open(perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags));
+}
+
+inline std::string
+read_sysfs(const std::string &path)
+{
+    std::ifstream ifs(path);
+    std::string value;
+    std::getline(ifs, value);
+    return value;
+}
+
+// Translate a sysfs event description such as "event=0x04,umask=0x03" into the config value,
+// using the bit positions in <pmu>/format/<term> (e.g. "config:8-15").
+inline bool
+parse_sysfs_event(const std::string &pmu, const std::string &desc, std::uint64_t &config)
+{
+    std::istringstream terms(desc);
+    std::string term;
+    config = 0;
+
+    while (std::getline(terms, term, ',')) {
+        auto eq = term.find('=');
+        std::string name = term.substr(0, eq);
+        std::uint64_t value = eq == std::string::npos ? 1 : std::stoull(term.substr(eq + 1), nullptr, 0);
+
+        std::string format = read_sysfs(pmu + "/format/" + name);
+        if (format.compare(0, 7, "config:") != 0) {
+            return false; // config1/config2 terms are not needed for the events used here
+        }
+        config |= value << std::stoul(format.substr(7));
+    }
+    return true;
+}
+} // namespace detail
+
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+        for (auto& fds : _fds) {
+            for (auto& e : fds) {
+                close(e.fd);
+            }
+        }
+    }
+
+    // Open all counters; uncore counters only if `uncore` is set (one rank per node).
+    void open(bool uncore) {
+        open_core(perf_counter::cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open_core(perf_counter::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open_core(perf_counter::llc_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+        if (uncore) {
+            open_uncore(perf_counter::dram_read_bytes, "cas_count_read");
+            open_uncore(perf_counter::dram_write_bytes, "cas_count_write");
+        }
+    }
+
+    bool available(perf_counter c) const { return !_fds[index(c)].empty(); }
+
+    void start() {
+        for (auto& fds : _fds) {
+            for (auto& e : fds) {
+                e.start = read_scaled(e.fd);
+                ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop() {
+        for (std::size_t k = 0; k < perf_counter_count; ++k) {
+            for (auto& e : _fds[k]) {
+                ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+                _values[k] += (read_scaled(e.fd) - e.start) * e.scale;
+            }
+        }
+    }
+
+    // Accumulated value over all start/stop pairs; NaN if the counter is not available.
+    double value(perf_counter c) const {
+        return available(c) ? _values[index(c)] : std::nan("");
+    }
+
+    void reset() { _values.fill(0); }
+
+    std::array<double, perf_counter_count> values() const {
+        std::array<double, perf_counter_count> v;
+        for (std::size_t k = 0; k < perf_counter_count; ++k) {
+            v[k] = value(static_cast<perf_counter>(k));
+        }
+        return v;
+    }
+
+private:
+    struct event {
+        int fd;
+        double scale; // to bytes for uncore events
+        double start;
+    };
+
+    static std::size_t index(perf_counter c) { return static_cast<std::size_t>(c); }
+
+    // Counter value, extrapolated if the event was multiplexed with others
+    static double read_scaled(int fd) {
+        std::uint64_t data[3] = { 0, 0, 0 }; // value, time enabled, time running
+        if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            return 0;
+        }
+        return static_cast<double>(data[0]) * data[1] / data[2];
+    }
+
+    static perf_event_attr make_attr(std::uint32_t type, std::uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return attr;
+    }
+
+    void open_core(perf_counter c, std::uint32_t type, std::uint64_t config) {
+        perf_event_attr attr = make_attr(type, config);
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = detail::perf_event_open(&attr, 0, -1, -1, 0);
+        if (fd >= 0) {
+            _fds[index(c)].push_back({fd, 1.0, 0});
+        }
+    }
+
+    void open_uncore(perf_counter c, const char *name) {
+        const std::string root = "/sys/bus/event_source/devices";
+        DIR *dir = opendir(root.c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        std::vector<event> fds;
+        bool complete = true;
+
+        while (dirent *entry = readdir(dir)) {
+            if (std::strncmp(entry->d_name, "uncore_imc", 10) != 0) {
+                continue;
+            }
+            const std::string pmu = root + "/" + entry->d_name;
+            const std::string desc = detail::read_sysfs(pmu + "/events/" + name);
+            std::uint64_t config = 0;
+
+            if (desc.empty() || !detail::parse_sysfs_event(pmu, desc, config)) {
+                continue;
+            }
+            // Scale and unit of the event (e.g. 6.103515625e-5 MiB per 64-byte transfer)
+            double scale = 1.0;
+            std::string scale_s = detail::read_sysfs(pmu + "/events/" + name + ".scale");
+            std::string unit = detail::read_sysfs(pmu + "/events/" + name + ".unit");
+            if (!scale_s.empty()) {
+                scale = std::stod(scale_s);
+            }
+            if (unit == "MiB") {
+                scale *= 1024 * 1024;
+            }
+
+            // Uncore PMUs are opened on one CPU per socket, as listed in cpumask (e.g. "0,28")
+            std::istringstream cpus(detail::read_sysfs(pmu + "/cpumask"));
+            std::string cpu;
+            perf_event_attr attr = make_attr(std::stoul(detail::read_sysfs(pmu + "/type")), config);
+
+            while (std::getline(cpus, cpu, ',')) {
+                int fd = detail::perf_event_open(&attr, -1, std::stoi(cpu), -1, 0);
+                if (fd < 0) {
+                    complete = false;
+                    continue;
+                }
+                fds.push_back({fd, scale, 0});
+            }
+        }
+        closedir(dir);
+
+        // Partial coverage of the memory controllers would underestimate traffic
+        if (!complete) {
+            for (auto& e : fds) {
+                close(e.fd);
+            }
+            fds.clear();
+        }
+        _fds[index(c)] = std::move(fds);
+    }
+
+    std::array<std::vector<event>, perf_counter_count> _fds;
+    std::array<double, perf_counter_count> _values{};
+};
+
+// Write the counters of every rank (one JSON line each, in rank order) followed by a line with
+// the sum over all ranks. time is the time spent in the measured kernels, used for derived
+// metrics (instructions per cycle, DRAM bandwidth). Counts are written as integers and other
+// numbers with 17 significant digits. Collective over upcxx::world().
+inline void
+write_counters_json(const std::string &file_path, const char *program,
+                    const std::vector<std::pair<std::string, double>> &params,
+                    const PerfCounters &counters, double time)
+{
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+
+    // Unavailable counters are excluded from the sum, and marked by a count of 0
+    std::array<double, perf_counter_count> local = counters.values(), sum;
+    std::array<int, perf_counter_count> ranks, ranks_sum;
+    for (std::size_t k = 0; k < perf_counter_count; ++k) {
+        ranks[k] = std::isnan(local[k]) ? 0 : 1;
+        local[k] = std::isnan(local[k]) ? 0 : local[k];
+    }
+    upcxx::reduce_one(local.data(), sum.data(), perf_counter_count, upcxx::op_fast_add, 0).wait();
+    upcxx::reduce_one(ranks.data(), ranks_sum.data(), perf_counter_count, upcxx::op_fast_add, 0).wait();
+    double time_max = upcxx::reduce_one(time, upcxx::op_fast_max, 0).wait();
+
+    if (proc_id == 0 && std::all_of(ranks_sum.begin(), ranks_sum.end(), [](int n) { return n == 0; })) {
+        std::cerr << "no hardware counters available (see /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+    }
+
+    auto write = [&](std::ostream &os, const char *rank, const std::array<double, perf_counter_count> &v,
+                     const std::array<int, perf_counter_count> &n, double t) {
+        os.precision(17);
+        os << "{\"program\":\"" << program << "\",\"ranks\":" << proc_n << ",\"rank\":" << rank;
+        for (const auto& [key, value] : params) {
+            os << ",\"" << key << "\":" << value;
+        }
+        os << ",\"time\":" << t;
+        for (std::size_t k = 0; k < perf_counter_count; ++k) {
+            if (n[k] > 0) {
+                os << ",\"" << perf_counter_name(static_cast<perf_counter>(k)) << "\":" << std::llround(v[k]);
+            }
+        }
+        const auto cyc = static_cast<std::size_t>(perf_counter::cycles);
+        const auto ins = static_cast<std::size_t>(perf_counter::instructions);
+        const auto rd = static_cast<std::size_t>(perf_counter::dram_read_bytes);
+        const auto wr = static_cast<std::size_t>(perf_counter::dram_write_bytes);
+        if (n[cyc] > 0 && n[ins] > 0 && v[cyc] > 0) {
+            os << ",\"ipc\":" << v[ins] / v[cyc];
+        }
+        if (n[rd] > 0 && n[wr] > 0 && t > 0) {
+            os << ",\"dram_bandwidth[GB/s]\":" << (v[rd] + v[wr]) * 1e-9 / t;
+        }
+        os << "}\n";
+    };
+
+    for (int k = 0; k < proc_n; ++k) {
+        if (proc_id == k) {
+            std::ofstream ofs(file_path, std::ofstream::app);
+            write(ofs, std::to_string(k).c_str(), local, ranks, time);
+        }
+        upcxx::barrier();
+    }
+    if (proc_id == 0) {
+        std::ofstream ofs(file_path, std::ofstream::app);
+        write(ofs, "\"all\"", sum, ranks_sum, time_max);
+    }
+}
+
+#endif // PERF_COUNTERS_HPP
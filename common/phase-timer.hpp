@@ -0,0 +1,151 @@
+#ifndef PHASE_TIMER_HPP
+#define PHASE_TIMER_HPP
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+#include "trace.hpp"
+
+// Per-rank accumulated timers for the different phases of a benchmark. Timers are cheap
+// (one clock read per start/stop), so they are always enabled; statistics across ranks are
+// only computed at the end of the program with reduce_phases(). If tracing is enabled (see
+// trace.hpp), every start/stop pair is also recorded as a trace event.
+
+enum class phase : int {
+    init = 0,   // allocation and initialization of data
+    exchange,   // point-to-point communication (e.g. ghost cells)
+    compute,    // local computation
+    collective, // barriers and reductions, including the wait for other ranks
+    io,         // writing data to files
+    count       // amount of phases, not a phase
+};
+constexpr std::size_t phase_count = static_cast<std::size_t>(phase::count);
+
+inline const char*
+phase_name(phase p)
+{
+    switch (p) {
+        case phase::init:       return "init";
+        case phase::exchange:   return "exchange";
+        case phase::compute:    return "compute";
+        case phase::collective: return "collective";
+        case phase::io:         return "io";
+        default:                return "unknown";
+    }
+}
+
+class PhaseTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double>;
+
+    void start(phase p) {
+        _start[index(p)] = Clock::now();
+    }
+
+    void stop(phase p) {
+        Clock::time_point end = Clock::now();
+        Duration d = end - _start[index(p)];
+        _elapsed[index(p)] += d.count();
+
+        if (trace_enabled()) {
+            using std::chrono::nanoseconds;
+            using std::chrono::duration_cast;
+            trace_record(phase_name(p),
+                         duration_cast<nanoseconds>(_start[index(p)].time_since_epoch()).count(),
+                         duration_cast<nanoseconds>(end.time_since_epoch()).count());
+        }
+    }
+
+    // Accumulated time of phase p, in seconds
+    double elapsed(phase p) const { return _elapsed[index(p)]; }
+    const std::array<double, phase_count>& elapsed() const { return _elapsed; }
+
+    void reset() { _elapsed.fill(0); }
+
+private:
+    static std::size_t index(phase p) { return static_cast<std::size_t>(p); }
+
+    std::array<Clock::time_point, phase_count> _start{};
+    std::array<double, phase_count> _elapsed{};
+};
+
+struct PhaseStats {
+    double min = 0;
+    double mean = 0;
+    double max = 0;
+    upcxx::intrank_t max_rank = 0; // slowest rank (lowest rank id if several)
+
+    // Ratio of the slowest rank to the average rank; 1 means perfect balance.
+    double imbalance() const { return mean > 0 ? max / mean : 1.0; }
+};
+
+// Reduce the timers of all ranks to min/mean/max per phase. Collective over upcxx::world();
+// the result is only valid on root.
+inline std::array<PhaseStats, phase_count>
+reduce_phases(const PhaseTimer &timer, upcxx::intrank_t root = 0)
+{
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+    const auto& local = timer.elapsed();
+
+    std::array<double, phase_count> t_min, t_sum, t_max;
+    upcxx::reduce_one(local.data(), t_min.data(), phase_count, upcxx::op_fast_min, root).wait();
+    upcxx::reduce_one(local.data(), t_sum.data(), phase_count, upcxx::op_fast_add, root).wait();
+    upcxx::reduce_all(local.data(), t_max.data(), phase_count, upcxx::op_fast_max).wait();
+
+    // Ranks which hit the maximum report their id; the lowest one is kept.
+    std::array<upcxx::intrank_t, phase_count> slowest, slowest_min;
+    for (std::size_t k = 0; k < phase_count; ++k) {
+        slowest[k] = local[k] == t_max[k] ? proc_id : proc_n;
+    }
+    upcxx::reduce_one(slowest.data(), slowest_min.data(), phase_count, upcxx::op_fast_min, root).wait();
+
+    std::array<PhaseStats, phase_count> stats;
+    for (std::size_t k = 0; k < phase_count; ++k) {
+        stats[k].min = t_min[k];
+        stats[k].mean = t_sum[k] / proc_n;
+        stats[k].max = t_max[k];
+        stats[k].max_rank = slowest_min[k];
+    }
+    return stats;
+}
+
+// Write one JSON object (single line) with the benchmark parameters and phase statistics.
+// Phases which were not timed on any rank are left out. Numbers are written with 17 significant
+// digits, so that integer parameters such as sizes are exact.
+inline std::ostream&
+write_phases_json(std::ostream &stream, const char *program,
+                  const std::vector<std::pair<std::string, double>> &params,
+                  const std::array<PhaseStats, phase_count> &stats)
+{
+    const std::streamsize precision = stream.precision(17);
+    stream << "{\"program\":\"" << program << "\",\"ranks\":" << upcxx::rank_n();
+    for (const auto& [key, value] : params) {
+        stream << ",\"" << key << "\":" << value;
+    }
+    stream << ",\"phases\":{";
+
+    bool first = true;
+    for (std::size_t k = 0; k < phase_count; ++k) {
+        const PhaseStats &s = stats[k];
+        if (s.max == 0) {
+            continue;
+        }
+        stream << (first ? "" : ",") << "\"" << phase_name(static_cast<phase>(k)) << "\":{"
+               << "\"min\":" << s.min << ",\"mean\":" << s.mean << ",\"max\":" << s.max
+               << ",\"imbalance\":" << s.imbalance() << ",\"max_rank\":" << s.max_rank << "}";
+        first = false;
+    }
+    stream << "}}" << std::endl;
+    stream.precision(precision);
+    return stream;
+}
+
+#endif // PHASE_TIMER_HPP
@@ -0,0 +1,351 @@
+#ifndef REDUCE_SELECT_HPP
+#define REDUCE_SELECT_HPP
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+// Sum of one double per rank, with several algorithms whose cost depends on the amount of
+// ranks, the amount of ranks per node and the network:
+//
+//   reduce-one          upcxx::reduce_one
+//   atomic              every rank adds its value to a word on rank 0 with a remote atomic
+//   rput                every rank writes its value into an array on rank 0, which adds them
+//   recursive-doubling  log2(p) rounds of pairwise exchange between rank and rank ^ 2^r
+//   hierarchical        the ranks of a node write their values into shared memory of the first
+//                       rank of the node, whose sums are then combined with reduce_one
+//
+// rput and recursive-doubling add in a fixed order, so their result does not depend on timing.
+// The fastest algorithm for a configuration (conduit, ranks, ranks per node) is measured with
+// reduce_calibrate() and stored in a CSV file for later runs, see reduce_calibration_read().
+
+enum class reduce_algorithm : int {
+    reduce_one = 0,
+    atomic,
+    rput,
+    recursive_doubling,
+    hierarchical,
+    count // amount of algorithms, not an algorithm
+};
+constexpr std::size_t reduce_algorithm_count = static_cast<std::size_t>(reduce_algorithm::count);
+
+inline const char*
+reduce_algorithm_name(reduce_algorithm a)
+{
+    switch (a) {
+        case reduce_algorithm::reduce_one:         return "reduce-one";
+        case reduce_algorithm::atomic:             return "atomic";
+        case reduce_algorithm::rput:               return "rput";
+        case reduce_algorithm::recursive_doubling: return "recursive-doubling";
+        case reduce_algorithm::hierarchical:       return "hierarchical";
+        default:                                   return "unknown";
+    }
+}
+
+inline std::optional<reduce_algorithm>
+reduce_algorithm_parse(const std::string &name)
+{
+    for (std::size_t k = 0; k < reduce_algorithm_count; ++k) {
+        auto a = static_cast<reduce_algorithm>(k);
+        if (name == reduce_algorithm_name(a)) {
+            return a;
+        }
+    }
+    return std::nullopt;
+}
+
+// Network the program was compiled for (UPCXX_NETWORK)
+inline const char*
+reduce_conduit()
+{
+#if defined(UPCXX_NETWORK_SMP)
+    return "smp";
+#elif defined(UPCXX_NETWORK_UDP)
+    return "udp";
+#elif defined(UPCXX_NETWORK_IBV)
+    return "ibv";
+#elif defined(UPCXX_NETWORK_ARIES)
+    return "aries";
+#elif defined(UPCXX_NETWORK_OFI)
+    return "ofi";
+#elif defined(UPCXX_NETWORK_MPI)
+    return "mpi";
+#else
+    return "unknown";
+#endif
+}
+
+// Messages of recursive doubling, by buffer (parity of the call) and round. A partner can be
+// at most one call ahead, so two buffers suffice.
+struct ReduceMailbox {
+    static constexpr int fold = 64;      // value of a rank beyond the largest power of two
+    static constexpr int unfold = 65;    // result, sent back to that rank
+    double value[2][66] = {};
+    bool full[2][66] = {};
+};
+
+class Reducer
+{
+public:
+    // Collective over upcxx::world(); must also be destroyed collectively, before
+    // upcxx::finalize().
+    Reducer()
+        : _domain({upcxx::atomic_op::add, upcxx::atomic_op::load, upcxx::atomic_op::store}),
+          _leaders(upcxx::world().split(upcxx::local_team().rank_me() == 0 ? 0 : 1, upcxx::rank_me())),
+          _mailbox(ReduceMailbox{})
+    {
+        const upcxx::intrank_t n = upcxx::rank_n();
+        const upcxx::intrank_t local_n = upcxx::local_team().rank_n();
+
+        if (upcxx::rank_me() == 0) {
+            // new_array() leaves the words indeterminate; the atomic algorithm adds to them and
+            // resets them only after reading
+            _accumulator = upcxx::new_array<double>(2);
+            _accumulator.local()[0] = _accumulator.local()[1] = 0;
+            _slots = upcxx::new_array<double>(2 * n);
+        }
+        _accumulator = upcxx::broadcast(_accumulator, 0).wait();
+        _slots = upcxx::broadcast(_slots, 0).wait();
+
+        if (upcxx::local_team().rank_me() == 0) {
+            _node_slots = upcxx::new_array<double>(2 * local_n);
+        }
+        _node_slots = upcxx::broadcast(_node_slots, 0, upcxx::local_team()).wait();
+        upcxx::barrier();
+    }
+
+    Reducer(const Reducer&) = delete;
+    Reducer& operator=(const Reducer&) = delete;
+
+    ~Reducer() {
+        upcxx::barrier();
+        if (upcxx::rank_me() == 0) {
+            upcxx::delete_array(_accumulator);
+            upcxx::delete_array(_slots);
+        }
+        if (upcxx::local_team().rank_me() == 0) {
+            upcxx::delete_array(_node_slots);
+        }
+        _domain.destroy();
+        _leaders.destroy();
+    }
+
+    // Sum of x over all ranks, valid on rank 0 (with recursive-doubling, on all ranks).
+    // Collective over upcxx::world(); all ranks must use the same algorithm.
+    double sum(double x, reduce_algorithm a) {
+        const int b = static_cast<int>(_calls++ % 2); // buffer of this call
+
+        switch (a) {
+            case reduce_algorithm::atomic:             return sum_atomic(x, b);
+            case reduce_algorithm::rput:               return sum_rput(x, b);
+            case reduce_algorithm::recursive_doubling: return sum_recursive_doubling(x, b);
+            case reduce_algorithm::hierarchical:       return sum_hierarchical(x, b);
+            default:
+                return upcxx::reduce_one(x, upcxx::op_fast_add, 0).wait();
+        }
+    }
+
+private:
+    // Rank 0 reads and clears the word of this call after the barrier; it is used again two
+    // calls later, after the next barrier, so no rank can add to it before it is cleared.
+    double sum_atomic(double x, int b) {
+        _domain.add(_accumulator + b, x, std::memory_order_relaxed).wait();
+        upcxx::barrier();
+
+        double s = 0;
+        if (upcxx::rank_me() == 0) {
+            s = _domain.load(_accumulator + b, std::memory_order_relaxed).wait();
+            _domain.store(_accumulator + b, 0.0, std::memory_order_relaxed).wait();
+        }
+        return s;
+    }
+
+    double sum_rput(double x, int b) {
+        const upcxx::intrank_t n = upcxx::rank_n();
+        upcxx::rput(x, _slots + b*n + upcxx::rank_me()).wait();
+        upcxx::barrier();
+
+        double s = 0;
+        if (upcxx::rank_me() == 0) {
+            const double *slots = _slots.local() + b*n;
+            for (upcxx::intrank_t k = 0; k < n; ++k) {
+                s += slots[k];
+            }
+        }
+        return s;
+    }
+
+    // Ranks from the largest power of two p2 upwards fold their value into rank - p2 first,
+    // and receive the result from it at the end. Both partners of a round add the same two
+    // values in the order of their ranks, so all ranks end up with the same sum.
+    double sum_recursive_doubling(double x, int b) {
+        const upcxx::intrank_t n = upcxx::rank_n();
+        const upcxx::intrank_t me = upcxx::rank_me();
+        upcxx::intrank_t p2 = 1;
+        while (p2 * 2 <= n) {
+            p2 *= 2;
+        }
+
+        if (me >= p2) {
+            send(me - p2, b, ReduceMailbox::fold, x);
+            return receive(b, ReduceMailbox::unfold);
+        }
+        if (me + p2 < n) {
+            x += receive(b, ReduceMailbox::fold);
+        }
+        for (int r = 0; (upcxx::intrank_t(1) << r) < p2; ++r) {
+            const upcxx::intrank_t partner = me ^ (upcxx::intrank_t(1) << r);
+            send(partner, b, r, x);
+            const double y = receive(b, r);
+            x = me < partner ? x + y : y + x;
+        }
+        if (me + p2 < n) {
+            send(me + p2, b, ReduceMailbox::unfold, x);
+        }
+        return x;
+    }
+
+    // The first rank of a node reads the slots of this call after the barrier of the node;
+    // as for the atomic word, they are written again only after the next barrier.
+    double sum_hierarchical(double x, int b) {
+        upcxx::team &node = upcxx::local_team();
+        const upcxx::intrank_t local_n = node.rank_n();
+        _node_slots.local()[b*local_n + node.rank_me()] = x;
+        upcxx::barrier(node);
+
+        if (node.rank_me() != 0) {
+            return 0;
+        }
+        const double *slots = _node_slots.local() + b*local_n;
+        double s = 0;
+        for (upcxx::intrank_t k = 0; k < local_n; ++k) {
+            s += slots[k];
+        }
+        return upcxx::reduce_one(s, upcxx::op_fast_add, 0, _leaders).wait();
+    }
+
+    void send(upcxx::intrank_t target, int b, int slot, double x) {
+        upcxx::rpc_ff(target, [](upcxx::dist_object<ReduceMailbox> &m, int b, int slot, double x) {
+            m->value[b][slot] = x;
+            m->full[b][slot] = true;
+        }, _mailbox, b, slot, x);
+    }
+
+    double receive(int b, int slot) {
+        while (!_mailbox->full[b][slot]) {
+            upcxx::progress();
+        }
+        _mailbox->full[b][slot] = false;
+        return _mailbox->value[b][slot];
+    }
+
+    std::uint64_t _calls = 0;
+    upcxx::atomic_domain<double> _domain;
+    upcxx::team _leaders;                      // first ranks of all nodes (other ranks: unused)
+    upcxx::dist_object<ReduceMailbox> _mailbox;
+    upcxx::global_ptr<double> _accumulator;    // [2] on rank 0
+    upcxx::global_ptr<double> _slots;          // [2][rank_n] on rank 0
+    upcxx::global_ptr<double> _node_slots;     // [2][ranks of the node] on the first rank of the node
+};
+
+// Mean time of every algorithm per call, after a barrier as in the benchmarks, on the slowest
+// rank. Collective over upcxx::world(); the result is valid on all ranks.
+inline std::array<double, reduce_algorithm_count>
+reduce_calibrate(Reducer &reducer, int iterations = 1000, int warmup = 10)
+{
+    using Clock = std::chrono::steady_clock;
+    std::array<double, reduce_algorithm_count> times{};
+
+    for (std::size_t k = 0; k < reduce_algorithm_count; ++k) {
+        const auto a = static_cast<reduce_algorithm>(k);
+        double elapsed = 0;
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            upcxx::barrier();
+            const auto t = Clock::now();
+            reducer.sum(1.0, a);
+            if (iter > 0) {
+                elapsed += std::chrono::duration<double>(Clock::now() - t).count();
+            }
+        }
+        times[k] = upcxx::reduce_all(elapsed / iterations, upcxx::op_fast_max).wait();
+    }
+    return times;
+}
+
+inline reduce_algorithm
+reduce_fastest(const std::array<double, reduce_algorithm_count> &times)
+{
+    auto it = std::min_element(times.begin(), times.end());
+    return static_cast<reduce_algorithm>(it - times.begin());
+}
+
+// Calibration file: one row per configuration, with the fastest algorithm and its time, e.g.
+//
+//   Conduit,Ranks,LocalRanks,Algorithm,Time[s]
+//   udp,16,4,hierarchical,0.000012
+constexpr const char *reduce_calibration_header = "Conduit,Ranks,LocalRanks,Algorithm,Time[s]";
+
+inline std::optional<reduce_algorithm>
+reduce_calibration_read(const std::string &file_path, const std::string &conduit, int ranks, int local_ranks)
+{
+    std::ifstream ifs(file_path);
+    std::string line;
+    std::getline(ifs, line); // header
+
+    while (std::getline(ifs, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream iss(line);
+        std::string c, name;
+        int n = 0, local_n = 0;
+
+        if (iss >> c >> n >> local_n >> name && c == conduit && n == ranks && local_n == local_ranks) {
+            return reduce_algorithm_parse(name);
+        }
+    }
+    return std::nullopt;
+}
+
+// Replace the row of the configuration (or add one); returns false if the file cannot be written
+inline bool
+reduce_calibration_write(const std::string &file_path, const std::string &conduit, int ranks, int local_ranks,
+                         reduce_algorithm a, double time)
+{
+    std::vector<std::string> rows;
+    {
+        std::ifstream ifs(file_path);
+        std::string line;
+        std::getline(ifs, line); // header
+
+        while (std::getline(ifs, line)) {
+            std::istringstream iss(line);
+            std::string c, n, local_n;
+            std::getline(iss, c, ',');
+            std::getline(iss, n, ',');
+            std::getline(iss, local_n, ',');
+
+            if (!line.empty() && !(c == conduit && n == std::to_string(ranks) && local_n == std::to_string(local_ranks))) {
+                rows.push_back(line);
+            }
+        }
+    }
+    std::ostringstream row;
+    row << conduit << ',' << ranks << ',' << local_ranks << ',' << reduce_algorithm_name(a) << ',' << time;
+    rows.push_back(row.str());
+
+    std::ofstream ofs(file_path, std::ofstream::trunc);
+    ofs << reduce_calibration_header << '\n';
+    for (const auto &r : rows) {
+        ofs << r << '\n';
+    }
+    return static_cast<bool>(ofs);
+}
+
+#endif // REDUCE_SELECT_HPP
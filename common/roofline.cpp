@@ -0,0 +1,266 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <omp.h>
+#include <lyra/lyra.hpp>
+
+#include "roofline.hpp"
+
+namespace
+{
+// Parse a Linux CPU list such as "0-3,8-11"
+std::vector<int>
+parse_cpulist(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(list);
+    std::string range;
+
+    while (std::getline(iss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// NUMA node of every CPU (index), from /sys/devices/system/node; node 0 if not available.
+std::vector<int>
+cpu_domains()
+{
+    std::vector<int> domains;
+    const std::string root = "/sys/devices/system/node";
+    DIR *dir = opendir(root.c_str());
+    if (dir == nullptr) {
+        return domains;
+    }
+    while (dirent *entry = readdir(dir)) {
+        int node = 0;
+        if (std::sscanf(entry->d_name, "node%d", &node) != 1) {
+            continue;
+        }
+        std::ifstream ifs(root + "/" + entry->d_name + "/cpulist");
+        std::string list;
+        std::getline(ifs, list);
+
+        for (int cpu : parse_cpulist(list)) {
+            if (cpu >= static_cast<int>(domains.size())) {
+                domains.resize(cpu + 1, 0);
+            }
+            domains[cpu] = node;
+        }
+    }
+    closedir(dir);
+    return domains;
+}
+
+double
+seconds_since(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+// Measure one domain with the threads for which member[thread] is set. Arrays of n doubles are
+// first touched by the same threads; the best of `repeats` runs is kept (as in STREAM).
+roofline_domain
+calibrate_threads(int domain, const std::vector<char> &member, std::size_t n, int repeats, long fma_iterations)
+{
+    constexpr int lanes = 128; // independent FMA chains per thread, enough to cover FMA latency
+    const int threads = static_cast<int>(member.size());
+
+    std::vector<int> slot(threads, -1);
+    int members = 0;
+    for (int k = 0; k < threads; ++k) {
+        if (member[k]) {
+            slot[k] = members++;
+        }
+    }
+    // Not std::vector, which would initialize (first touch) the arrays on the calling thread
+    double *a = static_cast<double*>(std::malloc(n * sizeof(double)));
+    double *b = static_cast<double*>(std::malloc(n * sizeof(double)));
+    double *c = static_cast<double*>(std::malloc(n * sizeof(double)));
+    std::vector<double> sink(threads * 8, 0.0); // one cache line per thread
+
+    enum { copy, triad, read, fma, kernels };
+    double best[kernels];
+    std::fill(best, best + kernels, std::numeric_limits<double>::infinity());
+    std::chrono::steady_clock::time_point t0;
+
+#pragma omp parallel num_threads(threads)
+{
+    const int s = slot[omp_get_thread_num()];
+    const std::size_t begin = s < 0 ? 0 : n * s / members;
+    const std::size_t end = s < 0 ? 0 : n * (s + 1) / members;
+    const double scalar = 3.0;
+    double &local_sink = sink[omp_get_thread_num() * 8];
+
+    for (std::size_t i = begin; i < end; ++i) {
+        a[i] = 1.0;
+        b[i] = 2.0;
+        c[i] = 0.0;
+    }
+    for (int r = 0; r < repeats; ++r) {
+        for (int k = 0; k < kernels; ++k) {
+#pragma omp barrier
+#pragma omp single
+            t0 = std::chrono::steady_clock::now();
+            // implicit barrier
+
+            if (k == copy) {
+#pragma omp simd
+                for (std::size_t i = begin; i < end; ++i) {
+                    c[i] = a[i];
+                }
+            } else if (k == triad) {
+#pragma omp simd
+                for (std::size_t i = begin; i < end; ++i) {
+                    a[i] = b[i] + scalar * c[i];
+                }
+            } else if (k == read) {
+                double sum = 0;
+#pragma omp simd reduction(+:sum)
+                for (std::size_t i = begin; i < end; ++i) {
+                    sum += a[i];
+                }
+                local_sink += sum;
+            } else if (s >= 0) {
+                float acc[lanes];
+                for (int j = 0; j < lanes; ++j) {
+                    acc[j] = 1.0f + j * 1e-3f;
+                }
+                for (long it = 0; it < fma_iterations; ++it) {
+#pragma omp simd
+                    for (int j = 0; j < lanes; ++j) {
+                        acc[j] = acc[j] * 0.999999f + 1e-6f;
+                    }
+                }
+                for (int j = 0; j < lanes; ++j) {
+                    local_sink += acc[j];
+                }
+            }
+#pragma omp barrier
+#pragma omp single
+            best[k] = std::min(best[k], seconds_since(t0));
+        }
+    }
+}
+    std::free(a);
+    std::free(b);
+    std::free(c);
+
+    roofline_domain d;
+    d.domain = domain;
+    d.threads = members;
+    d.copy = 2 * sizeof(double) * n * 1e-9 / best[copy];
+    d.triad = 3 * sizeof(double) * n * 1e-9 / best[triad];
+    d.read = sizeof(double) * n * 1e-9 / best[read];
+    d.peak = 2.0 * lanes * fma_iterations * members * 1e-9 / best[fma];
+
+    // Keep the results of the read and FMA kernels alive
+    if (std::accumulate(sink.begin(), sink.end(), 0.0) < 0) {
+        std::fprintf(stderr, "unexpected checksum\n");
+    }
+    return d;
+}
+} // namespace
+
+// Calibrate every NUMA domain which has OpenMP threads placed on it, followed by the whole node
+// (domain -1). n is the amount of doubles per array; it should be well beyond the cache size.
+std::vector<roofline_domain>
+roofline_calibrate(std::size_t n = std::size_t(1) << 25, int repeats = 10, long fma_iterations = 1 << 20)
+{
+    const int threads = omp_get_max_threads();
+    const std::vector<int> cpu_domain = cpu_domains();
+    std::vector<int> thread_domain(threads, 0);
+
+#pragma omp parallel num_threads(threads)
+    {
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && cpu < static_cast<int>(cpu_domain.size())) {
+            thread_domain[omp_get_thread_num()] = cpu_domain[cpu];
+        }
+    }
+    std::vector<int> domains(thread_domain);
+    std::sort(domains.begin(), domains.end());
+    domains.erase(std::unique(domains.begin(), domains.end()), domains.end());
+
+    std::vector<roofline_domain> result;
+    if (domains.size() > 1) {
+        for (int domain : domains) {
+            std::vector<char> member(threads);
+            for (int k = 0; k < threads; ++k) {
+                member[k] = thread_domain[k] == domain;
+            }
+            // Scale the arrays with the share of threads, so that every domain sees the same
+            // amount of data per thread as the whole node
+            std::size_t count = std::count(member.begin(), member.end(), 1);
+            result.push_back(calibrate_threads(domain, member, n * count / threads,
+                                                       repeats, fma_iterations));
+        }
+    }
+    result.push_back(calibrate_threads(-1, std::vector<char>(threads, 1), n, repeats, fma_iterations));
+    return result;
+}
+
+// Calibrate the roofline of the current node. Run with the same thread count and placement
+// (OMP_NUM_THREADS, OMP_PLACES, OMP_PROC_BIND) and compiler flags (CMAKE_BUILD_TYPE=Release;
+// the FMA kernel relies on the accumulators being kept in registers) as the benchmarks, and pass
+// the output to their --roofline option.
+int main(int argc, char** argv) {
+    std::ptrdiff_t size = std::ptrdiff_t(1) << 25; // doubles per array
+    int repeats = 10;
+    long fma_iterations = 1 << 20;
+    std::string output;
+    bool show_help = false;
+
+    auto cli = lyra::help(show_help) |
+        lyra::opt(size, "size")["-N"]["--size"](
+            "Elements (double) per array of the bandwidth kernels, default is 2^25") |
+        lyra::opt(repeats, "repeats")["--repeats"](
+            "Number of repetitions, of which the best is kept, default is 10") |
+        lyra::opt(fma_iterations, "iterations")["--fma-iterations"](
+            "Iterations of the FMA kernel, default is 2^20") |
+        lyra::opt(output, "file")["-o"]["--output"](
+            "Write calibration to file instead of standard output");
+    auto result = cli.parse({argc, argv});
+
+    if (!result) {
+		std::cerr << "Error in command line: " << result.errorMessage()
+			  << std::endl;
+		exit(1);
+	}
+	if (show_help) {
+		std::cout << cli << std::endl;
+		exit(0);
+	}
+    if (size <= 0 || repeats <= 0 || fma_iterations <= 0) {
+        std::cerr << "positive size, repeats and iterations required" << std::endl;
+        std::exit(1);
+    }
+
+    auto domains = roofline_calibrate(size, repeats, fma_iterations);
+    if (output.empty()) {
+        roofline_write_csv(std::cout, domains);
+    } else {
+        std::ofstream ofs(output, std::ofstream::trunc);
+        roofline_write_csv(ofs, domains);
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef ROOFLINE_HPP
+#define ROOFLINE_HPP
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Roofline model of a node: sustainable memory bandwidth (STREAM copy, triad and a read-only
+// sum) and peak single precision FMA throughput, as measured by the roofline program
+// (common/roofline.cpp) per NUMA domain and for the whole node ("all" row of the calibration file).
+//
+// Kernels are described by their minimum memory traffic and floating point operations; the
+// fraction of the roofline is the achieved performance divided by min(peak, intensity * bandwidth).
+
+struct roofline_domain {
+    int domain = -1;     // NUMA node, -1 for the whole node
+    int threads = 0;
+    double copy = 0;     // GB/s
+    double triad = 0;    // GB/s
+    double read = 0;     // GB/s
+    double peak = 0;     // GFLOP/s (single precision)
+
+    double bandwidth(const std::string &stream) const {
+        if (stream == "copy")  return copy;
+        if (stream == "read")  return read;
+        return triad;
+    }
+};
+
+struct roofline_kernel {
+    const char *name;
+    double bytes;        // minimum memory traffic (all ranks)
+    double flops;
+    const char *stream;  // STREAM kernel with the closest mix of reads and writes
+};
+
+struct roofline_point {
+    double intensity;    // flop/byte
+    double bandwidth;    // achieved, GB/s
+    double performance;  // achieved, GFLOP/s
+    double roof;         // attainable, GFLOP/s
+    double fraction;     // performance / roof
+};
+
+// Reduction of n floats: one load and one addition per element.
+inline roofline_kernel
+roofline_reduction(double n)
+{
+    return { "reduction", n * sizeof(float), n, "read" };
+}
+
+// Prefix sum of n doubles in place, in two passes: one load and one addition per element in
+// the first, a load, an addition and a store in the second.
+inline roofline_kernel
+roofline_scan(double n)
+{
+    return { "scan", n * 3 * sizeof(double), 2 * n, "copy" };
+}
+
+// Symmetrization of n (lower, upper) pairs in place: two loads, two stores, an addition and
+// a multiplication per pair.
+inline roofline_kernel
+roofline_symmetrize(double n)
+{
+    return { "symmetrize", n * 4 * sizeof(float), 2 * n, "copy" };
+}
+
+// Symmetric matrix-vector product with the diagonal and the lower triangle of an n x n matrix:
+// every element of the triangle is loaded once and used in two multiply-adds (for y_i and y_j);
+// x and y are assumed to be served from cache.
+inline roofline_kernel
+roofline_spmv(double n)
+{
+    const double t = n * (n - 1) / 2;
+    return { "spmv", (n + t) * sizeof(float), 2 * n + 4 * t, "read" };
+}
+
+// stencil_parallel_step() over a dim_x*dim_y*dim_z domain: Vin, Vsq and Vout are loaded and
+// Vout is stored once per point (neighbors are assumed to be served from cache). The center
+// term takes 1 flop, each ring 3 * (add, multiply, add), and the update 4 flops.
+inline roofline_kernel
+roofline_stencil(double dim_x, double dim_y, double dim_z, int radius, int steps)
+{
+    const double points = dim_x * dim_y * dim_z * steps;
+    return { "stencil", points * 4 * sizeof(float), points * (5 + 9 * radius), "triad" };
+}
+
+// Evaluate a kernel which took `time` seconds on `nodes` nodes of the calibrated machine.
+inline roofline_point
+roofline_evaluate(const roofline_kernel &kernel, double time, const roofline_domain &machine, int nodes = 1)
+{
+    roofline_point p;
+    p.intensity = kernel.flops / kernel.bytes;
+    p.bandwidth = kernel.bytes * 1e-9 / time;
+    p.performance = kernel.flops * 1e-9 / time;
+    p.roof = nodes * std::min(machine.peak, p.intensity * machine.bandwidth(kernel.stream));
+    p.fraction = p.performance / p.roof;
+    return p;
+}
+
+// Columns appended to the --bench output of the programs when --roofline is given
+constexpr const char *roofline_columns =
+    "Intensity[flop/B],Achieved[GB/s],Achieved[GFLOP/s],Roof[GFLOP/s],Roof[%]";
+
+inline void
+roofline_print_columns(std::FILE *stream, const roofline_point &p)
+{
+    std::fprintf(stream, ",%.6f,%.6f,%.6f,%.6f,%.2f",
+                 p.intensity, p.bandwidth, p.performance, p.roof, p.fraction * 100);
+}
+
+// Calibration file, as written by the roofline program
+inline void
+roofline_write_csv(std::ostream &stream, const std::vector<roofline_domain> &domains)
+{
+    stream << "Domain,Threads,Copy[GB/s],Triad[GB/s],Read[GB/s],Peak[GFLOP/s]\n";
+    for (const auto& d : domains) {
+        if (d.domain < 0) {
+            stream << "all";
+        } else {
+            stream << d.domain;
+        }
+        stream << "," << d.threads << "," << d.copy << "," << d.triad << "," << d.read << "," << d.peak << "\n";
+    }
+}
+
+// Read the whole-node entry of a calibration file
+inline std::optional<roofline_domain>
+roofline_read_csv(const std::string &file_path)
+{
+    std::ifstream ifs(file_path);
+    std::string line;
+    std::getline(ifs, line); // header
+
+    while (std::getline(ifs, line)) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream iss(line);
+        std::string domain;
+        roofline_domain d;
+
+        if (iss >> domain >> d.threads >> d.copy >> d.triad >> d.read >> d.peak && domain == "all") {
+            return d;
+        }
+    }
+    return std::nullopt;
+}
+
+#endif // ROOFLINE_HPP
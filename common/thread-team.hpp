@@ -0,0 +1,186 @@
+#ifndef THREAD_TEAM_HPP
+#define THREAD_TEAM_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Persistent team of threads for kernels that are too short to amortize an OpenMP fork/join.
+// The threads are created once, optionally pinned to one CPU each, and then spin on a
+// generation counter: run() publishes a job and bumps the counter, executes member 0 of the
+// job on the calling thread, and waits for a per-thread completion flag of every other member.
+// All shared state is padded to a cache line, so that a waiting thread only reads its own line
+// until the caller writes it.
+//
+// Idle members and the waiting caller spin (with a pause hint, yielding after a while), so a
+// team occupies its CPUs for its whole lifetime; it should not coexist with an active OpenMP
+// team on the same CPUs.
+
+constexpr std::size_t thread_team_line = 64;
+
+inline void
+thread_team_pin(std::thread::native_handle_type handle, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(handle, sizeof(set), &set); // best effort, e.g. cpu outside the cgroup
+}
+
+inline void
+thread_team_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+class ThreadTeam {
+public:
+    // Team of `threads` members including the calling thread; member k is pinned to
+    // cpus[k % cpus.size()], or not at all if cpus is empty.
+    explicit ThreadTeam(int threads, const std::vector<int>& cpus = {})
+        : _size(std::max(threads, 1)), _slots(new Slot[_size])
+    {
+        if (!cpus.empty()) {
+            thread_team_pin(pthread_self(), cpus[0]);
+        }
+        _workers.reserve(_size - 1);
+        for (int k = 1; k < _size; ++k) {
+            _workers.emplace_back([this, k] { work(k); });
+            if (!cpus.empty()) {
+                thread_team_pin(_workers.back().native_handle(), cpus[k % cpus.size()]);
+            }
+        }
+    }
+
+    ThreadTeam(const ThreadTeam&) = delete;
+    ThreadTeam& operator=(const ThreadTeam&) = delete;
+
+    ~ThreadTeam() {
+        _stop.store(true, std::memory_order_relaxed);
+        _generation.value.fetch_add(1, std::memory_order_release);
+        for (auto& w : _workers) {
+            w.join();
+        }
+    }
+
+    int size() const noexcept { return _size; }
+
+    // Call f(k) for every member k, and return when all calls have returned. Must only be
+    // called from the thread that created the team; f must not throw.
+    template <typename F>
+    void run(F& f) {
+        if (_size == 1) {
+            f(0);
+            return;
+        }
+        _job = [](void *data, int k) { (*static_cast<F*>(data))(k); };
+        _data = &f;
+        const unsigned g = _generation.value.fetch_add(1, std::memory_order_release) + 1;
+
+        f(0);
+        int spins = 0;
+        for (int k = 1; k < _size; ++k) {
+            while (_slots[k].done.load(std::memory_order_acquire) != g) {
+                if (++spins < spin_limit) {
+                    thread_team_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+private:
+    // Pause hints before an idle member starts yielding its CPU (roughly milliseconds)
+    static constexpr int spin_limit = 1 << 16;
+
+    struct alignas(thread_team_line) Slot {
+        std::atomic<unsigned> done{0}; // last generation completed by this member
+    };
+
+    struct alignas(thread_team_line) Counter {
+        std::atomic<unsigned> value{0};
+    };
+
+    void work(int k) {
+        unsigned seen = 0;
+        for (;;) {
+            unsigned g;
+            int spins = 0;
+            while ((g = _generation.value.load(std::memory_order_acquire)) == seen) {
+                if (++spins < spin_limit) {
+                    thread_team_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            seen = g;
+            if (_stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            _job(_data, k);
+            _slots[k].done.store(g, std::memory_order_release);
+        }
+    }
+
+    int _size;
+    std::unique_ptr<Slot[]> _slots;
+    std::vector<std::thread> _workers;
+    Counter _generation;
+    void (*_job)(void*, int) = nullptr; // published by the release on _generation
+    void *_data = nullptr;
+    std::atomic<bool> _stop{false};
+};
+
+// Partial sum of a thread, on its own cache line
+struct alignas(thread_team_line) ThreadTeamSum {
+    double value = 0;
+};
+
+// Sum of n floats in double precision. Arrays shorter than `threshold` are summed by the
+// calling thread alone; otherwise each member sums a contiguous block into its own slot of
+// `partial` (at least team.size() entries), and the caller adds the slots in member order.
+inline double
+thread_team_sum(ThreadTeam& team, const float* u, std::ptrdiff_t n, std::ptrdiff_t threshold,
+                ThreadTeamSum* partial)
+{
+    auto range_sum = [u](std::ptrdiff_t begin, std::ptrdiff_t end) {
+        double s = 0;
+    #pragma omp simd reduction(+:s)
+        for (std::ptrdiff_t i = begin; i < end; ++i) {
+            s += u[i];
+        }
+        return s;
+    };
+    if (n < threshold || team.size() == 1) {
+        return range_sum(0, n);
+    }
+    // Blocks are multiples of a cache line, so that members share no line of an aligned array
+    constexpr std::ptrdiff_t line = thread_team_line / sizeof(float);
+    const std::ptrdiff_t p = team.size();
+    const std::ptrdiff_t block = ((n + p - 1) / p + line - 1) / line * line;
+
+    auto job = [&](int k) {
+        const std::ptrdiff_t begin = std::min(n, k * block);
+        const std::ptrdiff_t end = std::min(n, begin + block);
+        partial[k].value = range_sum(begin, end);
+    };
+    team.run(job);
+
+    double sum = 0;
+    for (std::ptrdiff_t k = 0; k < p; ++k) {
+        sum += partial[k].value;
+    }
+    return sum;
+}
+
+#endif // THREAD_TEAM_HPP
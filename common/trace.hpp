@@ -0,0 +1,197 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+// Timeline tracing of distributed runs, written in the Chrome trace event format (JSON) which
+// can be opened with chrome://tracing or https://ui.perfetto.dev. Every thread records complete
+// events (name, begin, end) into its own ring buffer, so recording needs neither locks nor
+// atomics. Buffers are flushed by trace_write() at the end of the program; timestamps of all
+// ranks are aligned to the clock of rank 0.
+//
+// When tracing is not started, recording an event amounts to a single branch. Event names must
+// be string literals (or otherwise outlive the call to trace_write()).
+
+struct TraceEvent {
+    const char *name;
+    std::int64_t begin; // nanoseconds, local clock
+    std::int64_t end;
+};
+
+struct TraceBuffer {
+    std::vector<TraceEvent> events; // ring buffer
+    std::size_t count = 0;          // amount of recorded events, including overwritten ones
+    std::uint32_t tid = 0;
+    TraceBuffer *next = nullptr;    // list of all buffers, see trace_local_buffer()
+};
+
+struct TraceState {
+    bool enabled = false;
+    std::size_t capacity = 0;             // events per thread
+    std::int64_t offset = 0;              // local clock - clock of rank 0
+    std::int64_t origin = 0;              // start of the trace, clock of rank 0
+    std::atomic<TraceBuffer*> buffers{nullptr};
+    std::atomic<std::uint32_t> threads{0};
+};
+
+inline TraceState&
+trace_state()
+{
+    static TraceState state;
+    return state;
+}
+
+inline bool
+trace_enabled()
+{
+    return trace_state().enabled;
+}
+
+inline std::int64_t
+trace_now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Buffer of the calling thread, allocated and added to the (lock-free) list on first use.
+inline TraceBuffer*
+trace_local_buffer()
+{
+    thread_local TraceBuffer *buffer = nullptr;
+
+    if (buffer == nullptr) {
+        TraceState &state = trace_state();
+        buffer = new TraceBuffer;
+        buffer->events.resize(state.capacity);
+        buffer->tid = state.threads.fetch_add(1, std::memory_order_relaxed);
+        buffer->next = state.buffers.load(std::memory_order_relaxed);
+
+        while (!state.buffers.compare_exchange_weak(buffer->next, buffer,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed)) {}
+    }
+    return buffer;
+}
+
+inline void
+trace_record(const char *name, std::int64_t begin, std::int64_t end)
+{
+    if (!trace_enabled()) {
+        return;
+    }
+    TraceBuffer *buffer = trace_local_buffer();
+    buffer->events[buffer->count % buffer->events.size()] = { name, begin, end };
+    buffer->count++;
+}
+
+// Records an event spanning the lifetime of the object.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : _name(name), _begin(trace_enabled() ? trace_now() : 0)
+    {}
+
+    ~TraceScope() {
+        if (trace_enabled()) {
+            trace_record(_name, _begin, trace_now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char *_name;
+    std::int64_t _begin;
+};
+
+// Start recording, keeping the last `capacity` events per thread. Collective over upcxx::world().
+// The clock offset to rank 0 is estimated from the round trip with the lowest latency among a
+// few RPCs (Cristian's algorithm).
+inline void
+trace_start(std::size_t capacity = 1 << 16)
+{
+    TraceState &state = trace_state();
+    state.capacity = capacity;
+
+    if (upcxx::rank_me() != 0) {
+        std::int64_t best_rtt = std::numeric_limits<std::int64_t>::max();
+
+        for (int k = 0; k < 8; ++k) {
+            std::int64_t t0 = trace_now();
+            std::int64_t remote = upcxx::rpc(0, []() { return trace_now(); }).wait();
+            std::int64_t t1 = trace_now();
+
+            if (t1 - t0 < best_rtt) {
+                best_rtt = t1 - t0;
+                state.offset = (t0 + t1) / 2 - remote;
+            }
+        }
+    }
+    upcxx::barrier(); // rank 0 answers the RPCs while waiting here
+    state.origin = upcxx::broadcast(trace_now(), 0).wait();
+    state.enabled = true;
+}
+
+// Write all recorded events to file_path and stop recording. Collective over upcxx::world();
+// ranks append their events in rank order. Must be called outside of parallel regions.
+inline void
+trace_write(const std::string &file_path)
+{
+    TraceState &state = trace_state();
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+    state.enabled = false;
+
+    if (proc_id == 0) {
+        std::ofstream ofs(file_path, std::ofstream::trunc);
+        ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    }
+    for (int k = 0; k < proc_n; ++k) {
+        if (proc_id == k) {
+            std::ofstream ofs(file_path, std::ofstream::app);
+            ofs.precision(3);
+            ofs << std::fixed;
+
+            // Metadata event first, so every rank writes at least one event
+            ofs << (k == 0 ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << k
+                << ",\"args\":{\"name\":\"rank " << k << "\"}}";
+
+            for (TraceBuffer *buffer = state.buffers.load(std::memory_order_acquire);
+                 buffer != nullptr; buffer = buffer->next)
+            {
+                const std::size_t capacity = buffer->events.size();
+                const std::size_t first = buffer->count > capacity ? buffer->count - capacity : 0;
+
+                if (first > 0) {
+                    ofs << ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped " << first << " events\",\"pid\":"
+                        << k << ",\"tid\":" << buffer->tid << ",\"ts\":0}";
+                }
+                for (std::size_t i = first; i < buffer->count; ++i) {
+                    const TraceEvent &e = buffer->events[i % capacity];
+                    double ts = (e.begin - state.offset - state.origin) * 1e-3; // microseconds
+                    double dur = (e.end - e.begin) * 1e-3;
+
+                    ofs << ",\n{\"ph\":\"X\",\"name\":\"" << e.name << "\",\"pid\":" << k
+                        << ",\"tid\":" << buffer->tid << ",\"ts\":" << ts << ",\"dur\":" << dur << "}";
+                }
+                buffer->count = 0;
+            }
+            if (k == proc_n - 1) {
+                ofs << "\n]}\n";
+            }
+        }
+        upcxx::barrier();
+    }
+}
+
+#endif // TRACE_HPP
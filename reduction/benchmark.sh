@@ -17,8 +17,12 @@ run_upcxx_knl_dist=1
 run_openmp_skl_dist=1
 run_openmp_knl_dist=1
 
+# Node calibration for the roofline (csv/roofline-*.csv, see common/roofline.cpp)
+run_roofline=1
+
 # Number of iterations
 iterations=100
+warmup=3 # untimed iterations per size
 
 cmake() {
     command cmake -G Ninja -DCMAKE_TOOLCHAIN_FILE="$HOME/source/vcpkg/scripts/buildsystems/vcpkg.cmake" "$@"
@@ -36,44 +40,72 @@ mkdir build-shared
 cd build-shared
 UPCXX_NETWORK=smp cmake -DCMAKE_BUILD_TYPE=Release ../..
 ninja -v reduction-upcxx-knl reduction-upcxx-skl \
-         reduction-upcxx-openmp-knl reduction-upcxx-openmp-skl
+         reduction-upcxx-openmp-knl reduction-upcxx-openmp-skl \
+         scan-upcxx-openmp-knl scan-upcxx-openmp-skl
+
+# Roofline calibration, with the same thread placement as the OpenMP benchmarks
+((run_roofline)) && {
+    ninja -v roofline-skl roofline-knl
+    srun -w mp-media1 env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \
+        common/roofline-skl > ../roofline-skl.csv
+    srun -w mp-knl1 env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 \
+        common/roofline-knl > ../roofline-knl.csv
+}
 
 # SKL, UPCXX (4 processes)
 ((run_upcxx_skl)) && { 
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
-            reduction/reduction-upcxx-skl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
+        reduction/reduction-upcxx-skl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-shared-skl-upcxx.csv
 
 # KNL, UPCXX (64x4 processes)
 ((run_upcxx_knl)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        srun -w mp-knl1 upcxx-run -n 64 -shared-heap 80% \
-            reduction/reduction-upcxx-knl --size "$((1<<i))" --iterations "$iterations" --bench
-    done 
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-knl1 upcxx-run -n 64 -shared-heap 80% \
+        reduction/reduction-upcxx-knl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-shared-knl-upcxx.csv
 
 # SKL, UPCXX + OpenMP (1 process, 4 threads)
 ((run_openmp_skl)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 reduction/reduction-upcxx-openmp-skl --size "$((1<<i))" --iterations "$iterations" --bench
-    done 
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 reduction/reduction-upcxx-openmp-skl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-shared-skl-upcxx-openmp.csv
 
 # KNL, UPCXX + OpenMP (1 process, 64 threads)
 ((run_openmp_knl)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 reduction/reduction-upcxx-openmp-knl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 reduction/reduction-upcxx-openmp-knl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-shared-knl-upcxx-openmp.csv
 
+# SKL and KNL, UPCXX + persistent thread team (1 process, 4 resp. 64 threads), small sizes only
+((run_openmp_skl)) && {
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_NUM_THREADS=4 reduction/reduction-upcxx-openmp-skl --sweep "$((1<<10)):$((1<<22)):2" --warmup "$warmup" --iterations "$iterations" --bench --low-latency
+} > ../reduction-shared-skl-upcxx-openmp-low-latency.csv
+
+((run_openmp_knl)) && {
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_NUM_THREADS=64 reduction/reduction-upcxx-openmp-knl --sweep "$((1<<10)):$((1<<22)):2" --warmup "$warmup" --iterations "$iterations" --bench --low-latency
+} > ../reduction-shared-knl-upcxx-openmp-low-latency.csv
+
+# SKL and KNL, prefix sums with UPCXX + OpenMP (1 process, 4 resp. 64 threads)
+((run_openmp_skl)) && {
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 reduction/scan-upcxx-openmp-skl --sweep "$((1<<15)):$((1<<29)):2" --warmup "$warmup" --iterations "$iterations" --bench
+} > ../scan-shared-skl-upcxx-openmp.csv
+
+((run_openmp_knl)) && {
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 reduction/scan-upcxx-openmp-knl --sweep "$((1<<15)):$((1<<29)):2" --warmup "$warmup" --iterations "$iterations" --bench
+} > ../scan-shared-knl-upcxx-openmp.csv
+
 
 # ---------------------------------------
 # DISTRIBUTED
@@ -86,36 +118,46 @@ ninja -v reduction-upcxx-knl reduction-upcxx-skl \
 
 # SKL, UPCXX (16 processes)
 ((run_upcxx_skl_dist)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
-            reduction/reduction-upcxx-skl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
+        reduction/reduction-upcxx-skl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-dist-skl-upcxx.csv
 
 # KNL, UPCXX (256 processes)
 ((run_upcxx_knl_dist)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
-            reduction/reduction-upcxx-knl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
+        reduction/reduction-upcxx-knl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-dist-knl-upcxx.csv
 
+# SKL and KNL, UPCXX with the fastest reduction across ranks for the configuration, as
+# calibrated by the first run (stored in reduce-calibration.csv)
+((run_upcxx_skl_dist)) && {
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
+        reduction/reduction-upcxx-skl --calibrate --calibration ../reduce-calibration.csv
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
+        reduction/reduction-upcxx-skl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench --reduce auto --calibration ../reduce-calibration.csv
+} > ../reduction-dist-skl-upcxx-auto.csv
+
+((run_upcxx_knl_dist)) && {
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
+        reduction/reduction-upcxx-knl --calibrate --calibration ../reduce-calibration.csv
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
+        reduction/reduction-upcxx-knl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench --reduce auto --calibration ../reduce-calibration.csv
+} > ../reduction-dist-knl-upcxx-auto.csv
+
 # SKL, UPCXX + OpenMP (4 processes, 4x4 threads)
 ((run_openmp_skl_dist)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 reduction/reduction-upcxx-openmp-skl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 reduction/reduction-upcxx-openmp-skl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-dist-skl-upcxx-openmp.csv
 
 # KNL, UPCXX + OpenMP (4 processes, 64x4 threads)
 ((run_openmp_knl_dist)) && {
-    printf 'Size,Time[s],Throughput[GB/s]\n'
-    for i in {15..30}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 reduction/reduction-upcxx-openmp-knl --size "$((1<<i))" --iterations "$iterations" --bench
-    done
+    printf 'Size,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 reduction/reduction-upcxx-openmp-knl --sweep "$((1<<15)):$((1<<30)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../reduction-dist-knl-upcxx-openmp.csv
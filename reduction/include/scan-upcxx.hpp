@@ -0,0 +1,169 @@
+#ifndef SCAN_UPCXX_HPP
+#define SCAN_UPCXX_HPP
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <upcxx/upcxx.hpp>
+
+// Prefix sums over an array that is block-distributed between ranks as in the reduction, in
+// place and with the sums accumulated in double precision. The scan takes two passes over the
+// local block: the threads of a rank first sum their part of the block (a read), then the rank
+// totals are scanned across ranks, and finally every thread scans its part starting at the sum
+// of everything before it (a read and a write). Within a thread, the scan is vectorized with an
+// OpenMP 5.0 `scan` directive.
+//
+// The passes are separate OpenMP regions with the same static partition and thread count, so
+// that with OMP_PROC_BIND every thread reads its part from its own cache in the second pass.
+// Parts are distributed with a static loop, so that a team with fewer threads than requested
+// (e.g. with OMP_DYNAMIC) still covers all of them.
+
+namespace scan_detail
+{
+constexpr std::ptrdiff_t cache_line = 64;
+
+// Part [begin, end) of thread k of p in a block of n elements of T, in multiples of a cache line
+template <typename T>
+std::pair<std::ptrdiff_t, std::ptrdiff_t>
+thread_range(std::ptrdiff_t n, int k, int p)
+{
+    constexpr std::ptrdiff_t line = cache_line / static_cast<std::ptrdiff_t>(sizeof(T));
+    const std::ptrdiff_t chunk = ((n + p - 1) / p + line - 1) / line * line;
+    const std::ptrdiff_t begin = std::min(n, k * chunk);
+    return {begin, std::min(n, begin + chunk)};
+}
+
+} // namespace scan_detail
+
+// Partial sum of a thread, on its own cache line
+struct alignas(scan_detail::cache_line) ScanPartial {
+    double value = 0;
+};
+
+// Inclusive scan of a[0, n) in place, starting at offset; returns offset + sum of a
+template <typename T>
+double
+scan_local_inclusive(T* a, std::ptrdiff_t n, double offset)
+{
+    double s = offset;
+#pragma omp simd reduction(inscan, +:s)
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+        s += a[i];
+#pragma omp scan inclusive(s)
+        a[i] = s;
+    }
+    return s;
+}
+
+// Exclusive scan of a[0, n) in place, starting at offset. The input of each chunk is copied
+// to the stack first, as the input and scan phases of an iteration may not touch the same
+// element.
+template <typename T>
+double
+scan_local_exclusive(T* a, std::ptrdiff_t n, double offset)
+{
+    constexpr std::ptrdiff_t chunk = 256;
+    T x[chunk];
+    double s = offset;
+
+    for (std::ptrdiff_t c = 0; c < n; c += chunk) {
+        const std::ptrdiff_t m = std::min(chunk, n - c);
+        T* out = a + c;
+        std::copy(out, out + m, x);
+#pragma omp simd reduction(inscan, +:s)
+        for (std::ptrdiff_t l = 0; l < m; ++l) {
+            out[l] = s;
+#pragma omp scan exclusive(s)
+            s += x[l];
+        }
+    }
+    return s;
+}
+
+// First pass: sum of the part of every thread into partial (one entry per thread, which fixes
+// the thread count of both passes); returns the sum of the block
+template <typename T>
+double
+scan_partial_sums(const T* a, std::ptrdiff_t n, std::vector<ScanPartial>& partial)
+{
+    const int p = static_cast<int>(partial.size());
+
+#pragma omp parallel for schedule(static) num_threads(p)
+    for (int k = 0; k < p; ++k) {
+        const auto [begin, end] = scan_detail::thread_range<T>(n, k, p);
+        double s = 0;
+#pragma omp simd reduction(+:s)
+        for (std::ptrdiff_t i = begin; i < end; ++i) {
+            s += a[i];
+        }
+        partial[k].value = s;
+    }
+    double sum = 0;
+    for (const auto& s : partial) {
+        sum += s.value;
+    }
+    return sum;
+}
+
+// Second pass: scan of the part of every thread, starting at offset plus the partial sums of
+// the threads before it
+template <typename T>
+void
+scan_apply(T* a, std::ptrdiff_t n, const std::vector<ScanPartial>& partial, double offset, bool exclusive)
+{
+    const int p = static_cast<int>(partial.size());
+
+#pragma omp parallel for schedule(static) num_threads(p)
+    for (int k = 0; k < p; ++k) {
+        const auto [begin, end] = scan_detail::thread_range<T>(n, k, p);
+        double start = offset;
+        for (int j = 0; j < k; ++j) {
+            start += partial[j].value;
+        }
+        if (exclusive) {
+            scan_local_exclusive(a + begin, end - begin, start);
+        } else {
+            scan_local_inclusive(a + begin, end - begin, start);
+        }
+    }
+}
+
+// Sum of the totals of all lower ranks (the exclusive scan of one value per rank) and the sum
+// over all ranks. Collective over upcxx::world(). The totals are gathered on every rank with
+// a reduce_all of an array which is zero except for the entry of the rank, so that all ranks
+// add them in rank order; `buffer` is reused between calls.
+inline std::pair<double, double>
+scan_ranks(double total, std::vector<double>& buffer)
+{
+    const upcxx::intrank_t n = upcxx::rank_n();
+    const upcxx::intrank_t me = upcxx::rank_me();
+    buffer.assign(2 * n, 0.0);
+    buffer[me] = total;
+    upcxx::reduce_all(buffer.data(), buffer.data() + n, n, upcxx::op_fast_add).wait();
+
+    double offset = 0;
+    double sum = 0;
+    for (upcxx::intrank_t k = 0; k < n; ++k) {
+        if (k == me) {
+            offset = sum;
+        }
+        sum += buffer[n + k];
+    }
+    return {offset, sum};
+}
+
+// Inclusive or exclusive scan of the local block a[0, n) of a block-distributed array, in
+// place; returns the sum over all ranks. Collective over upcxx::world().
+template <typename T>
+double
+scan_distributed(T* a, std::ptrdiff_t n, bool exclusive, std::vector<ScanPartial>& partial,
+                 std::vector<double>& buffer)
+{
+    const double total = scan_partial_sums(a, n, partial);
+    const auto [offset, sum] = scan_ranks(total, buffer);
+    scan_apply(a, n, partial, offset, exclusive);
+    return sum;
+}
+
+#endif // SCAN_UPCXX_HPP
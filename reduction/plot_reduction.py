@@ -1,3 +1,4 @@
+import os
 import pandas as pd
 import seaborn as sns
 import numpy as np
@@ -28,13 +29,25 @@ def set_ax(ax,min,max):
                         a.set_title("Distributed Memory",fontsize=20)
                 a.grid(True,which="both",ls="-")
 
-def plot_df(df1,df2):
+def overlay_roofline(ax,path,partition,column,nodes):
+#       Horizontal line at the calibrated bandwidth of the node(s), see common/roofline.cpp
+        if not os.path.exists(path):
+                return
+        df = pd.read_csv(path)
+        bw = df[df['Domain'] == 'all'][column].iloc[0] * nodes
+        ax.axhline(bw,ls='--',lw=1,color='gray')
+        ax.annotate(partition+' '+column.split('[')[0].lower(),xy=(15,bw),fontsize=8,color='gray',va='bottom')
+
+def plot_df(df1,df2,rooflines=[]):
         global_max,global_min = find_limits(df1,df2)
         sns.set_style("white")
         fig, axes = plt.subplots(1,2,sharex=True,figsize=(15,7))
         sns.lineplot(ax=axes[0],data=df1,x=[x for x in range(15,31)]*2,y='Throughput[GB/s]',hue='Partition',marker='X',legend=True)
         sns.lineplot(ax=axes[1],data=df2,x=[x for x in range(15,31)]*2,y='Throughput[GB/s]',hue='Partition',marker='X',legend=True)
         set_ax(axes,global_min,global_max)
+        for path,partition,nodes in rooflines:
+                overlay_roofline(axes[0],path,partition,'Read[GB/s]',1)
+                overlay_roofline(axes[1],path,partition,'Read[GB/s]',nodes)
         fig.savefig('reduction.png', bbox_inches='tight')
         fig.savefig('reduction.pdf')
 
@@ -45,6 +58,8 @@ if __name__ == "__main__":
         knl_shared = 'csv/reduction-shared-knl-upcxx.csv'
         skl_dist = 'csv/reduction-dist-skl-upcxx.csv'
         knl_dist = 'csv/reduction-dist-knl-upcxx.csv'
+#       Optional node calibration (roofline program), drawn if present; nodes of the distributed runs
+        rooflines = [('csv/roofline-skl.csv','Media',4), ('csv/roofline-knl.csv','Knl',4)]
 
         skl = build_df(skl_shared,'Media')
         knl = build_df(knl_shared,'Knl')
@@ -52,4 +67,4 @@ if __name__ == "__main__":
         skl = build_df(skl_dist,'Media')
         knl = build_df(knl_dist,'Knl')
         dist = pd.concat([skl,knl])
-        plot_df(shared,dist)
+        plot_df(shared,dist,rooflines)
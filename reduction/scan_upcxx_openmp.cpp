@@ -0,0 +1,305 @@
+#include <iostream>
+#include <random>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <optional>
+#include <limits>
+#include <fstream>
+#include <tuple>
+
+#include <lyra/lyra.hpp>
+#include <omp.h>
+#include <upcxx/upcxx.hpp>
+
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+#include "include/scan-upcxx.hpp"
+
+using Clock = std::chrono::high_resolution_clock;
+using Duration = std::chrono::duration<double>;
+
+template <typename T>
+using time_point = std::chrono::time_point<T>;
+using index_t = std::ptrdiff_t;
+
+
+int main(int argc, char** argv)
+{
+    index_t size = 0; // array size
+    int seed = 42; // seed for pseudo-random generator
+    int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
+    bool exclusive = false;
+    bool check = false;
+    bool write = false;
+    bool bench = false;
+    bool show_help = false;
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
+
+    auto cli = lyra::help(show_help) |
+        lyra::opt(size, "size")["-N"]["--size"](
+            "Size of scanned array, must be specified") |
+        lyra::opt(iterations, "iterations")["--iterations"](
+            "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all sizes from min to max (multiplied by factor, default 2) in a single run") |
+        lyra::opt(exclusive)["--exclusive"](
+            "Compute exclusive instead of inclusive prefix sums") |
+        lyra::opt(check)["--check"](
+            "Compare the prefix sums of every rank with a sequential scan, and fail on a difference") |
+        lyra::opt(write)["--write"](
+            "Print the sum of the array (the last inclusive prefix sum) to standard output") |
+        lyra::opt(bench)["--bench"](
+            "Print benchmarks to standard output") |
+        lyra::opt(seed, "seed")["--seed"](
+            "Seed for pseudo-random number generation, default is 42") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
+    auto result = cli.parse({argc, argv});
+
+    if (!result) {
+		std::cerr << "Error in command line: " << result.errorMessage()
+			  << std::endl;
+		exit(1);
+	}
+	if (show_help) {
+		std::cout << cli << std::endl;
+		exit(0);
+	}
+
+    // Array sizes, a single one unless --sweep is given
+    std::vector<index_t> sizes{size};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        sizes = *swept;
+    } else if (size <= 0) {
+        std::cerr << "a positive array size is required (specify with --size)" << std::endl;
+        std::exit(1);
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // BEGIN PARALLEL REGION
+    upcxx::init();
+    int nproc = upcxx::rank_n();
+    int proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
+    const char* program = exclusive ? "scan-upcxx-openmp-exclusive" : "scan-upcxx-openmp";
+    std::vector<ScanPartial> partial(omp_get_max_threads());
+    std::vector<double> buffer;
+    index_t failures = 0;
+
+    for (const index_t N : sizes) {
+        // Block size for each process
+        const index_t block_size = N / nproc;
+        assert(block_size % 2 == 0);
+        assert(N == block_size * nproc);
+
+        // Allocate arrays, with blocks divided between processes. The values are the same as in
+        // the reduction, but stored as double so that all prefix sums are exact. As the scan is
+        // in place, every iteration starts from a copy of the initial values.
+        timer.start(phase::init);
+        double* u0 = new double[block_size];
+        double* u = new double[block_size];
+        std::mt19937_64 rgen(seed);
+
+    #pragma omp parallel firstprivate(rgen)
+    {
+        const int threads = omp_get_num_threads();
+        const index_t block_size_omp = block_size / threads;
+        assert(block_size_omp % 2 == 0);
+        assert(block_size == block_size_omp * threads);
+
+        rgen.discard((proc_id * threads + omp_get_thread_num()) * block_size_omp);
+
+        // Initialize vector with pseudo-random values (consistent with serial version)
+    #pragma omp for schedule(static)
+        for (index_t i = 0; i < block_size; ++i) {
+            u0[i] = 0.5 + rgen() % 100;
+        }
+    }
+        timer.stop(phase::init);
+
+        // Timings for different iterations; the mean is taken later.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+
+        // Prefix sums
+        for (int iter = 1 - warmup; iter <= iterations; ++iter)
+        {
+            timer.start(phase::init);
+            std::copy(u0, u0 + block_size, u);
+            timer.stop(phase::init);
+
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+
+            // Partial sums of the threads (first pass)
+            timer.start(phase::compute);
+            counters.start();
+            double total(0);
+            {
+                TraceScope ts("partial sum");
+                total = scan_partial_sums(u, block_size, partial);
+            }
+            counters.stop();
+            timer.stop(phase::compute);
+
+            // Offset of this rank: exclusive scan of the rank totals
+            timer.start(phase::collective);
+            double offset = 0;
+            double sum = 0;
+            {
+                TraceScope ts("scan ranks");
+                std::tie(offset, sum) = scan_ranks(total, buffer);
+            }
+            timer.stop(phase::collective);
+
+            // Prefix sums of the threads (second pass)
+            timer.start(phase::compute);
+            counters.start();
+            {
+                TraceScope ts("scan");
+                scan_apply(u, block_size, partial, offset, exclusive);
+            }
+            counters.stop();
+            timer.stop(phase::compute);
+
+            // All ranks are done when the slowest one is
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
+
+            if (write && iter > 0 && proc_id == 0) {
+                timer.start(phase::io);
+                std::cout << sum << std::endl;
+                timer.stop(phase::io);
+            }
+        }
+
+        if (check) {
+            // Sequential scan of all values up to the end of this block
+            std::mt19937_64 rseq(seed);
+            double s = 0;
+            for (index_t i = 0; i < proc_id * block_size; ++i) {
+                s += 0.5 + rseq() % 100;
+            }
+            index_t wrong = 0;
+            for (index_t i = 0; i < block_size; ++i) {
+                const double x = 0.5 + rseq() % 100;
+                const double expected = exclusive ? s : s + x;
+                s += x;
+                if (u[i] != expected && wrong++ == 0) {
+                    std::cerr << "rank " << proc_id << ": prefix sum " << u[i] << " at index "
+                              << proc_id * block_size + i << ", expected " << expected << std::endl;
+                }
+            }
+            failures += upcxx::reduce_all(wrong, upcxx::op_fast_add).wait();
+        }
+
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean; // average time
+
+            if (bench) {
+                // Two reads and one write of every element
+                double throughput = 3 * N * sizeof(double) * 1e-9 / time;
+                std::fprintf(stdout, "%ld,%.12f,%.12f", N, time, throughput);
+                bench_print_stats(stdout, stats);
+                if (machine) {
+                    // Roofline of all nodes, assuming the same amount of ranks on every node
+                    int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                    auto kernel = roofline_scan(N);
+                    roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+                }
+                std::fprintf(stdout, "\n");
+            }
+        }
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
+
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, program,
+                                  {{"size", N}, {"iterations", iterations}, {"threads", omp_get_max_threads()}}, stats);
+            }
+        }
+        delete[] u;
+        delete[] u0;
+
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, program, {{"size", N}, {"iterations", iterations}, {"threads", omp_get_max_threads()}},
+                                counters, timer.elapsed(phase::compute));
+        }
+        timer.reset();
+        counters.reset();
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
+    upcxx::finalize();
+    // END PARALLEL REGION
+
+    if (failures > 0) {
+        if (proc_id == 0) {
+            std::cerr << failures << " prefix sums differ from the sequential scan" << std::endl;
+        }
+        std::exit(1);
+    }
+}
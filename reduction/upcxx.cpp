@@ -7,12 +7,22 @@
 #include <string>
 #include <chrono>
 #include <vector>
+#include <optional>
 #include <algorithm>
 #include <limits>
+#include <fstream>
+#include <memory>
 
 #include <lyra/lyra.hpp>
 #include <upcxx/upcxx.hpp>
 
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/reduce-select.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
 
@@ -22,24 +32,51 @@ using index_t = std::ptrdiff_t;
 
 int main(int argc, char** argv) 
 {
-    index_t N = 0; // array size
+    index_t size = 0; // array size
     int seed = 42; // seed for pseudo-random generator
     int iterations = 1; // repeats when using benchmark
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
     bool write = false;
     bool bench = false;
     bool show_help = false;
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
+    std::string reduce_name = "reduce-one"; // algorithm of the reduction across ranks, or "auto"
+    bool calibrate = false; // time all reduction algorithms and store the fastest
+    std::string calibration_path = "reduce-calibration.csv";
 
     auto cli = lyra::help(show_help) |
-        lyra::opt(N, "size")["-N"]["--size"](
+        lyra::opt(size, "size")["-N"]["--size"](
             "Size of reduced array, must be specified") |
         lyra::opt(iterations, "iterations")["--iterations"](
             "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all sizes from min to max (multiplied by factor, default 2) in a single run") |
         lyra::opt(write)["--write"](
             "Print reduction value to standard output") |
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(seed, "seed")["--seed"](
-            "Seed for pseudo-random number generation, default is 42");
+            "Seed for pseudo-random number generation, default is 42") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file") |
+        lyra::opt(reduce_name, "algorithm")["--reduce"](
+            "Reduction across ranks: reduce-one (default), atomic, rput, recursive-doubling, hierarchical, or auto (fastest in the calibration file)") |
+        lyra::opt(calibrate)["--calibrate"](
+            "Time all reduction algorithms, store the fastest for this conduit and amount of ranks in the calibration file, and use it") |
+        lyra::opt(calibration_path, "file")["--calibration"](
+            "Calibration file of --reduce auto and --calibrate, default is reduce-calibration.csv");
     auto result = cli.parse({argc, argv});
 
     if (!result) {
@@ -51,67 +88,186 @@ int main(int argc, char** argv)
 		std::cout << cli << std::endl;
 		exit(0);
 	}
-    if (N <= 0) {
+
+    // Array sizes, a single one unless --sweep is given
+    std::vector<index_t> sizes{size};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        sizes = *swept;
+    } else if (size <= 0 && calibrate) {
+        sizes.clear(); // calibration only
+    } else if (size <= 0) {
         std::cerr << "a positive array size is required (specify with --size)" << std::endl;
         std::exit(1);
     }
 
+    std::optional<reduce_algorithm> algorithm;
+    if (reduce_name != "auto") {
+        algorithm = reduce_algorithm_parse(reduce_name);
+        if (!algorithm) {
+            std::cerr << "unknown reduction algorithm " << reduce_name << std::endl;
+            std::exit(1);
+        }
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
     // BEGIN PARALLEL REGION
     upcxx::init();
     int nproc = upcxx::rank_n();
     int proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
 
-    // Block size for each process
-    const index_t block_size = N / nproc;
-    assert(block_size % 2 == 0);
-    assert(N == block_size * nproc);
-
-    // Initialize array, with blocks divided between processes
-    std::vector<float> u(block_size);
+    // Reduction across ranks, chosen per conduit and amount of ranks (per node)
+    auto reducer = std::make_unique<Reducer>();
+    const int local_nproc = upcxx::local_team().rank_n();
+    if (calibrate) {
+        auto times = reduce_calibrate(*reducer);
+        algorithm = reduce_fastest(times);
 
-    // Fill with random values (consistent with sequential version)
-    std::mt19937_64 rgen(seed);
-    rgen.discard(proc_id * block_size);
-    for (index_t i = 0; i < block_size; ++i) {
-        u[i] = 0.5 + rgen() % 100;
+        if (proc_id == 0) {
+            for (std::size_t k = 0; k < reduce_algorithm_count; ++k) {
+                std::cerr << reduce_algorithm_name(static_cast<reduce_algorithm>(k)) << ": " << times[k] << " s" << std::endl;
+            }
+            if (!reduce_calibration_write(calibration_path, reduce_conduit(), nproc, local_nproc,
+                                          *algorithm, times[static_cast<std::size_t>(*algorithm)])) {
+                std::cerr << "could not write " << calibration_path << std::endl;
+            }
+        }
+    } else if (!algorithm) {
+        int found = -1;
+        if (proc_id == 0) {
+            auto stored = reduce_calibration_read(calibration_path, reduce_conduit(), nproc, local_nproc);
+            if (stored) {
+                found = static_cast<int>(*stored);
+            } else {
+                std::cerr << "no calibration for " << reduce_conduit() << " with " << nproc << " ranks (" << local_nproc
+                          << " per node) in " << calibration_path << ", using reduce-one" << std::endl;
+            }
+        }
+        found = upcxx::broadcast(found, 0).wait();
+        algorithm = found < 0 ? reduce_algorithm::reduce_one : static_cast<reduce_algorithm>(found);
     }
 
-    // Timings for different iterations, of which the mean is taken.
-    std::vector<double> vt;
-    vt.reserve(iterations);
-    // Reduction
-    for (int iter = 1; iter <= iterations; ++iter) 
-    {
-        // Set a barrier before doing any timing
-        upcxx::barrier();
-        time_point<Clock> t = Clock::now();
-        
-        // Compute partial sums and reduce on process 0
-        double psum(0);
+    for (const index_t N : sizes) {
+        // Block size for each process
+        const index_t block_size = N / nproc;
+        assert(block_size % 2 == 0);
+        assert(N == block_size * nproc);
+
+        // Initialize array, with blocks divided between processes
+        timer.start(phase::init);
+        std::vector<float> u(block_size);
+
+        // Fill with random values (consistent with sequential version)
+        std::mt19937_64 rgen(seed);
+        rgen.discard(proc_id * block_size);
         for (index_t i = 0; i < block_size; ++i) {
-            psum += u[i];
+            u[i] = 0.5 + rgen() % 100;
         }
-        double sum = upcxx::reduce_one(psum, upcxx::op_fast_add, 0).wait();
+        timer.stop(phase::init);
 
-        if (proc_id == 0) {
-            Duration d = Clock::now() - t;
-            double time = d.count(); // time in seconds
-            vt.push_back(time);
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+        // Reduction
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) 
+        {
+            // Set a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+        
+            // Compute partial sums and reduce on process 0
+            timer.start(phase::compute);
+            counters.start();
+            double psum(0);
+            for (index_t i = 0; i < block_size; ++i) {
+                psum += u[i];
+            }
+            counters.stop();
+            timer.stop(phase::compute);
+
+            timer.start(phase::collective);
+            double sum = 0;
+            {
+                TraceScope ts(reduce_algorithm_name(*algorithm));
+                sum = reducer->sum(psum, *algorithm);
+            }
+            timer.stop(phase::collective);
+
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
+
+            if (write && iter > 0) {
+                timer.start(phase::io);
+                std::cout << sum << std::endl;
+                timer.stop(phase::io);
+            }
         }
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean; // average time
 
-        if (write) {
-            std::cout << sum << std::endl;
+            if (bench) {
+                double throughput = N * sizeof(float) * 1e-9 / time;
+                std::fprintf(stdout, "%ld,%.12f,%.12f", N, time, throughput);
+                bench_print_stats(stdout, stats);
+                if (machine) {
+                    // Roofline of all nodes, assuming the same amount of ranks on every node
+                    int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                    auto kernel = roofline_reduction(N);
+                    roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+                }
+                std::fprintf(stdout, "\n");
+            }
         }
-    }
-    if (proc_id == 0) {
-        double time = std::accumulate(vt.begin(), vt.end(), 0.);
-        time /= vt.size(); // average time
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
 
-        if (bench) {
-            double throughput = N * sizeof(float) * 1e-9 / time;
-            std::fprintf(stdout, "%ld,%.12f,%.12f\n", N, time, throughput);
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, "reduction-upcxx", {{"size", N}, {"iterations", iterations}}, stats);
+            }
+        }
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, "reduction-upcxx", {{"size", N}, {"iterations", iterations}},
+                                counters, timer.elapsed(phase::compute));
         }
+        timer.reset();
+        counters.reset();
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
     }
+    reducer.reset();
     upcxx::finalize();
     // END PARALLEL REGION
 }
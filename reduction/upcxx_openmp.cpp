@@ -8,12 +8,22 @@
 #include <chrono>
 #include <algorithm>
 #include <vector>
+#include <optional>
 #include <limits>
+#include <fstream>
+#include <memory>
 
 #include <lyra/lyra.hpp>
 #include <omp.h>
 #include <upcxx/upcxx.hpp>
 
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/thread-team.hpp"
+#include "../common/trace.hpp"
+
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
 
@@ -24,24 +34,48 @@ using index_t = std::ptrdiff_t;
 
 int main(int argc, char** argv) 
 {
-    index_t N = 0; // array size
+    index_t size = 0; // array size
     int seed = 42; // seed for pseudo-random generator
     int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
     bool write = false;
     bool bench = false;
     bool show_help = false;
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
+    bool low_latency = false; // persistent thread team instead of OpenMP regions
+    index_t threshold = 1 << 16; // block size below which one thread sums (with --low-latency)
 
     auto cli = lyra::help(show_help) |
-        lyra::opt(N, "size")["-N"]["--size"](
+        lyra::opt(size, "size")["-N"]["--size"](
             "Size of reduced array, must be specified") |
         lyra::opt(iterations, "iterations")["--iterations"](
             "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all sizes from min to max (multiplied by factor, default 2) in a single run") |
         lyra::opt(write)["--write"](
             "Print reduction value to standard output") |
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(seed, "seed")["--seed"](
-            "Seed for pseudo-random number generation, default is 42");
+            "Seed for pseudo-random number generation, default is 42") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file") |
+        lyra::opt(low_latency)["--low-latency"](
+            "Compute partial sums with a persistent team of pinned threads instead of an OpenMP region") |
+        lyra::opt(threshold, "threshold")["--threshold"](
+            "With --low-latency, sum blocks smaller than threshold on a single thread, default is 65536");
     auto result = cli.parse({argc, argv});
     
     if (!result) {
@@ -53,82 +87,188 @@ int main(int argc, char** argv)
 		std::cout << cli << std::endl;
 		exit(0);
 	}
-    if (N <= 0) {
+
+    // Array sizes, a single one unless --sweep is given
+    std::vector<index_t> sizes{size};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        sizes = *swept;
+    } else if (size <= 0) {
         std::cerr << "a positive array size is required (specify with --size)" << std::endl;
         std::exit(1);
     }
 
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
     // BEGIN PARALLEL REGION
     upcxx::init();
     int nproc = upcxx::rank_n();
     int proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
+    // Created after the counters are opened, and placed on the OpenMP places (OMP_PLACES) if
+    // there are any. Otherwise the threads are not pinned, as ranks on the same node share
+    // the same affinity mask and would all be pinned to its first CPUs.
+    std::unique_ptr<ThreadTeam> team;
+    std::vector<ThreadTeamSum> partial;
+    if (low_latency) {
+        const int threads = omp_get_max_threads();
+        std::vector<int> cpus;
+        if (omp_get_num_places() > 0) {
+            for (int k = 0; k < threads; ++k) {
+                std::vector<int> ids(omp_get_place_num_procs(k % omp_get_num_places()));
+                omp_get_place_proc_ids(k % omp_get_num_places(), ids.data());
+                cpus.push_back(ids.empty() ? 0 : ids[0]);
+            }
+        }
+        team = std::make_unique<ThreadTeam>(threads, cpus);
+        partial.resize(threads);
+    }
+    const char* program = low_latency ? "reduction-upcxx-openmp-low-latency" : "reduction-upcxx-openmp";
 
-    // Block size for each process
-    const index_t block_size = N / nproc;
-    assert(block_size % 2 == 0);
-    assert(N == block_size * nproc);
+    for (const index_t N : sizes) {
+        // Block size for each process
+        const index_t block_size = N / nproc;
+        assert(block_size % 2 == 0);
+        assert(N == block_size * nproc);
 
-    // Allocate array, with blocks divided between processes
-    float* u = new float[N];
-    std::mt19937_64 rgen(seed);
+        // Allocate array, with blocks divided between processes
+        timer.start(phase::init);
+        float* u = new float[N];
+        std::mt19937_64 rgen(seed);
 
-#pragma omp parallel firstprivate(rgen)
-{
-    const int threads = omp_get_num_threads();
-    const index_t block_size_omp = block_size / threads;
-    assert(block_size_omp % 2 == 0);
-    assert(block_size == block_size_omp * threads);
+    #pragma omp parallel firstprivate(rgen)
+    {
+        const int threads = omp_get_num_threads();
+        const index_t block_size_omp = block_size / threads;
+        assert(block_size_omp % 2 == 0);
+        assert(block_size == block_size_omp * threads);
 
-    rgen.discard((proc_id * threads + omp_get_thread_num()) * block_size_omp);
+        rgen.discard((proc_id * threads + omp_get_thread_num()) * block_size_omp);
 
-    // Initialize vector with pseudo-random values (consistent with serial version)
-#pragma omp for schedule(static)
-    for (index_t i = 0; i < block_size; ++i) {
-        u[i] = 0.5 + rgen() % 100;
+        // Initialize vector with pseudo-random values (consistent with serial version)
+    #pragma omp for schedule(static)
+        for (index_t i = 0; i < block_size; ++i) {
+            u[i] = 0.5 + rgen() % 100;
+        }
     }
-}
-    // Timings for different iterations; the mean is taken later.
-    std::vector<double> vt;
-    vt.reserve(iterations);
+        timer.stop(phase::init);
 
-    // Reduction
-    for (int iter = 1; iter <= iterations; ++iter)
-    {
-        // Set up a barrier before doing any timing
-        upcxx::barrier();
-        time_point<Clock> t = Clock::now();
+        // Timings for different iterations; the mean is taken later.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+
+        // Reduction
+        for (int iter = 1 - warmup; iter <= iterations; ++iter)
+        {
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
         
-        // Compute partial sums (threading)
-        double psum(0);
-#pragma omp parallel for simd schedule(static) reduction(+:psum)
-        for (index_t i = 0; i < block_size; ++i) {
-            psum += u[i];
-        } // barrier
+            // Compute partial sums (threading)
+            timer.start(phase::compute);
+            counters.start();
+            double psum(0);
+            if (team) {
+                TraceScope ts("partial sum");
+                psum = thread_team_sum(*team, u, block_size, threshold, partial.data());
+            } else {
+    #pragma omp parallel
+    {
+            TraceScope ts("partial sum");
+    #pragma omp for simd schedule(static) reduction(+:psum) nowait
+            for (index_t i = 0; i < block_size; ++i) {
+                psum += u[i];
+            }
+    } // barrier
+            }
+            counters.stop();
+            timer.stop(phase::compute);
 
-        // Reduce and store result on process 0
-        double sum = upcxx::reduce_one(psum, upcxx::op_fast_add, 0).wait();
+            // Reduce and store result on process 0
+            timer.start(phase::collective);
+            double sum = 0;
+            {
+                TraceScope ts("reduce_one");
+                sum = upcxx::reduce_one(psum, upcxx::op_fast_add, 0).wait();
+            }
+            timer.stop(phase::collective);
 
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
+
+            if (write && iter > 0) {
+                timer.start(phase::io);
+                std::cout << sum << std::endl;
+                timer.stop(phase::io);
+            }
+        }
         if (proc_id == 0) {
-            Duration d = Clock::now() - t;
-            double time = d.count(); // time in seconds
-            vt.push_back(time);
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean; // average time
+
+            if (bench) {
+                double throughput = N * sizeof(float) * 1e-9 / time;
+                std::fprintf(stdout, "%ld,%.12f,%.12f", N, time, throughput);
+                bench_print_stats(stdout, stats);
+                if (machine) {
+                    // Roofline of all nodes, assuming the same amount of ranks on every node
+                    int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                    auto kernel = roofline_reduction(N);
+                    roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+                }
+                std::fprintf(stdout, "\n");
+            }
         }
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
 
-        if (write) {
-            std::cout << sum << std::endl;
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, program, 
+                                  {{"size", N}, {"iterations", iterations}, {"threads", omp_get_max_threads()}}, stats);
+            }
         }
-    }
-    if (proc_id == 0) {
-        double time = std::accumulate(vt.begin(), vt.end(), 0.);
-        time /= vt.size(); // average time
+        delete[] u;
 
-        if (bench) {
-            double throughput = N * sizeof(float) * 1e-9 / time;
-            std::fprintf(stdout, "%ld,%.12f,%.12f\n", N, time, throughput);
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, program, {{"size", N}, {"iterations", iterations}, {"threads", omp_get_max_threads()}},
+                                counters, timer.elapsed(phase::compute));
         }
+        timer.reset();
+        counters.reset();
     }
-    delete[] u;
-
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
+    team.reset();
     upcxx::finalize();
     // END PARALLEL REGION
 }
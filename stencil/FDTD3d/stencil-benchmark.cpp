@@ -1,6 +1,11 @@
 #include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <numeric>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -9,6 +14,8 @@
 //#include <malloc.h>
 #include <omp.h>
 #include "stencil-parallel.h"
+#include "../include/stencil-tune.hpp"
+#include "../../common/roofline.hpp"
 
 typedef struct {
 	int x;
@@ -19,17 +26,44 @@ typedef struct {
 	int ztile;
 } benchParam;
 
+// Roofline columns are appended if a machine calibration was given (--roofline)
+std::optional<roofline_domain> machine;
+
+void printRoofline(const int x, const int y, const int z, const int radius, const int steps,
+                   const double time) {
+	if (machine) {
+		std::cout << std::flush;
+		roofline_print_columns(stdout, roofline_evaluate(roofline_stencil(x, y, z, radius, steps),
+		                                                 time, *machine));
+		std::fflush(stdout);
+	}
+	std::cout << std::endl;
+}
+
 void printCSVHeader() {
 	std::cout << "X,Y,Z,Time[s],Bandwidth[GB/s],XTILE,YTILE,ZTILE"
-		  << std::endl;
+		  << (machine ? "," : "") << (machine ? roofline_columns : "") << std::endl;
 }
 
 void printCSV(const int x, const int y, const int z, const int xtile,
-              const int ytile, const int ztile, const double time,
-              const double bandwidth) {
+              const int ytile, const int ztile, const int radius, const int steps,
+              const double time, const double bandwidth) {
     std::cout << x << "," << y << "," << z << "," << time << ","
-		  << bandwidth << "," << xtile << "," << ytile << "," << ztile
-		  << std::endl;
+		  << bandwidth << "," << xtile << "," << ytile << "," << ztile;
+	printRoofline(x, y, z, radius, steps, time);
+}
+
+void printTuneCSVHeader() {
+	std::cout << "X,Y,Z,Time[s],Bandwidth[GB/s],XTILE,YTILE,ZTILE,THREADS,SCHEDULE"
+		  << (machine ? "," : "") << (machine ? roofline_columns : "") << std::endl;
+}
+
+void printTuneCSV(const int x, const int y, const int z, const int radius, const int steps,
+                  const stencil_tune_params& params, const double bandwidth) {
+	std::cout << x << "," << y << "," << z << "," << params.time << "," << bandwidth << ","
+		  << params.xtile << "," << params.ytile << "," << params.ztile << ","
+		  << params.threads << "," << stencil_schedule_name(params.schedule);
+	printRoofline(x, y, z, radius, steps, params.time);
 }
 
 void initData(const int Nx, const int Ny, const int Nz, const int radius, 
@@ -89,18 +123,74 @@ void generateBenchmark(std::vector<benchParam>* benchmark, const int min,
 	domainTile(benchmark, max, max, max);
 }
 
+// Domain with the arrays used for the stencil computation, allocated once for all tile sizes
+struct benchDomain {
+	int x;
+	int y;
+	int z;
+	int radius;
+	int outerX;
+	int outerY;
+	int outerZ;
+	std::vector<float> Veven;
+	std::vector<float> Vodd;
+	std::vector<float> Vsq;
+	std::vector<float> coeff;
+	bool tasks = false; // use loop_stencil_tasks() instead of loop_stencil_parallel()
+
+	benchDomain(const int x, const int y, const int z, const int radius, const bool tasks = false)
+		: x(x), y(y), z(z), radius(radius),
+		  outerX(x + 2*radius), outerY(y + 2*radius), outerZ(z + 2*radius),
+		  Veven(outerX * outerY * outerZ), Vodd(outerX * outerY * outerZ),
+		  Vsq(outerX * outerY * outerZ), coeff(radius+1, 0.1f), tasks(tasks)
+	{
+		initData(outerX, outerY, outerZ, radius, Veven.data(), Vodd.data(), Vsq.data());
+	}
+
+	// Mean time of loop_stencil_parallel() over the given amount of iterations
+	double run(const int xtile, const int ytile, const int ztile, const int steps,
+	           const int iterations) {
+		using Clock = std::chrono::high_resolution_clock;
+		using Duration = std::chrono::duration<double>;
+		double time = 0;
+		auto loop = tasks ? loop_stencil_tasks : loop_stencil_parallel;
+
+		for (int iter = 0; iter < iterations; ++iter) {
+			auto t = Clock::now();
+			loop(0, steps,
+			     radius, x + radius,
+			     radius, y + radius,
+			     radius, z + radius,
+			     outerX, outerY, outerZ,
+			     coeff.data(), Vsq.data(), Veven.data(), Vodd.data(),
+			     xtile, ytile, ztile,
+			     radius);
+			Duration d = Clock::now() - t;
+			time += d.count();
+		}
+		return time / iterations;
+	}
+
+	double bandwidth(const double time, const int steps) const {
+		return (x * y * z * sizeof(float) * steps * 1e-9) / time;
+	}
+};
+
 int main(int argc, char** argv) {
-	using Clock = std::chrono::high_resolution_clock;
-	using Duration = std::chrono::duration<double>;
-	
     // Cmdline arguments
 	int min = 32;
 	int max = 512;
 	int radius = 4;
 	int steps = 1;
 	int iterations = 1;
-	int threads = omp_get_num_threads();
+	int threads = omp_get_max_threads();
+	int max_evals = 64;
+	bool tune = false;
+	bool tuned = false;
+	bool tasks = false;
 	bool show_help = false;
+	std::string cache_path = "stencil-tune.cache";
+	std::string roofline_path;
 
 	/* Install lyra using vcpkg: vcpkg install lyra */
 
@@ -110,13 +200,25 @@ int main(int argc, char** argv) {
 		   lyra::opt(max, "max")["-e"]["--max"](
 		       "End value for domain generation, default is 512") |
 		   lyra::opt(threads, "threads")["-n"]["--threads"](
-		       "Number of threads, default is omp_get_num_threads()") |
+		       "Number of threads, default is omp_get_max_threads()") |
 		   lyra::opt(radius, "radius")["-r"]["--radius"](
 		       "Stencil radius, default 4") |
 		   lyra::opt(steps, "steps")["-t"]["--steps"](
 		       "Number of time steps, default 5") |
 		   lyra::opt(iterations, "iterations")["-i"]["--iterations"](
-		       "Number of iterations, default is 10");
+		       "Number of iterations, default is 10") |
+		   lyra::opt(tune)["--tune"](
+		       "Autotune tile sizes, thread count and schedule for each domain, and store results in the cache") |
+		   lyra::opt(tuned)["--tuned"](
+		       "Run each domain once with the parameters found in the cache") |
+		   lyra::opt(cache_path, "file")["--cache"](
+		       "Tuning cache, default is stencil-tune.cache") |
+		   lyra::opt(max_evals, "evals")["--evals"](
+		       "Maximum amount of configurations measured per domain when tuning, default is 64") |
+		   lyra::opt(tasks)["--tasks"](
+		       "Run time steps as OpenMP tasks with neighbor dependencies (no barrier between steps)") |
+		   lyra::opt(roofline_path, "file")["--roofline"](
+		       "Append the achieved fraction of the roofline, using the calibration in file");
 
 	auto result = cli.parse({argc, argv});
 	if (!result) {
@@ -129,46 +231,67 @@ int main(int argc, char** argv) {
 		exit(0);
 	}
 
+	if (!roofline_path.empty()) {
+		machine = roofline_read_csv(roofline_path);
+		if (!machine) {
+			std::cerr << "No calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+			exit(1);
+		}
+	}
+
 	omp_set_num_threads(threads);
+	stencil_default_schedule();
 	std::vector<benchParam> benchmark;
 	generateBenchmark(&benchmark, min, max);
+
+	if (tune || tuned) {
+		// Only the domain sizes of the generated benchmark are used; tile sizes are searched
+		// (--tune) or read from the cache (--tuned).
+		std::set<std::tuple<int, int, int>> visited;
+		StencilTuneCache cache(cache_path);
+		const std::string cpu = stencil_cpu_model();
+		printTuneCSVHeader();
+
+		for (auto& state : benchmark) {
+			if (!visited.insert({state.x, state.y, state.z}).second) {
+				continue;
+			}
+			stencil_tune_key key{state.x, state.y, state.z, radius, threads, cpu, tasks};
+			benchDomain domain(state.x, state.y, state.z, radius, tasks);
+			stencil_tune_params params;
+
+			if (tune) {
+				params = stencil_autotune(key, [&](const stencil_tune_params& p) {
+					return domain.run(p.xtile, p.ytile, p.ztile, steps, iterations);
+				}, max_evals);
+				cache.store(key, params);
+			} else {
+				auto cached = cache.lookup(key);
+				if (!cached) {
+					std::cerr << "No cache entry for " << state.x << "x" << state.y << "x"
+						  << state.z << ", skipping" << std::endl;
+					continue;
+				}
+				params = *cached;
+				params.apply();
+				params.time = domain.run(params.xtile, params.ytile, params.ztile, steps, iterations);
+			}
+			printTuneCSV(state.x, state.y, state.z, radius, steps, params, domain.bandwidth(params.time, steps));
+		}
+		if (tune && !cache.save()) {
+			std::cerr << "Could not write tuning cache " << cache_path << std::endl;
+			exit(1);
+		}
+		return 0;
+	}
 	printCSVHeader();
 	
     for (auto& state : benchmark) {
-		int outerX = state.x + 2*radius;
-		int outerY = state.y + 2*radius;
-		int outerZ = state.z + 2*radius;
-		auto size = outerX * outerY * outerZ;
-		
-        std::vector<float> Veven(size);
-		std::vector<float> Vodd(size);
-		std::vector<float> Vsq(size);
-		std::vector<float> coeff(radius+1);
-		double time = 0;
-		
-        //init coefficients	
-		for(auto &c : coeff)
-			c = 0.1f;
-
-		initData(outerX, outerY, outerZ, radius, Veven.data(), Vodd.data(), Vsq.data());
-		for (int iter = 0; iter < iterations; ++iter) {
-			auto t = Clock::now();
-            loop_stencil_parallel(0, steps, 
-								  radius, state.x + radius, 
-								  radius, state.y + radius, 
-								  radius, state.z + radius, 
-								  outerX, outerY, outerZ, 
-                                  coeff.data(), Vsq.data(), Veven.data(), Vodd.data(), 
-                                  state.xtile, state.ytile, state.ztile, 
-                                  radius);
-
-            Duration d = Clock::now() - t;
-			time += d.count();
-		}
-		time /= iterations;
-        double bw = (state.x * state.y * state.z * sizeof(float) * steps * 1e-9) / time;
+		benchDomain domain(state.x, state.y, state.z, radius, tasks);
+		double time = domain.run(state.xtile, state.ytile, state.ztile, steps, iterations);
+		double bw = domain.bandwidth(time, steps);
 
-        printCSV(state.x, state.y, state.z, state.xtile, state.ytile, state.ztile, time, bw);
+        printCSV(state.x, state.y, state.z, state.xtile, state.ytile, state.ztile, radius, steps, time, bw);
 	}
 	return 0;
 }
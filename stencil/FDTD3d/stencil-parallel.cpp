@@ -34,6 +34,7 @@ met:
 #include "stencil-parallel.h"
 #include <algorithm> // for min()
 #include <iostream>
+#include <vector>
 
 void stencil_parallel_step(int x0,
                            int x1,
@@ -97,7 +98,8 @@ void loop_stencil_parallel(int t0,
     int cx = 0, cy = 0, cz = 0;
     
     for (int t = t0; t < t1; ++t) {
-#pragma omp parallel for collapse(2) schedule(guided)
+        // The loop schedule is selected by the caller, with omp_set_schedule() or OMP_SCHEDULE.
+#pragma omp parallel for collapse(2) schedule(runtime)
         for (int z = z0; z < z1; z += ztilesize) {
             for (int y = y0; y < y1; y += ytilesize) {
                 for (int x = x0; x < x1; x += xtilesize) {
@@ -113,3 +115,74 @@ void loop_stencil_parallel(int t0,
         }
     }
 }
+
+void loop_stencil_tasks(int t0,
+                        int t1,
+                        int x0,
+                        int x1,
+                        int y0,
+                        int y1,
+                        int z0,
+                        int z1,
+                        int Nx,
+                        int Ny,
+                        int Nz,
+                        const float coeff[],
+                        const float vsq[],
+                        float Veven[],
+                        float Vodd[],
+                        const int xtilesize,
+                        const int ytilesize,
+                        const int ztilesize,
+                        const int radius) {
+    // A tile of at least radius cells in y and z only reads from its direct neighbors (3x3 in
+    // the y-z plane), so these are the only dependencies on the previous time step.
+    const int ytile = std::max(ytilesize, radius);
+    const int ztile = std::max(ztilesize, radius);
+    const int nty = (y1 - y0 + ytile - 1) / ytile;
+    const int ntz = (z1 - z0 + ztile - 1) / ztile;
+
+    // Dependency objects, one per tile and time step parity. Tile (tz,ty) of step t writes
+    // Vout = Vin of step t-1, so it must wait for all neighbors of step t-1 to finish reading
+    // (and writing) it. Its predecessor of step t-2 is ordered through these neighbors, which
+    // allows to reuse the dependency objects every other step.
+    std::vector<char> deps(2 * nty * ntz);
+    char *dep = deps.data();
+
+#pragma omp parallel
+#pragma omp single
+    for (int t = t0; t < t1; ++t) {
+        const float *Vin = (t & 1) == 0 ? Veven : Vodd;
+        float *Vout = (t & 1) == 0 ? Vodd : Veven;
+        [[maybe_unused]] char *prev = dep + ((t + 1) & 1) * nty * ntz;
+        [[maybe_unused]] char *curr = dep + (t & 1) * nty * ntz;
+
+        for (int tz = 0; tz < ntz; ++tz) {
+            for (int ty = 0; ty < nty; ++ty) {
+                // Neighbors on the domain border are clamped (duplicate dependencies are allowed)
+                const int zl = std::max(tz - 1, 0) * nty;
+                const int zc = tz * nty;
+                const int zh = std::min(tz + 1, ntz - 1) * nty;
+                const int yl = std::max(ty - 1, 0);
+                const int yh = std::min(ty + 1, nty - 1);
+
+#pragma omp task firstprivate(tz, ty, Vin, Vout) \
+        depend(in: prev[zl + yl], prev[zl + ty], prev[zl + yh], \
+                   prev[zc + yl], prev[zc + ty], prev[zc + yh], \
+                   prev[zh + yl], prev[zh + ty], prev[zh + yh]) \
+        depend(out: curr[zc + ty])
+                {
+                    const int z = z0 + tz * ztile;
+                    const int y = y0 + ty * ytile;
+
+                    for (int x = x0; x < x1; x += xtilesize) {
+                        stencil_parallel_step(x, std::min(x1, x + xtilesize), y,
+                                              std::min(y1, y + ytile), z,
+                                              std::min(z1, z + ztile), Nx, Ny, Nz,
+                                              coeff, vsq, Vin, Vout, radius);
+                    }
+                }
+            }
+        }
+    } // implicit barrier, all tasks are complete
+}
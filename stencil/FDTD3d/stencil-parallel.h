@@ -34,3 +34,27 @@ void loop_stencil_parallel(int t0,
                            const int ytilesize,
                            const int ztilesize,
                            const int radius);
+
+// Same as loop_stencil_parallel(), but keeps a single thread team for all time steps. Each
+// (y,z)-tile of a time step is an OpenMP task which depends only on the neighboring tiles of
+// the previous time step, so there is no barrier between time steps. Tiles are enlarged to
+// the stencil radius in y and z if needed.
+void loop_stencil_tasks(int t0,
+                        int t1,
+                        int x0,
+                        int x1,
+                        int y0,
+                        int y1,
+                        int z0,
+                        int z1,
+                        int Nx,
+                        int Ny,
+                        int Nz,
+                        const float coeff[],
+                        const float vsq[],
+                        float Veven[],
+                        float Vodd[],
+                        const int xtilesize,
+                        const int ytilesize,
+                        const int ztilesize,
+                        const int radius);
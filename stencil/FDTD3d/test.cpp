@@ -0,0 +1,58 @@
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+#include <random>
+#include <vector>
+#include <omp.h>
+
+#include "stencil-parallel.h"
+
+namespace
+{
+struct Domain {
+    static constexpr int radius = 4;
+    int Nx, Ny, Nz;
+    std::vector<float> Veven, Vodd, vsq, coeff;
+
+    Domain(int nx, int ny, int nz)
+        : Nx(nx + 2*radius), Ny(ny + 2*radius), Nz(nz + 2*radius),
+          Veven(Nx * Ny * Nz), Vodd(Nx * Ny * Nz), vsq(Nx * Ny * Nz), coeff(radius + 1) {
+        std::mt19937_64 rgen(42);
+        for (auto& v : Veven) {
+            v = (rgen() % 100) / 100.0f;
+        }
+        Vodd = Veven;
+        for (auto& v : vsq) {
+            v = (rgen() % 100) / 1000.0f;
+        }
+        for (int i = 0; i <= radius; ++i) {
+            coeff[i] = 0.1f / (i + 1);
+        }
+    }
+};
+} // namespace
+
+TEST_CASE("loop_stencil_tasks matches loop_stencil_parallel") {
+    const int r = Domain::radius;
+    const int steps = GENERATE(1, 2, 5);
+    const int threads = GENERATE(1, 4);
+    // Tiles smaller than the radius are enlarged by loop_stencil_tasks(); the domain is not a
+    // multiple of the tiles, so border tiles are partial
+    const int tile = GENERATE(2, 8, 16);
+    CAPTURE(steps, threads, tile);
+    omp_set_num_threads(threads);
+
+    const int nx = 24, ny = 37, nz = 29;
+    Domain A(nx, ny, nz);
+    Domain B(nx, ny, nz);
+
+    loop_stencil_parallel(0, steps, r, r + nx, r, r + ny, r, r + nz, A.Nx, A.Ny, A.Nz,
+                          A.coeff.data(), A.vsq.data(), A.Veven.data(), A.Vodd.data(),
+                          nx, tile, tile, r);
+    loop_stencil_tasks(0, steps, r, r + nx, r, r + ny, r, r + nz, B.Nx, B.Ny, B.Nz,
+                       B.coeff.data(), B.vsq.data(), B.Veven.data(), B.Vodd.data(),
+                       nx, tile, tile, r);
+
+    // Every point is computed by the same expression, so results are identical
+    CHECK(A.Veven == B.Veven);
+    CHECK(A.Vodd == B.Vodd);
+}
@@ -11,41 +11,25 @@ max=512
 radius=2 # default values from sample benchmark script
 steps=5
 iterations=10 # TODO
+warmup=3 # untimed iterations per domain
 
 # Enabled benchmarks
 run_upcxx_media=1
 run_upcxx_knl=1
 run_upcxx_media_cluster=1
 run_upcxx_knl_cluster=1
+run_roofline=1 # node calibration (csv/roofline-*.csv, see common/roofline.cpp)
 
 cmake() {
     command cmake -G Ninja -DCMAKE_TOOLCHAIN_FILE="$HOME/source/vcpkg/scripts/buildsystems/vcpkg.cmake" "$@"
 }
 
 # XXX: set process amount depending on z-dimension and radius (-n $..) to ensure correct results
+# All domains are run in a single job: the x-, y- and z-dimension are doubled in turn from min to max.
 bench() {
-    local x=$min 
-    local y=$min 
-    local z=$min
-    printf 'X,Y,Z,Timesteps,Radius,Time[s],Throughput[GB/s]\n'
-    
-    # Alternate the doubling of the x-, y- and z-dimension.
-    while (( x < max )); do
-        printf >&2 'Benchmarking x=%d, y=%d, z=%d, radius=%d, steps=%d\n' "$x" "$y" "$z" "$radius" "$steps"
-        "$@" -x "$x" -y "$y" -z "$z" --radius "$radius" --steps "$steps" --iterations "$iterations" --bench
-        x=$((x * 2))
-        
-        printf >&2 '\nBenchmarking x=%d, y=%d, z=%d, radius=%d, steps=%d\n' "$x" "$y" "$z" "$radius" "$steps"
-        "$@" -x "$x" -y "$y" -z "$z" --radius "$radius" --steps "$steps" --iterations "$iterations" --bench
-        y=$((y * 2))
-        
-        printf >&2 '\nBenchmarking x=%d, y=%d, z=%d, radius=%d, steps=%d\n' "$x" "$y" "$z" "$radius" "$steps"
-        "$@" -x "$x" -y "$y" -z "$z" --radius "$radius" --steps "$steps" --iterations "$iterations" --bench
-        z=$((z * 2))
-    done
-
-    printf >&2 '\nBenchmarking x=%d, y=%d, z=%d, radius=%d, steps=%d\n' "$x" "$y" "$z" "$radius" "$steps"
-    "$@" -x "$x" -y "$y" -z "$z" --radius "$radius" --steps "$steps" --iterations "$iterations" --bench
+    printf 'X,Y,Z,Timesteps,Radius,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+    printf >&2 'Benchmarking %d^3 to %d^3, radius=%d, steps=%d\n' "$min" "$max" "$radius" "$steps"
+    "$@" --sweep "$min:$max:2" --radius "$radius" --steps "$steps" --iterations "$iterations" --warmup "$warmup" --bench
 }
 
 rm -rf build-shared
@@ -60,6 +44,14 @@ cd build-shared
 UPCXX_NETWORK=smp cmake -DCMAKE_BUILD_TYPE=Release ../.. # -march=knl, -march=skylake, smp conduit
 ninja -v stencil-upcxx-skl stencil-upcxx-knl
 
+if (( run_roofline )); then
+    ninja -v roofline-skl roofline-knl
+    srun -w 'mp-media1' env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \
+        common/roofline-skl > ../roofline-skl.csv
+    srun -w 'mp-knl1' env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 \
+        common/roofline-knl > ../roofline-knl.csv
+fi
+
 if (( run_upcxx_media )); then
     bench srun -w 'mp-media1' \
         upcxx-run -n 4 -shared-heap 80% stencil/stencil-upcxx-skl > ../stencil-shared-skl-upcxx.csv
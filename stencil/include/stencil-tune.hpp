@@ -0,0 +1,257 @@
+#ifndef STENCIL_TUNE_HPP
+#define STENCIL_TUNE_HPP
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <omp.h>
+
+// Autotuning of the tile sizes, thread count and loop schedule used by loop_stencil_parallel().
+// Results are stored in a plain text cache, keyed by the (local) domain size, the stencil radius,
+// the amount of threads available to the process, the CPU model and whether the time steps run
+// as tasks (loop_stencil_tasks()) or as parallel loops.
+
+struct stencil_tune_key {
+    std::ptrdiff_t dim_x;
+    std::ptrdiff_t dim_y;
+    std::ptrdiff_t dim_z;
+    int radius;
+    int threads; // upper bound on the amount of threads, i.e. omp_get_max_threads()
+    std::string cpu;
+    bool tasks = false;
+
+    bool operator<(const stencil_tune_key &other) const {
+        return std::tie(dim_x, dim_y, dim_z, radius, threads, cpu, tasks) <
+            std::tie(other.dim_x, other.dim_y, other.dim_z, other.radius, other.threads, other.cpu, other.tasks);
+    }
+};
+
+struct stencil_tune_params {
+    int xtile;
+    int ytile;
+    int ztile;
+    int threads;
+    omp_sched_t schedule = omp_sched_guided;
+    int chunk = 0; // 0 selects the default chunk size of the schedule
+    double time = std::numeric_limits<double>::infinity(); // best time measured while tuning
+
+    // Apply the thread count and loop schedule. Tile sizes are passed to loop_stencil_parallel().
+    void apply() const {
+        omp_set_num_threads(threads);
+        omp_set_schedule(schedule, chunk);
+    }
+};
+
+// Schedule of the stencil loops (schedule(runtime)) without tuned parameters: guided, unless
+// OMP_SCHEDULE selects one. The runtime default (dynamic with chunk size 1) is much slower.
+inline void
+stencil_default_schedule()
+{
+    if (std::getenv("OMP_SCHEDULE") == nullptr) {
+        omp_set_schedule(omp_sched_guided, 0);
+    }
+}
+
+inline const char*
+stencil_schedule_name(omp_sched_t schedule)
+{
+    switch (schedule) {
+        case omp_sched_static:  return "static";
+        case omp_sched_dynamic: return "dynamic";
+        case omp_sched_guided:  return "guided";
+        default:                return "auto";
+    }
+}
+
+inline omp_sched_t
+stencil_schedule_from_name(const std::string &name)
+{
+    if (name == "static")  return omp_sched_static;
+    if (name == "dynamic") return omp_sched_dynamic;
+    if (name == "guided")  return omp_sched_guided;
+    return omp_sched_auto;
+}
+
+// CPU model as reported by the kernel (first "model name" entry in /proc/cpuinfo)
+inline std::string
+stencil_cpu_model()
+{
+    std::ifstream ifs("/proc/cpuinfo");
+    std::string line;
+
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            auto pos = line.find(':');
+            if (pos != std::string::npos) {
+                pos = line.find_first_not_of(" \t", pos + 1);
+                return pos != std::string::npos ? line.substr(pos) : std::string();
+            }
+        }
+    }
+    return "unknown";
+}
+
+// Cache file format, one entry per line:
+//   dim_x dim_y dim_z radius threads mode xtile ytile ztile nthreads schedule chunk time cpu model...
+// where mode is "tasks" or "loop".
+// The CPU model comes last as it may contain spaces. Lines starting with '#' are ignored.
+class StencilTuneCache
+{
+public:
+    explicit StencilTuneCache(std::string file_path)
+        : _file_path(std::move(file_path))
+    {
+        std::ifstream ifs(_file_path);
+        std::string line;
+
+        while (std::getline(ifs, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream iss(line);
+            stencil_tune_key key;
+            stencil_tune_params params;
+            std::string mode;
+            std::string schedule;
+
+            if (iss >> key.dim_x >> key.dim_y >> key.dim_z >> key.radius >> key.threads >> mode
+                    >> params.xtile >> params.ytile >> params.ztile >> params.threads
+                    >> schedule >> params.chunk >> params.time)
+            {
+                std::getline(iss >> std::ws, key.cpu);
+                key.tasks = mode == "tasks";
+                params.schedule = stencil_schedule_from_name(schedule);
+                _entries[key] = params;
+            }
+        }
+    }
+
+    std::optional<stencil_tune_params> lookup(const stencil_tune_key &key) const {
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void store(const stencil_tune_key &key, const stencil_tune_params &params) {
+        _entries[key] = params;
+    }
+
+    // Rewrite the cache file with all entries (including those read on construction)
+    bool save() const {
+        std::ofstream ofs(_file_path, std::ofstream::trunc);
+        if (!ofs) {
+            return false;
+        }
+        ofs << "# dim_x dim_y dim_z radius threads mode xtile ytile ztile nthreads schedule chunk time cpu\n";
+        for (const auto& [key, params] : _entries) {
+            ofs << key.dim_x << " " << key.dim_y << " " << key.dim_z << " " << key.radius << " "
+                << key.threads << " " << (key.tasks ? "tasks" : "loop") << " " << params.xtile << " " << params.ytile << " " << params.ztile << " "
+                << params.threads << " " << stencil_schedule_name(params.schedule) << " "
+                << params.chunk << " " << params.time << " " << key.cpu << "\n";
+        }
+        return static_cast<bool>(ofs);
+    }
+
+private:
+    std::string _file_path;
+    std::map<stencil_tune_key, stencil_tune_params> _entries;
+};
+
+// Search tile sizes, thread count and schedule for the domain described by key. Instead of sweeping
+// all power-of-two tile sizes (as done by stencil-benchmark), we do a coordinate descent: starting
+// from the initial guess, tile sizes are halved or doubled along one axis as long as this improves
+// the time reported by measure(params). The thread count and schedule are then tuned for the best
+// tile found. Each configuration is measured at most once; max_evals limits the total amount.
+template <typename Measure>
+stencil_tune_params
+stencil_autotune(const stencil_tune_key &key, Measure &&measure, int max_evals = 64)
+{
+    using config = std::tuple<int, int, int, int, int>; // xtile, ytile, ztile, threads, schedule
+    std::map<config, double> evaluated;
+
+    auto evaluate = [&](stencil_tune_params &params) -> bool {
+        config c{params.xtile, params.ytile, params.ztile, params.threads, static_cast<int>(params.schedule)};
+        auto it = evaluated.find(c);
+        if (it != evaluated.end()) {
+            params.time = it->second;
+            return true;
+        }
+        if (static_cast<int>(evaluated.size()) >= max_evals) {
+            return false;
+        }
+        params.apply();
+        params.time = measure(params);
+        evaluated.emplace(c, params.time);
+        return true;
+    };
+
+    // Initial guess: full rows in x (unit stride, vectorized), small square tiles in y/z.
+    stencil_tune_params best;
+    best.xtile = static_cast<int>(key.dim_x);
+    best.ytile = static_cast<int>(std::min<std::ptrdiff_t>(key.dim_y, 16));
+    best.ztile = static_cast<int>(std::min<std::ptrdiff_t>(key.dim_z, 16));
+    best.threads = key.threads;
+    best.schedule = omp_sched_guided;
+    evaluate(best);
+
+    // Tile sizes: coordinate descent over powers of two (clamped to the domain)
+    const std::ptrdiff_t dims[3] = { key.dim_x, key.dim_y, key.dim_z };
+    bool improved = true;
+
+    while (improved) {
+        improved = false;
+        stencil_tune_params candidate_best = best;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int scale : { 2, -2 }) {
+                stencil_tune_params candidate = best;
+                int *tile = axis == 0 ? &candidate.xtile : axis == 1 ? &candidate.ytile : &candidate.ztile;
+                int next = scale > 0 ? *tile * 2 : *tile / 2;
+
+                if (next < 1 || next > dims[axis] || next == *tile) {
+                    continue;
+                }
+                *tile = next;
+                if (evaluate(candidate) && candidate.time < candidate_best.time) {
+                    candidate_best = candidate;
+                    improved = true;
+                }
+            }
+        }
+        best = candidate_best;
+    }
+
+    // Thread count: halve as long as this improves the time (e.g. for bandwidth saturation, SMT)
+    for (int threads = best.threads / 2; threads >= 1; threads /= 2) {
+        stencil_tune_params candidate = best;
+        candidate.threads = threads;
+
+        if (!evaluate(candidate) || candidate.time >= best.time) {
+            break;
+        }
+        best = candidate;
+    }
+
+    // Loop schedule
+    for (omp_sched_t schedule : { omp_sched_static, omp_sched_dynamic, omp_sched_guided }) {
+        stencil_tune_params candidate = best;
+        candidate.schedule = schedule;
+
+        if (evaluate(candidate) && candidate.time < best.time) {
+            best = candidate;
+        }
+    }
+    best.apply();
+    return best;
+}
+
+#endif // STENCIL_TUNE_HPP
@@ -2,6 +2,7 @@
 #define UPCXX_STENCIL_HPP
 #include <cassert>
 #include "upcxx.hpp"
+#include "../../common/trace.hpp"
 
 inline void
 stencil_get_ghost_cells(dist_ptr<float> &input_g, index_t n_local, index_t n_ghost_offset)
@@ -17,20 +18,28 @@ stencil_get_ghost_cells(dist_ptr<float> &input_g, index_t n_local, index_t n_gho
     // As rget does not allow source values to be modified until operation completion is notified,
     // first retrieve all right neighbors, then all left neighbors.
     if (proc_id != proc_n - 1) {
+        TraceScope ts("rget (right)");
         upcxx::global_ptr<float> input_r = input_g.fetch(proc_id + 1).wait();
         upcxx::rget(input_r + n_ghost_offset,
                     input + n_local - n_ghost_offset,
                     n_ghost_offset).wait();
     }
-    upcxx::barrier();
+    {
+        TraceScope ts("barrier");
+        upcxx::barrier();
+    }
 
     if (proc_id != 0) {
+        TraceScope ts("rget (left)");
         upcxx::global_ptr<float> input_l = input_g.fetch(proc_id - 1).wait();
         upcxx::rget(input_l + n_local - 2*n_ghost_offset,
                     input,
                     n_ghost_offset).wait();
     }
-    upcxx::barrier();
+    {
+        TraceScope ts("barrier");
+        upcxx::barrier();
+    }
 }
 
 #endif // UPCXX_STENCIL_HPP
@@ -126,7 +126,8 @@ loop_stencil_parallel(int t0,
     int cx = 0, cy = 0, cz = 0;
     
     for (int t = t0; t < t1; ++t) {
-#pragma omp parallel for collapse(2) schedule(guided)
+        // The loop schedule is selected by the caller, with omp_set_schedule() or OMP_SCHEDULE.
+#pragma omp parallel for collapse(2) schedule(runtime)
         for (int z = z0; z < z1; z += ztilesize) {
             for (int y = y0; y < y1; y += ytilesize) {
                 for (int x = x0; x < x1; x += xtilesize) {
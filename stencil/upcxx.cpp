@@ -4,8 +4,10 @@
 #include <cstdlib>
 #include <string>
 #include <chrono>
+#include <array>
 #include <vector>
 #include <algorithm>
+#include <optional>
 
 #include <lyra/lyra.hpp>
 
@@ -13,6 +15,12 @@
 #include "include/stencil.hpp"
 #include "include/stencil-upcxx.hpp"
 #include "include/stencil-print.hpp"
+#include "include/stencil-tune.hpp"
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
 
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
@@ -29,25 +37,31 @@ int main(int argc, char** argv)
 {
     int seed = 42;  // seed for pseudo-random generator
     int iterations = 1;
+    int warmup = 0;     // untimed iterations before timing
+    std::string sweep;  // min:max:factor
+    bool weak = false;  // domain size per process (weak scaling)
     bool bench = false;
     bool write = false;
     bool show_help = false;
     const char* file_path = "upcxx_stencil.txt";
     const char* file_path_steps = "upcxx_stencil_steps.txt";
     const char* file_path_steps_cell = "upcxx_stencil_steps_cell.txt";
+    std::string tune_cache; // tuning cache written by stencil-benchmark --tune
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
 
-    index_t dim_x = 32;
-    index_t dim_y = 32;
-    index_t dim_z = 32;
+    std::array<index_t, 3> dim = { 32, 32, 32 };
     int radius = 4;
     int steps = 5;
 
     auto cli = lyra::help(show_help) |
-        lyra::opt(dim_x, "dim_x")["-x"]["--dim_x"](
+        lyra::opt(dim[0], "dim_x")["-x"]["--dim_x"](
             "Size of domain (x-dimension), default is 32") |
-        lyra::opt(dim_y, "dim_y")["-y"]["--dim_y"](
+        lyra::opt(dim[1], "dim_y")["-y"]["--dim_y"](
             "Size of domain (y-dimension), default is 32") |
-        lyra::opt(dim_z, "dim_z")["-z"]["--dim_z"](
+        lyra::opt(dim[2], "dim_z")["-z"]["--dim_z"](
             "Size of domain (z-dimension), default is 32") |
         lyra::opt(radius, "radius")["-r"]["--radius"](
             "Stencil radius, default is 4") |
@@ -55,15 +69,31 @@ int main(int argc, char** argv)
             "Number of time steps, default is 5") |
         lyra::opt(iterations, "iterations")["--iterations"](
             "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark domains from min^3 to max^3 in a single run, multiplying x, y and z by factor (default 2) in turn") |
+        lyra::opt(weak)["--weak"](
+            "Domain size is per process: the z-dimension is multiplied by the amount of processes") |
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(seed, "seed")["--seed"](
             "Seed for pseudo-random number generation, default is 42") |
         lyra::opt(write)["--write"](
-            "Write out array contents to file");
+            "Write out array contents to file") |
+        lyra::opt(tune_cache, "file")["--tune-cache"](
+            "Use tile sizes, thread count and schedule from the given tuning cache") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
     auto result = cli.parse({argc, argv});
     
-    if (!is_positive(dim_x, dim_y, dim_z, radius, steps)) {
+    if (!is_positive(dim[0], dim[1], dim[2], radius, steps)) {
         std::cerr << "Arguments must be positive" << std::endl;
         exit(1);
     }
@@ -77,103 +107,239 @@ int main(int argc, char** argv)
 		exit(0);
 	}
 
+    // Domains, a single one unless --sweep is given
+    std::vector<std::array<index_t, 3>> domains{dim};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_domains(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        if (write) {
+            std::cerr << "--write cannot be combined with --sweep" << std::endl;
+            std::exit(1);
+        }
+        domains = *swept;
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
     // BEGIN PARALLEL REGION
     upcxx::init();
     const upcxx::intrank_t proc_n = upcxx::rank_n();
     const upcxx::intrank_t proc_id = upcxx::rank_me();
-
-    // We partition the stencil arrays in the z-axis. Splits in the x- and y-axis are avoided 
-    // to reduce communication costs between nodes (i.e. x/y tiling should be done locally, 
-    // through broadcasting or a threading model).
-    const index_t dim_zi = dim_z / proc_n;
-    assert(dim_z == dim_zi * proc_n);
-    const index_t n_block = dim_x * dim_y * dim_zi;
-
-    // Checks that the size of the ghost cells does not exceed the size of the process block
-    // (e.g. {4,4,4} with 4 processes (or {4,4,1} per process) and radius 2)
-    assert(dim_zi >= radius);
-
-    // Add zero padding for ghost cells (communication) and neighbor access on the domain border.
-    const index_t Nx = dim_x + 2*radius;
-    const index_t Ny = dim_y + 2*radius;
-    const index_t Nz = dim_zi + 2*radius;
-    const index_t n_ghost_offset = Nx * Ny * radius;
-    const index_t n_local = Nx * Ny * Nz;
-
-    // Veven -> input array on even steps, output array on uneven steps.
-    // Vodd  -> output array on even steps, input array on uneven steps.
-    // Alternation between input and output array allows to implement the stencil as a gather.
-    dist_ptr<float> Veven_g = upcxx::new_array<float>(n_local);
-    dist_ptr<float> Vodd_g = upcxx::new_array<float>(n_local);    
-    float* Veven = downcast_dptr<float>(Veven_g);
-    float* Vodd = downcast_dptr<float>(Vodd_g);
-
-    // Vsq, coeff -> coefficients
-    upcxx::global_ptr<float> coeff_g = upcxx::new_array<float>(radius+1);
-    upcxx::global_ptr<float> Vsq_g = upcxx::new_array<float>(n_local);
-    float* coeff = downcast_gptr<float>(coeff_g);
-    float* Vsq = downcast_gptr<float>(Vsq_g);
-
-    // Initialize arrays and wait for completion. Veven and Vsq are initialized with pseudo-random
-    // numbers; Vodd is left to zero. Coefficients are kept to a fixed value.
-    std::mt19937_64 rgen(seed);
-    rgen.discard(2 * upcxx::rank_me() * n_block);
-    stencil_init_data(Nx, Ny, Nz, radius, rgen, Veven, Vodd, Vsq);
-
-    // Initialize coefficients with fixed values
-    for (int i = 0; i < radius+1; ++i) {
-        coeff[i] = 0.1f;
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
     }
-
-    if (write) {
-        dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path);
+    if (!trace_path.empty()) {
+        trace_start();
     }
 
-    // Timings for different iterations, of which the mean is taken.
-    std::vector<double> vt;
-    vt.reserve(iterations);
-    // FDTD
-    for (int iter = 1; iter <= iterations; ++iter) {
-        // Set up a barrier before doing any timing
-        upcxx::barrier();
-        time_point<Clock> t = Clock::now();
-
-        // Perform time steps
-        for (int t = 0; t < steps; ++t) {
-            bool is_even_ts = (t & 1) == 0;
-
-            if (proc_n > 1) {
-                // std::fprintf(stderr, "Retrieving ghost cells for %s, rank (%d/%d), step %d\n", "Veven", proc_id, proc_n, t);
-                stencil_get_ghost_cells(is_even_ts ? Veven_g : Vodd_g,
-                                        n_local, n_ghost_offset);
-            } // barrier
-            stencil_parallel_step(radius, radius + dim_x,
-                                radius, radius + dim_y,
-                                radius, radius + dim_zi,
-                                Nx, Ny, Nz, coeff, Vsq,
-                                is_even_ts ? Veven : Vodd,
-                                is_even_ts ? Vodd : Veven, 
-                                radius);
-            upcxx::barrier(); // wait until all processes have finished calculations
+    // Thread count and schedule without tuned parameters. Tuned parameters of a domain replace
+    // them, so they are restored for every domain, and the thread count is also the budget
+    // by which tuning cache entries are looked up.
+    stencil_default_schedule();
+    const int threads = omp_get_max_threads();
+    omp_sched_t schedule;
+    int chunk;
+    omp_get_schedule(&schedule, &chunk);
+
+    for (const auto& domain : domains) {
+        const index_t dim_x = domain[0];
+        const index_t dim_y = domain[1];
+        const index_t dim_z = weak ? domain[2] * proc_n : domain[2];
+
+        // We partition the stencil arrays in the z-axis. Splits in the x- and y-axis are avoided 
+        // to reduce communication costs between nodes (i.e. x/y tiling should be done locally, 
+        // through broadcasting or a threading model).
+        const index_t dim_zi = dim_z / proc_n;
+        assert(dim_z == dim_zi * proc_n);
+        const index_t n_block = dim_x * dim_y * dim_zi;
+
+        // Checks that the size of the ghost cells does not exceed the size of the process block
+        // (e.g. {4,4,4} with 4 processes (or {4,4,1} per process) and radius 2)
+        assert(dim_zi >= radius);
+
+        // Add zero padding for ghost cells (communication) and neighbor access on the domain border.
+        const index_t Nx = dim_x + 2*radius;
+        const index_t Ny = dim_y + 2*radius;
+        const index_t Nz = dim_zi + 2*radius;
+        const index_t n_ghost_offset = Nx * Ny * radius;
+        const index_t n_local = Nx * Ny * Nz;
+
+        // Veven -> input array on even steps, output array on uneven steps.
+        // Vodd  -> output array on even steps, input array on uneven steps.
+        // Alternation between input and output array allows to implement the stencil as a gather.
+        timer.start(phase::init);
+        dist_ptr<float> Veven_g = upcxx::new_array<float>(n_local);
+        dist_ptr<float> Vodd_g = upcxx::new_array<float>(n_local);    
+        float* Veven = downcast_dptr<float>(Veven_g);
+        float* Vodd = downcast_dptr<float>(Vodd_g);
+
+        // Vsq, coeff -> coefficients
+        upcxx::global_ptr<float> coeff_g = upcxx::new_array<float>(radius+1);
+        upcxx::global_ptr<float> Vsq_g = upcxx::new_array<float>(n_local);
+        float* coeff = downcast_gptr<float>(coeff_g);
+        float* Vsq = downcast_gptr<float>(Vsq_g);
+
+        // Initialize arrays and wait for completion. Veven and Vsq are initialized with pseudo-random
+        // numbers; Vodd is left to zero. Coefficients are kept to a fixed value.
+        std::mt19937_64 rgen(seed);
+        rgen.discard(2 * upcxx::rank_me() * n_block);
+        stencil_init_data(Nx, Ny, Nz, radius, rgen, Veven, Vodd, Vsq);
+
+        // Initialize coefficients with fixed values
+        for (int i = 0; i < radius+1; ++i) {
+            coeff[i] = 0.1f;
+        }
+        timer.stop(phase::init);
+
+        if (write) {
+            timer.start(phase::io);
+            dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path);
+            timer.stop(phase::io);
+        }
+
+        // Look up tuned parameters for the local block. Without an entry, the block is computed
+        // by a single call to stencil_parallel_step(), with the default schedule.
+        omp_set_num_threads(threads);
+        omp_set_schedule(schedule, chunk);
+        std::optional<stencil_tune_params> tuned;
+        if (!tune_cache.empty()) {
+            StencilTuneCache cache(tune_cache);
+            tuned = cache.lookup({dim_x, dim_y, dim_zi, radius, threads, stencil_cpu_model()});
+
+            if (tuned) {
+                tuned->apply();
+            } else if (proc_id == 0) {
+                std::cerr << "No entry for block " << dim_x << "x" << dim_y << "x" << dim_zi
+                          << " in tuning cache " << tune_cache << std::endl;
+            }
+        }
+
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+        // FDTD
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+
+            // Perform time steps
+            for (int t = 0; t < steps; ++t) {
+                TraceScope ts_step("step");
+                bool is_even_ts = (t & 1) == 0;
+
+                if (proc_n > 1) {
+                    // std::fprintf(stderr, "Retrieving ghost cells for %s, rank (%d/%d), step %d\n", "Veven", proc_id, proc_n, t);
+                    timer.start(phase::exchange);
+                    stencil_get_ghost_cells(is_even_ts ? Veven_g : Vodd_g,
+                                            n_local, n_ghost_offset);
+                    timer.stop(phase::exchange);
+                } // barrier
+                timer.start(phase::compute);
+                counters.start();
+                if (tuned) {
+                    loop_stencil_parallel(t, t + 1,
+                                          radius, radius + dim_x,
+                                          radius, radius + dim_y,
+                                          radius, radius + dim_zi,
+                                          Nx, Ny, Nz, coeff, Vsq, Veven, Vodd,
+                                          tuned->xtile, tuned->ytile, tuned->ztile,
+                                          radius);
+                } else {
+                    stencil_parallel_step(radius, radius + dim_x,
+                                        radius, radius + dim_y,
+                                        radius, radius + dim_zi,
+                                        Nx, Ny, Nz, coeff, Vsq,
+                                        is_even_ts ? Veven : Vodd,
+                                        is_even_ts ? Vodd : Veven, 
+                                        radius);
+                }
+                counters.stop();
+                timer.stop(phase::compute);
+
+                timer.start(phase::collective);
+                {
+                    TraceScope ts("barrier");
+                    upcxx::barrier(); // wait until all processes have finished calculations
+                }
+                timer.stop(phase::collective);
+            }
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() -t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
         }
         if (proc_id == 0) {
-            Duration d = Clock::now() -t;
-            double time = d.count(); // time in seconds
-            vt.push_back(time);
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean;
+
+            if (bench) {
+                double throughput = dim_x * dim_y * dim_z * sizeof(float) * steps * 1e-9 / time; // throughput in Gb/s
+                std::fprintf(stdout, "%ld,%ld,%ld,%d,%d,%.12f,%.12f", dim_x, dim_y, dim_z, steps, radius, time, throughput);
+                bench_print_stats(stdout, stats);
+                if (machine) {
+                    // Roofline of all nodes, assuming the same amount of ranks on every node
+                    int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                    auto kernel = roofline_stencil(dim_x, dim_y, dim_z, radius, steps);
+                    roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+                }
+                std::fprintf(stdout, "\n");
+            }
         }
-    }
-    if (proc_id == 0) {
-        double time = std::accumulate(vt.begin(), vt.end(), 0.);
-        time /= vt.size();
+        if (write) {
+            timer.start(phase::io);
+            dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path_steps_cell, true);
+            dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path_steps, false);
+            timer.stop(phase::io);
+        }
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
 
-        if (bench) {
-            double throughput = dim_x * dim_y * dim_z * sizeof(float) * steps * 1e-9 / time; // throughput in Gb/s
-            std::fprintf(stdout, "%ld,%ld,%ld,%d,%d,%.12f,%.12f\n", dim_x, dim_y, dim_z, steps, radius, time, throughput);
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, "stencil-upcxx",
+                                  {{"dim_x", dim_x}, {"dim_y", dim_y}, {"dim_z", dim_z}, {"radius", radius},
+                                   {"steps", steps}, {"iterations", iterations}}, stats);
+            }
+        }
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, "stencil-upcxx",
+                                {{"dim_x", dim_x}, {"dim_y", dim_y}, {"dim_z", dim_z}, {"radius", radius},
+                                 {"steps", steps}, {"iterations", iterations}},
+                                counters, timer.elapsed(phase::compute));
         }
+
+        // Wait for all ghost cell transfers before releasing the arrays
+        upcxx::barrier();
+        upcxx::delete_array(*Veven_g);
+        upcxx::delete_array(*Vodd_g);
+        upcxx::delete_array(coeff_g);
+        upcxx::delete_array(Vsq_g);
+        timer.reset();
+        counters.reset();
     }
-    if (write) {
-        dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path_steps_cell, true);
-        dump_stencil(Veven, Vodd, Vsq, n_local, n_ghost_offset, file_path_steps, false);
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
     }
     upcxx::finalize();
     // END PARALLEL REGION
@@ -8,6 +8,8 @@ type ninja
 # Enabled benchmarks (shared)
 run_upcxx_skl=1
 run_upcxx_knl=1
+run_upcxx_dense_skl=1
+run_upcxx_batch_skl=1
 run_openmp_skl=1
 run_openmp_knl=1
 
@@ -19,6 +21,7 @@ run_openmp_knl_dist=1
 
 # Number of iterations
 iterations=10
+warmup=3 # untimed iterations per size
 
 cmake() {
     command cmake -G Ninja -DCMAKE_TOOLCHAIN_FILE="$HOME/source/vcpkg/scripts/buildsystems/vcpkg.cmake" "$@"
@@ -35,67 +38,100 @@ mkdir build-shared
 # ---------------------------------------
 cd build-shared
 UPCXX_NETWORK=smp cmake -DCMAKE_BUILD_TYPE=Release ../..
-ninja -v symmetrize-upcxx-knl symmetrize-upcxx-skl \
-         symmetrize-upcxx-openmp-knl symmetrize-upcxx-openmp-skl
+ninja -v symmetrize-upcxx-knl symmetrize-upcxx-skl symmetrize-upcxx-dense-skl \
+         symmetrize-upcxx-openmp-knl symmetrize-upcxx-openmp-skl symmetrize-upcxx-batch-skl
 
 
 # SKL, UPCXX (4 processes)
 ((run_upcxx_skl)) && { 
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
     
-    for i in {5..14}; do
-        srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
-            symmetrize/symmetrize-upcxx-skl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
+        symmetrize/symmetrize-upcxx-skl --sweep "$((1<<5)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-shared-skl-upcxx.csv
 
 
+# SKL, UPCXX, dense row blocks (4 processes)
+((run_upcxx_dense_skl)) && {
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+
+    srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
+        symmetrize/symmetrize-upcxx-dense-skl --sweep "$((1<<5)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
+} > ../symmetrize-shared-skl-upcxx-dense.csv
+
+# SKL, UPCXX, dense row blocks, incremental after updating 1% of the tiles (4 processes)
+((run_upcxx_dense_skl)) && {
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+
+    srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% \
+        symmetrize/symmetrize-upcxx-dense-skl --sweep "$((1<<8)):$((1<<14)):2" --update 0.01 --warmup "$warmup" --iterations "$iterations" --bench
+} > ../symmetrize-shared-skl-upcxx-dense-update.csv
+
+
 # KNL, UPCXX (max. 64 processes)
 ((run_upcxx_knl)) && {
     nproc_min=8
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
 
     for i in {5..7}; do    
         srun -w mp-knl1 upcxx-run -n "$nproc_min" -shared-heap 80% \
-            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --iterations "$iterations" --bench
+            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --warmup "$warmup" --iterations "$iterations" --bench
         nproc_min=$((nproc_min * 2))
     done
 
-    for i in {8..14}; do
-        srun -w mp-knl1 upcxx-run -n 64 -shared-heap 80% \
-            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done 
+    srun -w mp-knl1 upcxx-run -n 64 -shared-heap 80% \
+        symmetrize/symmetrize-upcxx-knl --sweep "$((1<<8)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-shared-knl-upcxx.csv
 
 
 # SKL, UPCXX + OpenMP (1 process, 4 threads)
 ((run_openmp_skl)) && {
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
     
-    for i in {5..14}; do
-        srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \                
-            symmetrize/symmetrize-upcxx-openmp-skl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done 
+    srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \
+        symmetrize/symmetrize-upcxx-openmp-skl --sweep "$((1<<5)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-shared-skl-upcxx-openmp.csv
 
+# SKL, UPCXX + OpenMP, interleaved triangles (1 process, 4 threads)
+((run_openmp_skl)) && {
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+
+    srun -w mp-media1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \
+        symmetrize/symmetrize-upcxx-openmp-skl --sweep "$((1<<5)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench --interleaved
+} > ../symmetrize-shared-skl-upcxx-openmp-interleaved.csv
+
+# SKL, UPCXX + OpenMP, batch of 2^28 elements (1 GiB) of small matrices (4 processes, 4 threads each)
+((run_upcxx_batch_skl)) && {
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+
+    srun -w mp-media1 upcxx-run -n 4 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 \
+        symmetrize/symmetrize-upcxx-batch-skl --sweep "2:64:2" --elements "$((1<<28))" --warmup "$warmup" --iterations "$iterations" --bench
+} > ../symmetrize-shared-skl-upcxx-batch.csv
+
 
 # KNL, UPCXX + OpenMP (1 process, max. 64 threads)
 ((run_openmp_knl)) && {
     nproc_min=8
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
 
     for i in {5..7}; do
         srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS="$nproc_min" \
-            symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --iterations "$iterations" --bench
+            symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --warmup "$warmup" --iterations "$iterations" --bench
         nproc_min=$((nproc_min * 2))
     done
 
-    for i in {8..14}; do
-        srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 \
-            symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 \
+        symmetrize/symmetrize-upcxx-openmp-knl --sweep "$((1<<8)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-shared-knl-upcxx-openmp.csv
 
+# KNL, UPCXX + OpenMP, interleaved triangles (1 process, 64 threads)
+((run_openmp_knl)) && {
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
+
+    srun -w mp-knl1 upcxx-run -n 1 -shared-heap 80% env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 \
+        symmetrize/symmetrize-upcxx-openmp-knl --sweep "$((1<<8)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench --interleaved
+} > ../symmetrize-shared-knl-upcxx-openmp-interleaved.csv
+
 
 # ---------------------------------------
 # DISTRIBUTED
@@ -109,63 +145,55 @@ ninja -v symmetrize-upcxx-knl symmetrize-upcxx-skl \
 
 # SKL, UPCXX (max. 16 processes)
 ((run_upcxx_skl_dist)) && {
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
     
     GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 8 -shared-heap 80% \
         symmetrize/symmetrize-upcxx-skl --dim "$((1<<5))" --iterations "$iterations" --bench
 
-    for i in {6..14}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
-            symmetrize/symmetrize-upcxx-skl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 16 -shared-heap 80% \
+        symmetrize/symmetrize-upcxx-skl --sweep "$((1<<6)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-dist-skl-upcxx.csv
 
 
 # KNL, UPCXX (max. 256 processes)
 ((run_upcxx_knl_dist)) && {
     nproc_min=8
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
 
     for i in {5..9}; do
         GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n "$nproc_min" \
-            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --iterations "$iterations" --bench
+            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --warmup "$warmup" --iterations "$iterations" --bench
         nproc_min=$((nproc_min * 2))
     done
         
-    for i in {10..14}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
-            symmetrize/symmetrize-upcxx-knl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 256 \
+        symmetrize/symmetrize-upcxx-knl --sweep "$((1<<10)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-dist-knl-upcxx.csv
 
 
 # SKL, UPCXX + OpenMP (4 processes, max. 16 threads)
 ((run_openmp_skl_dist)) && {
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
 
     GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
         env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=2 symmetrize/symmetrize-upcxx-openmp-skl --dim "$((1<<5))" --iterations "$iterations" --bench
     
-    for i in {6..14}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 symmetrize/symmetrize-upcxx-openmp-skl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-media[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=4 symmetrize/symmetrize-upcxx-openmp-skl --sweep "$((1<<6)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-dist-skl-upcxx-openmp.csv
 
 
 # KNL, UPCXX + OpenMP (4 processes, max. 256 threads)
 ((run_openmp_knl_dist)) && {
     nproc_min=2
-    printf 'X,Time[s],Throughput[GB/s]\n'
+    printf 'X,Time[s],Throughput[GB/s],Median[s],P10[s],P90[s],Min[s],Max[s],Stddev[s]\n'
 
     for i in {5..9}; do
         GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS="$nproc_min" symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --iterations "$iterations" --bench
+            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS="$nproc_min" symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --warmup "$warmup" --iterations "$iterations" --bench
         nproc_min=$((nproc_min * 2))
     done
 
-    for i in {10..14}; do
-        GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
-            env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 symmetrize/symmetrize-upcxx-openmp-knl --dim "$((1<<i))" --iterations "$iterations" --bench
-    done
+    GASNET_SPAWNFN=C GASNET_CSPAWN_CMD="srun -w mp-knl[1-4] -n %N %C" upcxx-run -N 4 -n 4 -shared-heap 80% \
+        env OMP_PLACES=cores OMP_PROC_BIND=true OMP_NUM_THREADS=64 symmetrize/symmetrize-upcxx-openmp-knl --sweep "$((1<<10)):$((1<<14)):2" --warmup "$warmup" --iterations "$iterations" --bench
 } > ../symmetrize-dist-knl-upcxx-openmp.csv
@@ -0,0 +1,85 @@
+#ifndef UPCXX_REDISTRIBUTE_HPP
+#define UPCXX_REDISTRIBUTE_HPP
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+#include "../matrix/layout.h"
+#include "../../common/trace.hpp"
+
+// Redistribution of a matrix between two distributions (matrix/layout.h) over all ranks. Every
+// rank packs the elements for each other rank into one contiguous message, which is written
+// with a single rput into a landing buffer in the shared segment of the receiver; the receiver
+// unpacks after a barrier. No rank ever holds more than its local parts and the messages, so
+// the matrix size is not limited by the memory of a single rank.
+
+// Collective over upcxx::world(). src is the local part of this rank in distribution `from`,
+// dst receives the local part in distribution `to` (of length to.local_size(rank_me())).
+template <typename T>
+void
+redistribute(const T* src, const asc::pad_ws20::project::distribution &from,
+             T* dst, const asc::pad_ws20::project::distribution &to)
+{
+    namespace detail = asc::pad_ws20::project::detail;
+    using index_t = std::ptrdiff_t;
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+    assert(from.n == to.n);
+    assert(from.P == proc_n && to.P == proc_n);
+
+    // Messages to this rank, ordered by sender
+    const std::vector<index_t> recv_displs = detail::displacements(detail::recv_counts(from, to, proc_id));
+    upcxx::dist_object<upcxx::global_ptr<T>> landing(upcxx::new_array<T>(std::max(index_t(1), recv_displs.back())));
+    upcxx::dist_object<std::vector<index_t>> landing_displs(recv_displs);
+
+    // Messages from this rank, ordered by receiver
+    const std::vector<index_t> send_displs = detail::displacements(detail::send_counts(from, to, proc_id));
+    std::vector<T> buf(send_displs.back());
+    {
+        TraceScope ts("pack");
+        detail::pack_messages(src, from, to, proc_id, send_displs, buf.data());
+    }
+
+    // Start with the next rank, so that not all ranks write to the same receiver at once
+    upcxx::future<> done = upcxx::make_future();
+    for (upcxx::intrank_t k = 0; k < proc_n; ++k) {
+        const upcxx::intrank_t q = (proc_id + k) % proc_n;
+        const T* msg = buf.data() + send_displs[q];
+        const index_t count = send_displs[q + 1] - send_displs[q];
+        if (count == 0) {
+            continue;
+        }
+        if (q == proc_id) {
+            std::copy(msg, msg + count, landing->local() + recv_displs[proc_id]);
+            continue;
+        }
+        auto offset = upcxx::rpc(q,
+            [](upcxx::dist_object<std::vector<index_t>> &displs, upcxx::intrank_t sender) {
+                return (*displs)[sender];
+            }, landing_displs, proc_id);
+        done = upcxx::when_all(done,
+            upcxx::when_all(landing.fetch(q), offset).then(
+                [msg, count](upcxx::global_ptr<T> remote, index_t off) {
+                    return upcxx::rput(msg, remote + off, count);
+                }));
+    }
+    {
+        TraceScope ts("rput");
+        done.wait();
+    }
+    {
+        // All messages to this rank have arrived
+        TraceScope ts("barrier");
+        upcxx::barrier();
+    }
+
+    {
+        TraceScope ts("unpack");
+        detail::unpack_messages(landing->local(), recv_displs, from, to, proc_id, dst);
+    }
+    upcxx::delete_array(*landing);
+}
+
+#endif // UPCXX_REDISTRIBUTE_HPP
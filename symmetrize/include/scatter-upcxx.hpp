@@ -0,0 +1,294 @@
+#ifndef UPCXX_SCATTER_HPP
+#define UPCXX_SCATTER_HPP
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <upcxx/upcxx.hpp>
+
+#include "../matrix/layout.h"
+#include "../matrix/matrix.h"
+#include "../matrix/shared-allocator.h"
+#include "../matrix/trimatrix.h"
+#include "../../common/trace.hpp"
+
+// Distribution of a matrix held by a single rank (e.g. one which read it from a file) over all
+// ranks, and back. Destinations are in the shared segment of the receiving rank: the local
+// parts of the other ranks when scattering or broadcasting, a matrix with shared_allocator on
+// the root when gathering. Every chunk is then written with one rput straight from the array
+// of the sender into the array of the receiver, without packing, serialization or landing
+// buffers. A barrier at the end makes the chunks visible to their receivers.
+//
+// The local parts are those of matrix/layout.h: for a TriMatrix, the chunks of the diagonal,
+// lower and upper triangle of distribution::packed (as in symmetrize-upcxx); for a
+// SquareMatrix, the rows of distribution::row_block (as in symmetrize-upcxx-dense).
+
+namespace scatter_detail
+{
+using index_t = std::ptrdiff_t;
+
+// Chunks of the diagonal, lower and upper triangle of rank p
+inline std::array<std::pair<index_t, index_t>, 3>
+packed_ranges(const asc::pad_ws20::project::distribution &d, int p)
+{
+    return {d.range(d.n, p), d.range(d.t(), p), d.range(d.t(), p)};
+}
+
+// Copy the root's K arrays of lengths len to all ranks, along a binomial tree: in the round
+// with step s, the ranks which already have the arrays (the first s, counted from the root)
+// write them to the rank s places further. All ranks must hold arrays of the same lengths in
+// their shared segment.
+template <typename T, std::size_t K>
+void
+broadcast_arrays(const std::array<T*, K> &arrays, const std::array<index_t, K> &len,
+                 upcxx::intrank_t root)
+{
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t rel = (upcxx::rank_me() - root + proc_n) % proc_n;
+
+    std::array<upcxx::global_ptr<T>, K> mine;
+    for (std::size_t a = 0; a < K; ++a) {
+        mine[a] = upcxx::to_global_ptr(arrays[a]);
+    }
+    upcxx::dist_object<std::array<upcxx::global_ptr<T>, K>> remote(mine);
+
+    for (upcxx::intrank_t s = 1; s < proc_n; s *= 2) {
+        if (rel < s && rel + s < proc_n) {
+            const upcxx::intrank_t q = (rel + s + root) % proc_n;
+            TraceScope ts("rput");
+            remote.fetch(q).then(
+                [&arrays, &len](const std::array<upcxx::global_ptr<T>, K> &dst) {
+                    upcxx::future<> done = upcxx::make_future();
+                    for (std::size_t a = 0; a < K; ++a) {
+                        if (len[a] > 0) {
+                            done = upcxx::when_all(done, upcxx::rput(arrays[a], dst[a], len[a]));
+                        }
+                    }
+                    return done;
+                }).wait();
+        }
+        TraceScope ts("barrier");
+        upcxx::barrier(); // the receivers of this round send in the next one
+    }
+}
+
+} // namespace scatter_detail
+
+// Collective over upcxx::world(). M is the matrix on the root and ignored on other ranks.
+// diag, lower and upper receive the chunks of this rank in distribution::packed(M.n(),
+// rank_n()), of lengths d.diag_size(rank_me()) and d.tri_size(rank_me()), and must be in the
+// shared segment of this rank.
+template <typename T, typename Alloc>
+void
+scatter_packed(const asc::pad_ws20::project::TriMatrix<T, Alloc> *M, upcxx::intrank_t root,
+               const asc::pad_ws20::project::distribution &d, upcxx::global_ptr<T> diag,
+               upcxx::global_ptr<T> lower, upcxx::global_ptr<T> upper)
+{
+    using scatter_detail::index_t;
+    assert(d.kind == asc::pad_ws20::project::dist_kind::packed && d.P == upcxx::rank_n());
+    upcxx::dist_object<std::array<upcxx::global_ptr<T>, 3>> chunks({diag, lower, upper});
+
+    if (upcxx::rank_me() == root) {
+        assert(M != nullptr && M->n() == d.n);
+        const std::array<const T*, 3> src{M->diag(), M->lower(), M->upper()};
+        upcxx::future<> done = upcxx::make_future();
+
+        for (upcxx::intrank_t q = 0; q < d.P; ++q) {
+            const auto ranges = scatter_detail::packed_ranges(d, q);
+            done = upcxx::when_all(done, chunks.fetch(q).then(
+                [src, ranges](const std::array<upcxx::global_ptr<T>, 3> &dst) {
+                    upcxx::future<> f = upcxx::make_future();
+                    for (std::size_t a = 0; a < 3; ++a) {
+                        const auto [k0, k1] = ranges[a];
+                        if (k1 > k0) {
+                            f = upcxx::when_all(f, upcxx::rput(src[a] + k0, dst[a], k1 - k0));
+                        }
+                    }
+                    return f;
+                }));
+        }
+        TraceScope ts("rput");
+        done.wait();
+    }
+    TraceScope ts("barrier");
+    upcxx::barrier();
+}
+
+// Collective over upcxx::world(). The inverse of scatter_packed(): diag, lower and upper are the
+// chunks of this rank (in any memory), M receives the matrix on the root and is ignored on other
+// ranks. M must be allocated in the shared segment of the root.
+template <typename T, std::size_t A>
+void
+gather_packed(const T* diag, const T* lower, const T* upper,
+              const asc::pad_ws20::project::distribution &d,
+              asc::pad_ws20::project::TriMatrix<T, asc::pad_ws20::project::shared_allocator<T, A>> *M,
+              upcxx::intrank_t root)
+{
+    assert(d.kind == asc::pad_ws20::project::dist_kind::packed && d.P == upcxx::rank_n());
+    std::array<upcxx::global_ptr<T>, 3> mine;
+    if (upcxx::rank_me() == root) {
+        assert(M != nullptr && M->n() == d.n);
+        mine = {upcxx::to_global_ptr(M->diag()), upcxx::to_global_ptr(M->lower()),
+                upcxx::to_global_ptr(M->upper())};
+    }
+    upcxx::dist_object<std::array<upcxx::global_ptr<T>, 3>> target(mine);
+
+    const auto ranges = scatter_detail::packed_ranges(d, upcxx::rank_me());
+    const std::array<const T*, 3> src{diag, lower, upper};
+    {
+        TraceScope ts("rput");
+        target.fetch(root).then(
+            [&src, &ranges](const std::array<upcxx::global_ptr<T>, 3> &dst) {
+                upcxx::future<> f = upcxx::make_future();
+                for (std::size_t a = 0; a < 3; ++a) {
+                    const auto [k0, k1] = ranges[a];
+                    if (k1 > k0) {
+                        f = upcxx::when_all(f, upcxx::rput(src[a], dst[a] + k0, k1 - k0));
+                    }
+                }
+                return f;
+            }).wait();
+    }
+    TraceScope ts("barrier");
+    upcxx::barrier();
+}
+
+// Collective over upcxx::world(). M is the matrix on the root and ignored on other ranks; rows
+// receives the rows of this rank in distribution::row_block(M.n(), rank_n()), of length
+// d.local_size(rank_me()), and must be in the shared segment of this rank.
+template <typename T, typename Alloc>
+void
+scatter_rows(const asc::pad_ws20::project::SquareMatrix<T, Alloc> *M, upcxx::intrank_t root,
+             const asc::pad_ws20::project::distribution &d, upcxx::global_ptr<T> rows)
+{
+    assert(d.kind == asc::pad_ws20::project::dist_kind::row_block && d.P == upcxx::rank_n());
+    upcxx::dist_object<upcxx::global_ptr<T>> block(rows);
+
+    if (upcxx::rank_me() == root) {
+        assert(M != nullptr && M->n() == d.n);
+        const T* src = M->elements();
+        const auto n = d.n;
+        upcxx::future<> done = upcxx::make_future();
+
+        for (upcxx::intrank_t q = 0; q < d.P; ++q) {
+            const auto [i0, i1] = d.range(n, q);
+            if (i1 > i0) {
+                done = upcxx::when_all(done, block.fetch(q).then(
+                    [src, n, i0 = i0, i1 = i1](upcxx::global_ptr<T> dst) {
+                        return upcxx::rput(src + i0*n, dst, (i1 - i0)*n);
+                    }));
+            }
+        }
+        TraceScope ts("rput");
+        done.wait();
+    }
+    TraceScope ts("barrier");
+    upcxx::barrier();
+}
+
+// Collective over upcxx::world(). The inverse of scatter_rows(): rows are the rows of this rank
+// (in any memory), M receives the matrix on the root, in its shared segment.
+template <typename T, std::size_t A>
+void
+gather_rows(const T* rows, const asc::pad_ws20::project::distribution &d,
+            asc::pad_ws20::project::SquareMatrix<T, asc::pad_ws20::project::shared_allocator<T, A>> *M,
+            upcxx::intrank_t root)
+{
+    assert(d.kind == asc::pad_ws20::project::dist_kind::row_block && d.P == upcxx::rank_n());
+    upcxx::global_ptr<T> mine;
+    if (upcxx::rank_me() == root) {
+        assert(M != nullptr && M->n() == d.n);
+        mine = upcxx::to_global_ptr(M->elements());
+    }
+    upcxx::dist_object<upcxx::global_ptr<T>> target(mine);
+
+    const auto n = d.n;
+    const auto [i0, i1] = d.range(n, upcxx::rank_me());
+    if (i1 > i0) {
+        TraceScope ts("rput");
+        target.fetch(root).then([rows, n, i0 = i0, i1 = i1](upcxx::global_ptr<T> dst) {
+            return upcxx::rput(rows, dst + i0*n, (i1 - i0)*n);
+        }).wait();
+    }
+    TraceScope ts("barrier");
+    upcxx::barrier();
+}
+
+// Collective over upcxx::world(). Copy the matrix of the root into M on all other ranks, which
+// must have the same dimension and be allocated in the shared segment.
+template <typename T, std::size_t A>
+void
+broadcast_matrix(asc::pad_ws20::project::TriMatrix<T, asc::pad_ws20::project::shared_allocator<T, A>> &M,
+                 upcxx::intrank_t root)
+{
+    scatter_detail::broadcast_arrays<T, 3>({M.diag(), M.lower(), M.upper()},
+                                           {M.n(), M.t(), M.t()}, root);
+}
+
+template <typename T, std::size_t A>
+void
+broadcast_matrix(asc::pad_ws20::project::SquareMatrix<T, asc::pad_ws20::project::shared_allocator<T, A>> &M,
+                 upcxx::intrank_t root)
+{
+    scatter_detail::broadcast_arrays<T, 1>({M.elements()}, {M.n() * M.n()}, root);
+}
+
+// Serialization of whole matrices as rpc arguments or results: the dimension, followed by the
+// arrays, which are read straight from the message into a matrix constructed on the receiver,
+// with a default-constructed allocator of the receiver (with shared_allocator, in its shared
+// segment). Matrices are move-only, so the callee takes the deserialized matrix by rvalue
+// reference (or by value) and can keep it without a copy:
+//
+//     upcxx::rpc(q, [](TriMatrix<float>&& M) { store(std::move(M)); }, std::move(local));
+//
+// Only the elements are sent, not the padding of the contiguous layout. For slices of large
+// matrices, prefer the rput-based functions above, which avoid the copies into and out of
+// the message.
+namespace upcxx
+{
+template <typename T, typename Alloc>
+struct serialization<asc::pad_ws20::project::TriMatrix<T, Alloc>>
+{
+    typedef asc::pad_ws20::project::TriMatrix<T, Alloc> matrix_type;
+
+    template <typename Writer>
+    static void serialize(Writer &w, const matrix_type &M) {
+        w.write(M.n());
+        w.write_sequence(M.diag(), M.diag() + M.n(), M.n());
+        w.write_sequence(M.lower(), M.lower() + M.t(), M.t());
+        w.write_sequence(M.upper(), M.upper() + M.t(), M.t());
+    }
+
+    template <typename Reader>
+    static matrix_type* deserialize(Reader &r, void *storage) {
+        const auto n = r.template read<typename matrix_type::index_t>();
+        matrix_type *M = ::new(storage) matrix_type(n);
+        r.template read_sequence_into<T>(M->diag(), M->n());
+        r.template read_sequence_into<T>(M->lower(), M->t());
+        r.template read_sequence_into<T>(M->upper(), M->t());
+        return M;
+    }
+};
+
+template <typename T, typename Alloc>
+struct serialization<asc::pad_ws20::project::SquareMatrix<T, Alloc>>
+{
+    typedef asc::pad_ws20::project::SquareMatrix<T, Alloc> matrix_type;
+
+    template <typename Writer>
+    static void serialize(Writer &w, const matrix_type &M) {
+        w.write(M.n());
+        w.write_sequence(M.elements(), M.elements() + M.n()*M.n(), M.n()*M.n());
+    }
+
+    template <typename Reader>
+    static matrix_type* deserialize(Reader &r, void *storage) {
+        const auto n = r.template read<typename matrix_type::index_t>();
+        matrix_type *M = ::new(storage) matrix_type(n);
+        r.template read_sequence_into<T>(M->elements(), n*n);
+        return M;
+    }
+};
+} // namespace upcxx
+
+#endif // UPCXX_SCATTER_HPP
@@ -0,0 +1,45 @@
+#ifndef UPCXX_SPMV_HPP
+#define UPCXX_SPMV_HPP
+#include <cstddef>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+#include "../matrix/symmatrix.h"
+#include "../../common/phase-timer.hpp"
+#include "../../common/trace.hpp"
+
+// Matrix-vector product y = A x of a symmetric n x n matrix in the packed layout of
+// symmetrize-upcxx: every rank owns a contiguous chunk of the diagonal, starting at d0, and of
+// the lower triangle (col-major), starting at offset k0. Since the matrix is symmetric, the
+// upper triangle is not needed. x is replicated on all ranks; every rank computes the partial
+// product of its chunks, and the partial results are summed with a reduction to all ranks.
+
+// Collective over upcxx::world(). y must hold n elements on every rank. The local product is
+// accounted to phase::compute, the reduction to phase::collective.
+template <typename T>
+void
+spmv_packed(const T* diag, std::ptrdiff_t d0, std::ptrdiff_t diag_n,
+            const T* lower, std::ptrdiff_t k0, std::ptrdiff_t lower_n,
+            std::ptrdiff_t n, const T* x, T* y, PhaseTimer &timer)
+{
+    std::vector<T> partial(n, T(0));
+
+    timer.start(phase::compute);
+    {
+        TraceScope ts("spmv");
+        for (std::ptrdiff_t i = 0; i < diag_n; ++i) {
+            partial[d0 + i] = diag[i] * x[d0 + i];
+        }
+        asc::pad_ws20::project::detail::spmv_lower(lower, k0, k0 + lower_n, n, x, partial.data());
+    }
+    timer.stop(phase::compute);
+
+    timer.start(phase::collective);
+    {
+        TraceScope ts("reduce_all");
+        upcxx::reduce_all(partial.data(), y, n, upcxx::op_fast_add).wait();
+    }
+    timer.stop(phase::collective);
+}
+
+#endif // UPCXX_SPMV_HPP
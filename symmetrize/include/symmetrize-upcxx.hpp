@@ -0,0 +1,337 @@
+#ifndef UPCXX_SYMMETRIZE_HPP
+#define UPCXX_SYMMETRIZE_HPP
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include <upcxx/upcxx.hpp>
+
+#include "../matrix/blocked.h"
+#include "../matrix/dirty.h"
+#include "../../common/phase-timer.hpp"
+#include "../../common/trace.hpp"
+
+// Symmetrization of a dense n x n matrix distributed in row blocks: rank p owns the rows
+// [p*b, (p+1)*b), b = n / rank_n(), in row-major order in its shared segment. The matrix is
+// split into b x b tiles; tile (p,q) is owned by rank p, its mirror (q,p) by rank q.
+//
+// Diagonal tiles (p,p) are symmetrized locally. Every pair of off-diagonal tiles is handled
+// by one of the two ranks: it gets the mirror tile with rget, averages it with the transposed
+// local tile, and writes it back with rput. Transfers of the next pair are issued before the
+// current pair is averaged, so communication overlaps with local work.
+
+template <typename T>
+using dist_rows = upcxx::dist_object<upcxx::global_ptr<T>>;
+using index_t = std::ptrdiff_t;
+
+// Ranks with which rank p exchanges tile pairs, such that every pair is handled by exactly
+// one rank and each rank handles (P-1)/2 or P/2 pairs: the next (P-1)/2 ranks in cyclic order,
+// and for even P the opposite rank if p is in the lower half.
+inline std::vector<upcxx::intrank_t>
+symmetrize_partners(upcxx::intrank_t p, upcxx::intrank_t P)
+{
+    std::vector<upcxx::intrank_t> partners;
+    for (upcxx::intrank_t k = 1; k <= (P - 1) / 2; ++k) {
+        partners.push_back((p + k) % P);
+    }
+    if (P % 2 == 0 && p < P / 2) {
+        partners.push_back(p + P / 2);
+    }
+    return partners;
+}
+
+// Get the b x b tile starting at column `col` of the row block at `rows` (row stride n) into
+// the contiguous buffer `tile`, or put it back.
+template <typename T>
+upcxx::future<>
+symmetrize_get_tile(upcxx::global_ptr<T> rows, index_t n, index_t b, index_t col, T* tile)
+{
+    upcxx::future<> f = upcxx::make_future();
+    for (index_t r = 0; r < b; ++r) {
+        f = upcxx::when_all(f, upcxx::rget(rows + r*n + col, tile + r*b, b));
+    }
+    return f;
+}
+
+template <typename T>
+upcxx::future<>
+symmetrize_put_tile(const T* tile, upcxx::global_ptr<T> rows, index_t n, index_t b, index_t col)
+{
+    upcxx::future<> f = upcxx::make_future();
+    for (index_t r = 0; r < b; ++r) {
+        f = upcxx::when_all(f, upcxx::rput(tile + r*b, rows + r*n + col, b));
+    }
+    return f;
+}
+
+// Collective over upcxx::world(). Communication (including waits) is accounted to
+// phase::exchange, averaging to phase::compute.
+template <typename T>
+void
+symmetrize_block_rows(dist_rows<T> &rows_g, index_t n, PhaseTimer &timer)
+{
+    namespace detail = asc::pad_ws20::project::detail;
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+    const index_t b = n / proc_n;
+    assert(n == b * proc_n);
+
+    T* rows = rows_g->local();
+    const std::vector<upcxx::intrank_t> partners = symmetrize_partners(proc_id, proc_n);
+    const std::size_t pairs = partners.size();
+
+    // Row blocks of the partners
+    timer.start(phase::exchange);
+    std::vector<upcxx::global_ptr<T>> remote(pairs);
+    {
+        TraceScope ts("fetch");
+        for (std::size_t k = 0; k < pairs; ++k) {
+            remote[k] = rows_g.fetch(partners[k]).wait();
+        }
+    }
+
+    // Double buffering: the mirror tile of pair k+1 is transferred while pair k is averaged.
+    // A buffer is reused only after its previous contents were put back.
+    constexpr std::size_t depth = 2;
+    // Buffers are allocated on first use only, as a single rank has no pairs.
+    std::vector<std::vector<T>> buffer(depth);
+    std::vector<upcxx::future<>> get(depth, upcxx::make_future());
+    std::vector<upcxx::future<>> put(depth, upcxx::make_future());
+
+    auto issue_get = [&](std::size_t k) {
+        const std::size_t slot = k % depth;
+        put[slot].wait();
+        buffer[slot].resize(b * b);
+        get[slot] = symmetrize_get_tile(remote[k], n, b, proc_id * b, buffer[slot].data());
+    };
+    if (pairs > 0) {
+        issue_get(0);
+    }
+    timer.stop(phase::exchange);
+
+    // Diagonal tile, while the first mirror tile is in flight
+    timer.start(phase::compute);
+    {
+        TraceScope ts("diagonal");
+        T* diag = rows + proc_id * b;
+        for (index_t i = 0; i < b; i += detail::tile_size) {
+            for (index_t j = 0; j <= i; j += detail::tile_size) {
+                detail::pairs_block(diag, n, i, std::min(i + detail::tile_size, b),
+                                    j, std::min(j + detail::tile_size, b), detail::average_op());
+            }
+        }
+    }
+    timer.stop(phase::compute);
+
+    for (std::size_t k = 0; k < pairs; ++k) {
+        const std::size_t slot = k % depth;
+
+        timer.start(phase::exchange);
+        if (k + 1 < pairs) {
+            issue_get(k + 1);
+        }
+        {
+            TraceScope ts("rget");
+            get[slot].wait();
+        }
+        timer.stop(phase::exchange);
+
+        timer.start(phase::compute);
+        {
+            TraceScope ts("average");
+            detail::pairs_rect(rows + partners[k] * b, n, buffer[slot].data(), b, b, b,
+                               detail::average_op());
+        }
+        timer.stop(phase::compute);
+
+        put[slot] = symmetrize_put_tile(buffer[slot].data(), remote[k], n, b, proc_id * b);
+    }
+
+    timer.start(phase::exchange);
+    {
+        TraceScope ts("rput");
+        for (auto& f : put) {
+            f.wait();
+        }
+    }
+    timer.stop(phase::exchange);
+
+    // Mirror tiles of this rank may still be written by its partners
+    timer.start(phase::collective);
+    {
+        TraceScope ts("barrier");
+        upcxx::barrier();
+    }
+    timer.stop(phase::collective);
+}
+
+// Tile dimension for tracking updates of a row block of b rows: the largest divisor of b up to
+// detail::tile_size, so that tiles of all ranks lie on one grid and mirror each other.
+inline index_t
+symmetrize_dirty_tile(index_t b)
+{
+    index_t tb = std::min(b, asc::pad_ws20::project::detail::tile_size);
+    while (b % tb != 0) {
+        --tb;
+    }
+    return tb;
+}
+
+// Incremental variant of symmetrize_block_rows(): only tile pairs of which a tile was written
+// are exchanged and averaged. dirty covers the row block of this rank (b x n elements, in tiles
+// of symmetrize_dirty_tile(b)) and is cleared on return. Each rank first fetches the flags of
+// the mirror tiles from its partners, then transfers the mirror tiles of the dirty pairs only.
+template <typename T>
+void
+symmetrize_block_rows(dist_rows<T> &rows_g, index_t n, asc::pad_ws20::project::DirtyTiles &dirty,
+                      PhaseTimer &timer)
+{
+    namespace project = asc::pad_ws20::project;
+    namespace detail = asc::pad_ws20::project::detail;
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const upcxx::intrank_t proc_id = upcxx::rank_me();
+    const index_t b = n / proc_n;
+    const index_t tb = dirty.tile_dim();
+    const index_t m = b / tb; // tiles per row block
+    assert(n == b * proc_n);
+    assert(b == m * tb);
+    assert(dirty.rows() == b && dirty.cols() == n);
+
+    T* rows = rows_g->local();
+    const std::vector<upcxx::intrank_t> partners = symmetrize_partners(proc_id, proc_n);
+    const std::size_t pairs = partners.size();
+    upcxx::dist_object<const project::DirtyTiles*> dirty_g(&dirty);
+
+    // Row blocks of the partners, and the flags of the tiles mirroring this row block: tile
+    // (C, R) of the partner, with C < m and R < m, is at [C*m + R].
+    timer.start(phase::exchange);
+    std::vector<upcxx::global_ptr<T>> remote(pairs);
+    std::vector<std::vector<unsigned char>> mirror(pairs);
+    {
+        TraceScope ts("fetch");
+        upcxx::future<> done = upcxx::make_future();
+        for (std::size_t k = 0; k < pairs; ++k) {
+            auto f = upcxx::rpc(partners[k],
+                [](upcxx::dist_object<const project::DirtyTiles*> &d, index_t col0, index_t m) {
+                    const project::DirtyTiles &D = **d;
+                    std::vector<unsigned char> flags(m * m);
+                    for (index_t r = 0; r < m; ++r) {
+                        for (index_t c = 0; c < m; ++c) {
+                            flags[r*m + c] = D(r, col0 + c);
+                        }
+                    }
+                    return flags;
+                }, dirty_g, proc_id * m, m);
+            done = upcxx::when_all(done,
+                f.then([&mirror, k](std::vector<unsigned char> flags) { mirror[k] = std::move(flags); }),
+                rows_g.fetch(partners[k]).then([&remote, k](upcxx::global_ptr<T> p) { remote[k] = p; }));
+        }
+        done.wait();
+    }
+
+    // Dirty tile pairs (R, C) for every partner: tile (R, C) of the partner's column block here,
+    // mirrored by tile (C, R) of this rank's column block there
+    std::vector<std::vector<std::pair<index_t, index_t>>> tiles(pairs);
+    for (std::size_t k = 0; k < pairs; ++k) {
+        for (index_t R = 0; R < m; ++R) {
+            for (index_t C = 0; C < m; ++C) {
+                if (dirty(R, partners[k] * m + C) || mirror[k][C*m + R]) {
+                    tiles[k].emplace_back(R, C);
+                }
+            }
+        }
+    }
+
+    // Double buffering over partners, as in symmetrize_block_rows()
+    constexpr std::size_t depth = 2;
+    std::vector<std::vector<T>> buffer(depth);
+    std::vector<upcxx::future<>> get(depth, upcxx::make_future());
+    std::vector<upcxx::future<>> put(depth, upcxx::make_future());
+
+    auto issue_get = [&](std::size_t k) {
+        const std::size_t slot = k % depth;
+        put[slot].wait();
+        buffer[slot].resize(tiles[k].size() * tb * tb);
+        upcxx::future<> f = upcxx::make_future();
+        for (std::size_t t = 0; t < tiles[k].size(); ++t) {
+            const auto [R, C] = tiles[k][t];
+            f = upcxx::when_all(f, symmetrize_get_tile(remote[k] + C*tb*n, n, tb, proc_id*b + R*tb,
+                                                       buffer[slot].data() + t*tb*tb));
+        }
+        get[slot] = f;
+    };
+    if (pairs > 0) {
+        issue_get(0);
+    }
+    timer.stop(phase::exchange);
+
+    timer.start(phase::compute);
+    {
+        TraceScope ts("diagonal");
+        T* diag = rows + proc_id * b;
+        for (index_t R = 0; R < m; ++R) {
+            for (index_t C = 0; C <= R; ++C) {
+                if (dirty(R, proc_id*m + C) || dirty(C, proc_id*m + R)) {
+                    detail::pairs_block(diag, n, R*tb, (R + 1)*tb, C*tb, (C + 1)*tb,
+                                        detail::average_op());
+                }
+            }
+        }
+    }
+    timer.stop(phase::compute);
+
+    for (std::size_t k = 0; k < pairs; ++k) {
+        const std::size_t slot = k % depth;
+
+        timer.start(phase::exchange);
+        if (k + 1 < pairs) {
+            issue_get(k + 1);
+        }
+        {
+            TraceScope ts("rget");
+            get[slot].wait();
+        }
+        timer.stop(phase::exchange);
+
+        timer.start(phase::compute);
+        {
+            TraceScope ts("average");
+            for (std::size_t t = 0; t < tiles[k].size(); ++t) {
+                const auto [R, C] = tiles[k][t];
+                detail::pairs_rect(rows + R*tb*n + partners[k]*b + C*tb, n,
+                                   buffer[slot].data() + t*tb*tb, tb, tb, tb, detail::average_op());
+            }
+        }
+        timer.stop(phase::compute);
+
+        upcxx::future<> f = upcxx::make_future();
+        for (std::size_t t = 0; t < tiles[k].size(); ++t) {
+            const auto [R, C] = tiles[k][t];
+            f = upcxx::when_all(f, symmetrize_put_tile(buffer[slot].data() + t*tb*tb,
+                                                       remote[k] + C*tb*n, n, tb, proc_id*b + R*tb));
+        }
+        put[slot] = f;
+    }
+
+    timer.start(phase::exchange);
+    {
+        TraceScope ts("rput");
+        for (auto& f : put) {
+            f.wait();
+        }
+    }
+    timer.stop(phase::exchange);
+
+    // Mirror tiles of this rank may still be written by its partners, which also read the
+    // flags until then
+    timer.start(phase::collective);
+    {
+        TraceScope ts("barrier");
+        upcxx::barrier();
+    }
+    timer.stop(phase::collective);
+    dirty.clear();
+}
+
+#endif // UPCXX_SYMMETRIZE_HPP
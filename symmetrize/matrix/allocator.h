@@ -0,0 +1,107 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+#include <sys/mman.h>
+
+
+namespace asc::pad_ws20::project
+{
+constexpr std::size_t cache_line_size = 64;
+constexpr std::size_t huge_page_size = std::size_t(1) << 21; // 2 MiB, x86-64
+
+// Allocator returning memory aligned to Alignment bytes (default: a cache line, so that vector
+// loads at the start of an array are aligned). With an alignment of at least a huge page, the
+// kernel is asked to back the memory with transparent huge pages.
+template <typename T, std::size_t Alignment = cache_line_size>
+class aligned_allocator
+{
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0);
+
+public:
+    typedef T value_type;
+    static constexpr std::size_t alignment = Alignment;
+
+    template <typename U>
+    struct rebind {
+        typedef aligned_allocator<U, Alignment> other;
+    };
+
+    aligned_allocator() noexcept = default;
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* p = ::operator new(n * sizeof(T), std::align_val_t(Alignment));
+        if constexpr (Alignment >= huge_page_size) {
+            madvise(p, n * sizeof(T), MADV_HUGEPAGE); // advisory, failure is not an error
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+};
+
+template <typename T, typename U, std::size_t A>
+bool operator==(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&) { return true; }
+
+template <typename T, typename U, std::size_t A>
+bool operator!=(const aligned_allocator<T, A>&, const aligned_allocator<U, A>&) { return false; }
+
+template <typename T>
+using huge_page_allocator = aligned_allocator<T, huge_page_size>;
+
+// Allocator of matrices over memory which they do not own, such as a mapped file (see
+// mapped.h). Such matrices are constructed with adopt_arrays; deallocation does nothing, and
+// allocation fails.
+template <typename T>
+class non_owning_allocator
+{
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef non_owning_allocator<U> other;
+    };
+
+    non_owning_allocator() noexcept = default;
+    template <typename U>
+    non_owning_allocator(const non_owning_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t) {
+        throw std::bad_alloc();
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+};
+
+template <typename T, typename U>
+bool operator==(const non_owning_allocator<T>&, const non_owning_allocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const non_owning_allocator<T>&, const non_owning_allocator<U>&) { return false; }
+
+namespace detail
+{
+// n elements of type T, rounded up to a multiple of the cache line size. Used to align arrays
+// which share one allocation.
+template <typename T>
+constexpr std::ptrdiff_t padded(std::ptrdiff_t n) {
+    constexpr std::ptrdiff_t a = static_cast<std::ptrdiff_t>(cache_line_size / sizeof(T));
+    return a > 1 ? (n + a - 1) / a * a : n;
+}
+
+} // namespace detail
+
+} // namespace asc::pad_ws20::project
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,183 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "allocator.h"
+#include "blocked.h"
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Matrices per chunk of a batch which is assigned to one thread at a time
+constexpr std::ptrdiff_t batch_chunk = 1024;
+
+// Apply op(a_ij, a_ji) for all j < i to the matrices [m0, m1) of a batch of n x n matrices,
+// where element (i,j) of matrix m is at a[(i*n + j)*ld + m]. The inner loop runs over the
+// batch, with unit stride in both elements of the pair, so it vectorizes for any n.
+template <typename T, typename Op>
+void pairs_batch(T* a, std::ptrdiff_t n, std::ptrdiff_t ld, std::ptrdiff_t m0, std::ptrdiff_t m1, Op op)
+{
+    for (std::ptrdiff_t i = 1; i < n; ++i) {
+        for (std::ptrdiff_t j = 0; j < i; ++j) {
+            T* x = a + (i*n + j)*ld;
+            T* y = a + (j*n + i)*ld;
+            #pragma omp simd
+            for (std::ptrdiff_t m = m0; m < m1; ++m) {
+                op(x[m], y[m]);
+            }
+        }
+    }
+}
+
+// Same, with chunks of batch_chunk matrices distributed over the OpenMP threads
+template <typename T, typename Op>
+void pairs_batch_parallel(T* a, std::ptrdiff_t n, std::ptrdiff_t ld, std::ptrdiff_t m0, std::ptrdiff_t m1, Op op)
+{
+    const std::ptrdiff_t chunks = (m1 - m0 + batch_chunk - 1) / batch_chunk;
+
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t c = 0; c < chunks; ++c) {
+        const std::ptrdiff_t begin = m0 + c*batch_chunk;
+        pairs_batch(a, n, ld, begin, std::min(begin + batch_chunk, m1), op);
+    }
+}
+
+} // namespace detail
+
+// Batch of `count` square matrices of the same dimension n, stored as a structure of arrays:
+// element (i,j) of all matrices is contiguous, in an array of `ld` elements which starts on a
+// cache line. A batch of thousands of small matrices is a single allocation, and kernels work
+// on all matrices at once, with one vector lane per matrix, instead of looping over the
+// elements of a single matrix, which for n = 3 is shorter than a vector.
+template <typename T, typename Alloc = aligned_allocator<T>>
+class MatrixBatch
+{
+    static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
+
+public:
+    typedef T value_type;
+    typedef Alloc allocator_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::ptrdiff_t index_t;
+
+    MatrixBatch(index_t n, index_t count, const Alloc& alloc = Alloc())
+        : _n(n), _count(count), _ld(detail::padded<T>(count)), _alloc(alloc)
+    {
+        assert(n >= 1);
+        assert(count >= 1);
+        assert(_ld < std::numeric_limits<index_t>::max() / n / n); // overflow check
+        _elements = _alloc.allocate(n*n * _ld);
+    }
+
+    // From count matrices, each in row-major order, stored one after another
+    MatrixBatch(const T* row_major, index_t n, index_t count, const Alloc& alloc = Alloc())
+        : MatrixBatch(n, count, alloc)
+    {
+        #pragma omp parallel for schedule(static)
+        for (index_t m = 0; m < _count; ++m) {
+            load(m, row_major + m*_n*_n);
+        }
+    }
+
+    MatrixBatch(const MatrixBatch&) = delete;
+    MatrixBatch& operator=(const MatrixBatch&) = delete;
+
+    MatrixBatch(MatrixBatch&& other) noexcept
+        : _n(other._n), _count(other._count), _ld(other._ld), _alloc(std::move(other._alloc)),
+          _elements(std::exchange(other._elements, nullptr))
+    {}
+
+    MatrixBatch& operator=(MatrixBatch&& other) noexcept {
+        if (this != &other) {
+            if (_elements != nullptr) {
+                _alloc.deallocate(_elements, _n*_n * _ld);
+            }
+            _n = other._n;
+            _count = other._count;
+            _ld = other._ld;
+            _alloc = std::move(other._alloc);
+            _elements = std::exchange(other._elements, nullptr);
+        }
+        return *this;
+    }
+
+    ~MatrixBatch() {
+        if (_elements != nullptr) {
+            _alloc.deallocate(_elements, _n*_n * _ld);
+        }
+    }
+
+    // Element (i,j) of matrix m
+    T operator()(index_t m, index_t i, index_t j) const {
+        assert(m >= 0 && m < _count);
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+        return _elements[(i*_n + j)*_ld + m];
+    }
+
+    T& operator()(index_t m, index_t i, index_t j) {
+        assert(m >= 0 && m < _count);
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+        return _elements[(i*_n + j)*_ld + m];
+    }
+
+    // Element (i,j) of all matrices
+    T* element(index_t i, index_t j) { return _elements + (i*_n + j)*_ld; }
+    const T* element(index_t i, index_t j) const { return _elements + (i*_n + j)*_ld; }
+
+    // Copy matrix m from or to n*n elements in row-major order
+    void load(index_t m, const T* row_major) {
+        for (index_t k = 0; k < _n*_n; ++k) {
+            _elements[k*_ld + m] = row_major[k];
+        }
+    }
+
+    void store(index_t m, T* row_major) const {
+        for (index_t k = 0; k < _n*_n; ++k) {
+            row_major[k] = _elements[k*_ld + m];
+        }
+    }
+
+    void transpose() {
+        detail::pairs_batch(_elements, _n, _ld, index_t(0), _count, detail::swap_op());
+    }
+
+    void symmetrize() {
+        detail::pairs_batch(_elements, _n, _ld, index_t(0), _count, detail::average_op());
+    }
+
+    void transpose_parallel() {
+        detail::pairs_batch_parallel(_elements, _n, _ld, index_t(0), _count, detail::swap_op());
+    }
+
+    void symmetrize_parallel() {
+        detail::pairs_batch_parallel(_elements, _n, _ld, index_t(0), _count, detail::average_op());
+    }
+
+    index_t n() const noexcept { return _n; }
+    index_t count() const noexcept { return _count; }
+    index_t ld() const noexcept { return _ld; }
+    T* elements() { return _elements; }
+    const T* elements() const { return _elements; }
+    allocator_type get_allocator() const { return _alloc; }
+
+private:
+    index_t _n;
+    index_t _count;
+    index_t _ld; // distance between elements (i,j) and (i,j+1) of a matrix
+    Alloc _alloc;
+    T* _elements = nullptr;
+};
+
+} // namespace asc::pad_ws20::project
+
+#endif // BATCH_H
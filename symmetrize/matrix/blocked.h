@@ -0,0 +1,208 @@
+#ifndef BLOCKED_H
+#define BLOCKED_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Cache-blocked in-place operations on a dense row-major n x n matrix, which combine every
+// element a_ij of the lower triangle with its mirror a_ji (transposition, symmetrization).
+//
+// The lower triangle is split into tiles of tile_size x tile_size elements; a tile (I,J) is
+// processed together with its mirror (J,I), so both are kept in cache instead of reading a_ji
+// with stride n. Within a tile pair, micro tiles of micro_tile x micro_tile elements are loaded
+// into local arrays with unit stride, combined there (the compiler maps the index swap to
+// register shuffles), and stored back with unit stride.
+
+constexpr std::ptrdiff_t micro_tile = 8;
+constexpr std::ptrdiff_t tile_size = 64; // tile pair of floats: 32 KiB, the L1 size on SKL and KNL
+
+struct swap_op {
+    template <typename T>
+    void operator()(T& lower, T& upper) const {
+        using std::swap;
+        swap(lower, upper);
+    }
+};
+
+struct average_op {
+    template <typename T>
+    void operator()(T& lower, T& upper) const {
+        T s = (lower + upper) / 2;
+        lower = s;
+        upper = s;
+    }
+};
+
+// Apply op(a_ij, a_ji) for all i0 <= i < i1, j0 <= j < j1 with j < i. n is the row stride,
+// so a may also point to a square block of a larger (or distributed) matrix.
+template <typename T, typename Op>
+void pairs_block(T* a, std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t i1,
+                 std::ptrdiff_t j0, std::ptrdiff_t j1, Op op)
+{
+    constexpr std::ptrdiff_t m = micro_tile;
+
+    for (std::ptrdiff_t i = i0; i < i1; i += m) {
+        for (std::ptrdiff_t j = j0; j < std::min(j1, i + m); j += m) {
+            if (i + m <= i1 && j + m <= j1 && j + m <= i) {
+                // Full micro tile strictly below the diagonal
+                T lo[m][m];
+                T up[m][m];
+                for (std::ptrdiff_t r = 0; r < m; ++r) {
+                    for (std::ptrdiff_t c = 0; c < m; ++c) {
+                        lo[r][c] = a[(i + r)*n + j + c];
+                        up[r][c] = a[(j + r)*n + i + c];
+                    }
+                }
+                for (std::ptrdiff_t r = 0; r < m; ++r) {
+                    for (std::ptrdiff_t c = 0; c < m; ++c) {
+                        op(lo[r][c], up[c][r]);
+                    }
+                }
+                for (std::ptrdiff_t r = 0; r < m; ++r) {
+                    for (std::ptrdiff_t c = 0; c < m; ++c) {
+                        a[(i + r)*n + j + c] = lo[r][c];
+                        a[(j + r)*n + i + c] = up[r][c];
+                    }
+                }
+            } else {
+                // Micro tiles on the diagonal or at the matrix edge
+                for (std::ptrdiff_t r = i; r < std::min(i + m, i1); ++r) {
+                    for (std::ptrdiff_t c = j; c < std::min({j + m, j1, r}); ++c) {
+                        op(a[r*n + c], a[c*n + r]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Apply op(x_ij, y_ji) for all 0 <= i < rows, 0 <= j < cols, where x and y are separate
+// blocks with row strides ldx and ldy (e.g. a block and a copy of its mirror block).
+template <typename T, typename Op>
+void pairs_rect(T* x, std::ptrdiff_t ldx, T* y, std::ptrdiff_t ldy,
+                std::ptrdiff_t rows, std::ptrdiff_t cols, Op op)
+{
+    constexpr std::ptrdiff_t m = micro_tile;
+
+    for (std::ptrdiff_t i0 = 0; i0 < rows; i0 += tile_size) {
+        for (std::ptrdiff_t j0 = 0; j0 < cols; j0 += tile_size) {
+            const std::ptrdiff_t i1 = std::min(i0 + tile_size, rows);
+            const std::ptrdiff_t j1 = std::min(j0 + tile_size, cols);
+
+            for (std::ptrdiff_t i = i0; i < i1; i += m) {
+                for (std::ptrdiff_t j = j0; j < j1; j += m) {
+                    if (i + m <= i1 && j + m <= j1) {
+                        T lo[m][m];
+                        T up[m][m];
+                        for (std::ptrdiff_t r = 0; r < m; ++r) {
+                            for (std::ptrdiff_t c = 0; c < m; ++c) {
+                                lo[r][c] = x[(i + r)*ldx + j + c];
+                                up[r][c] = y[(j + r)*ldy + i + c];
+                            }
+                        }
+                        for (std::ptrdiff_t r = 0; r < m; ++r) {
+                            for (std::ptrdiff_t c = 0; c < m; ++c) {
+                                op(lo[r][c], up[c][r]);
+                            }
+                        }
+                        for (std::ptrdiff_t r = 0; r < m; ++r) {
+                            for (std::ptrdiff_t c = 0; c < m; ++c) {
+                                x[(i + r)*ldx + j + c] = lo[r][c];
+                                y[(j + r)*ldy + i + c] = up[r][c];
+                            }
+                        }
+                    } else {
+                        for (std::ptrdiff_t r = i; r < std::min(i + m, i1); ++r) {
+                            for (std::ptrdiff_t c = j; c < std::min(j + m, j1); ++c) {
+                                op(x[r*ldx + c], y[c*ldy + r]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Tile pairs (I,J) with J <= I, in row order of the lower triangle of tiles
+template <typename T, typename Op>
+void pairs_tiled(T* a, std::ptrdiff_t n, Op op, std::ptrdiff_t tile = tile_size)
+{
+    for (std::ptrdiff_t i = 0; i < n; i += tile) {
+        for (std::ptrdiff_t j = 0; j <= i; j += tile) {
+            pairs_block(a, n, i, std::min(i + tile, n), j, std::min(j + tile, n), op);
+        }
+    }
+}
+
+// Same as pairs_tiled(), with tile pairs distributed over the OpenMP threads. Tile pairs are
+// disjoint, so no synchronization is needed; diagonal tiles have half the work, hence the
+// dynamic schedule.
+template <typename T, typename Op>
+void pairs_tiled_parallel(T* a, std::ptrdiff_t n, Op op, std::ptrdiff_t tile = tile_size)
+{
+    const std::ptrdiff_t tiles = (n + tile - 1) / tile;
+    const std::ptrdiff_t pairs = tiles * (tiles + 1) / 2;
+
+#pragma omp parallel for schedule(dynamic)
+    for (std::ptrdiff_t p = 0; p < pairs; ++p) {
+        // Invert p = I*(I+1)/2 + J, with J <= I; the root is off by at most one in floating point
+        std::ptrdiff_t I = static_cast<std::ptrdiff_t>((std::sqrt(8.0 * p + 1) - 1) / 2);
+        if (I * (I + 1) / 2 > p) {
+            --I;
+        } else if ((I + 1) * (I + 2) / 2 <= p) {
+            ++I;
+        }
+        const std::ptrdiff_t J = p - I * (I + 1) / 2;
+        const std::ptrdiff_t i = I * tile;
+        const std::ptrdiff_t j = J * tile;
+
+        pairs_block(a, n, i, std::min(i + tile, n), j, std::min(j + tile, n), op);
+    }
+}
+
+// Cache-oblivious variant: the rectangle [i0,i1) x [j0,j1) below the diagonal is halved along
+// its longer side until it fits a tile, so that every level of the cache hierarchy is used
+// without tuning the tile size.
+template <typename T, typename Op>
+void pairs_recursive_rect(T* a, std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t i1,
+                          std::ptrdiff_t j0, std::ptrdiff_t j1, Op op)
+{
+    if (i1 - i0 <= tile_size && j1 - j0 <= tile_size) {
+        pairs_block(a, n, i0, i1, j0, j1, op);
+    } else if (i1 - i0 >= j1 - j0) {
+        const std::ptrdiff_t im = i0 + (i1 - i0) / 2;
+        pairs_recursive_rect(a, n, i0, im, j0, j1, op);
+        pairs_recursive_rect(a, n, im, i1, j0, j1, op);
+    } else {
+        const std::ptrdiff_t jm = j0 + (j1 - j0) / 2;
+        pairs_recursive_rect(a, n, i0, i1, j0, jm, op);
+        pairs_recursive_rect(a, n, i0, i1, jm, j1, op);
+    }
+}
+
+// Triangle [i0,i1)^2: two half-size triangles and the square between them
+template <typename T, typename Op>
+void pairs_recursive(T* a, std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t i1, Op op)
+{
+    if (i1 - i0 <= tile_size) {
+        pairs_block(a, n, i0, i1, i0, i1, op);
+        return;
+    }
+    const std::ptrdiff_t im = i0 + (i1 - i0) / 2;
+    pairs_recursive(a, n, i0, im, op);
+    pairs_recursive_rect(a, n, im, i1, i0, im, op);
+    pairs_recursive(a, n, im, i1, op);
+}
+
+} // namespace detail
+} // namespace asc::pad_ws20::project
+
+#endif // BLOCKED_H
@@ -0,0 +1,165 @@
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "blocked.h"
+
+
+namespace asc::pad_ws20::project
+{
+// Tiles of a rows x cols matrix (or of a block of a distributed matrix) which were written
+// since the last symmetrization, one flag per b x b tile (smaller at the edge). Symmetrizing
+// then only needs the tile pairs of which at least one tile is dirty.
+//
+// Marking is not synchronized: threads writing to the same tile must mark it only once.
+class DirtyTiles
+{
+public:
+    typedef std::ptrdiff_t index_t;
+
+    DirtyTiles(index_t rows, index_t cols, index_t b)
+        : _rows(rows), _cols(cols), _b(b),
+          _tr((rows + b - 1) / b), _tc((cols + b - 1) / b), _flags(_tr * _tc, 0)
+    {
+        assert(rows >= 1 && cols >= 1);
+        assert(b >= 1);
+    }
+
+    explicit DirtyTiles(index_t n, index_t b = detail::tile_size)
+        : DirtyTiles(n, n, b)
+    {}
+
+    // Element (i,j) was written
+    void mark(index_t i, index_t j) {
+        assert(i >= 0 && i < _rows);
+        assert(j >= 0 && j < _cols);
+        _flags[(i / _b)*_tc + j / _b] = 1;
+    }
+
+    // Elements [i0, i0+rows) x [j0, j0+cols) were written
+    void mark(index_t i0, index_t j0, index_t rows, index_t cols) {
+        assert(i0 >= 0 && rows >= 0 && i0 + rows <= _rows);
+        assert(j0 >= 0 && cols >= 0 && j0 + cols <= _cols);
+        if (rows == 0 || cols == 0) {
+            return;
+        }
+        for (index_t I = i0 / _b; I <= (i0 + rows - 1) / _b; ++I) {
+            for (index_t J = j0 / _b; J <= (j0 + cols - 1) / _b; ++J) {
+                _flags[I*_tc + J] = 1;
+            }
+        }
+    }
+
+    void mark_all() { std::fill(_flags.begin(), _flags.end(), 1); }
+    void clear() { std::fill(_flags.begin(), _flags.end(), 0); }
+
+    // Tile (I,J) was written
+    bool operator()(index_t I, index_t J) const {
+        assert(I >= 0 && I < _tr);
+        assert(J >= 0 && J < _tc);
+        return _flags[I*_tc + J] != 0;
+    }
+
+    // Tile pair (I,J), (J,I) of a square matrix needs symmetrization
+    bool pair(index_t I, index_t J) const {
+        return (*this)(I, J) || (*this)(J, I);
+    }
+
+    // Call f(I, J) for every tile pair with J <= I needing symmetrization, in row order
+    template <typename F>
+    void for_each_pair(F&& f) const {
+        assert(_rows == _cols);
+        for (index_t I = 0; I < _tr; ++I) {
+            for (index_t J = 0; J <= I; ++J) {
+                if (pair(I, J)) {
+                    f(I, J);
+                }
+            }
+        }
+    }
+
+    // The same tile pairs, as a list which can be split between threads
+    std::vector<std::pair<index_t, index_t>> pairs() const {
+        std::vector<std::pair<index_t, index_t>> p;
+        for_each_pair([&](index_t I, index_t J) { p.emplace_back(I, J); });
+        return p;
+    }
+
+    index_t count() const {
+        return std::count(_flags.begin(), _flags.end(), 1);
+    }
+
+    index_t rows() const noexcept { return _rows; }
+    index_t cols() const noexcept { return _cols; }
+    index_t tile_dim() const noexcept { return _b; }
+    index_t tile_rows() const noexcept { return _tr; }
+    index_t tile_cols() const noexcept { return _tc; }
+
+    // Flags in row-major order of tiles, e.g. for sending them to another rank
+    const std::vector<unsigned char>& flags() const noexcept { return _flags; }
+
+private:
+    index_t _rows;
+    index_t _cols;
+    index_t _b;
+    index_t _tr; // tiles per column
+    index_t _tc; // tiles per row
+    std::vector<unsigned char> _flags;
+};
+
+// Matrix whose writes are recorded in a DirtyTiles, so that symmetrize() only processes the
+// tiles written since the previous call. Reads go to the matrix directly; writes through the
+// matrix itself bypass the tracking and must be marked with dirty().mark().
+template <typename Matrix>
+class Tracked
+{
+public:
+    typedef typename Matrix::value_type value_type;
+    typedef std::ptrdiff_t index_t;
+
+    // The matrix is assumed to be symmetric at first; it must outlive the tracker.
+    explicit Tracked(Matrix& M, index_t b = detail::tile_size)
+        : _M(M), _dirty(M.n(), b)
+    {}
+
+    value_type operator()(index_t i, index_t j) const { return _M(i, j); }
+
+    void set(index_t i, index_t j, value_type v) {
+        _M(i, j) = v;
+        _dirty.mark(i, j);
+    }
+
+    // Write the block [i0, i0+rows) x [j0, j0+cols) from src, with row stride ld
+    void set(index_t i0, index_t j0, index_t rows, index_t cols, const value_type* src, index_t ld) {
+        for (index_t r = 0; r < rows; ++r) {
+            for (index_t c = 0; c < cols; ++c) {
+                _M(i0 + r, j0 + c) = src[r*ld + c];
+            }
+        }
+        _dirty.mark(i0, j0, rows, cols);
+    }
+
+    // Symmetrize the dirty tile pairs and clear the flags
+    void symmetrize() {
+        _M.symmetrize(_dirty);
+        _dirty.clear();
+    }
+
+    Matrix& matrix() noexcept { return _M; }
+    const Matrix& matrix() const noexcept { return _M; }
+    DirtyTiles& dirty() noexcept { return _dirty; }
+    const DirtyTiles& dirty() const noexcept { return _dirty; }
+
+private:
+    Matrix& _M;
+    DirtyTiles _dirty;
+};
+
+} // namespace asc::pad_ws20::project
+
+#endif // DIRTY_H
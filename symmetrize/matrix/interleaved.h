@@ -0,0 +1,245 @@
+#ifndef INTERLEAVED_H
+#define INTERLEAVED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "allocator.h"
+#include "blocked.h"
+#include "offsets.h"
+#include "trimatrix.h"
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Interleaved layout of the packed triangles: chunks of one cache line of the lower triangle
+// (col-major) alternate with the chunk of the upper triangle (row-major) at the same offsets,
+// so that a pair (a_ij, a_ji) is in adjacent cache lines, and a pass over all pairs reads and
+// writes a single stream instead of two. The last chunk is padded with zeros.
+template <typename T>
+constexpr std::ptrdiff_t interleave_width = static_cast<std::ptrdiff_t>(cache_line_size / sizeof(T));
+
+// Length of the interleaved array of t pairs
+template <typename T>
+constexpr std::ptrdiff_t interleaved_size(std::ptrdiff_t t) {
+    return 2 * padded<T>(t);
+}
+
+// Offset of element k of the lower triangle; its mirror is interleave_width<T> further
+template <typename T>
+constexpr std::ptrdiff_t interleaved_offset(std::ptrdiff_t k) {
+    constexpr std::ptrdiff_t W = interleave_width<T>;
+    return (k / W) * 2*W + k % W;
+}
+
+template <typename T>
+void interleave(const T* lower, const T* upper, std::ptrdiff_t t, T* pairs)
+{
+    constexpr std::ptrdiff_t W = interleave_width<T>;
+    const std::ptrdiff_t chunks = padded<T>(t) / W;
+
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t c = 0; c < chunks; ++c) {
+        T* p = pairs + c*2*W;
+        const std::ptrdiff_t k0 = c*W;
+        const std::ptrdiff_t m = std::min(W, t - k0);
+        std::copy(lower + k0, lower + k0 + m, p);
+        std::fill(p + m, p + W, T(0));
+        std::copy(upper + k0, upper + k0 + m, p + W);
+        std::fill(p + W + m, p + 2*W, T(0));
+    }
+}
+
+template <typename T>
+void deinterleave(const T* pairs, std::ptrdiff_t t, T* lower, T* upper)
+{
+    constexpr std::ptrdiff_t W = interleave_width<T>;
+    const std::ptrdiff_t chunks = padded<T>(t) / W;
+
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t c = 0; c < chunks; ++c) {
+        const T* p = pairs + c*2*W;
+        const std::ptrdiff_t k0 = c*W;
+        const std::ptrdiff_t m = std::min(W, t - k0);
+        std::copy(p, p + m, lower + k0);
+        std::copy(p + W, p + W + m, upper + k0);
+    }
+}
+
+// op(lower, upper) for all pairs of the interleaved array of t pairs. Padding is only ever
+// combined with padding.
+template <typename T, typename Op>
+void pairs_interleaved(T* pairs, std::ptrdiff_t t, Op op)
+{
+    constexpr std::ptrdiff_t W = interleave_width<T>;
+    const std::ptrdiff_t chunks = padded<T>(t) / W;
+
+    for (std::ptrdiff_t c = 0; c < chunks; ++c) {
+        T* p = pairs + c*2*W;
+        #pragma omp simd
+        for (std::ptrdiff_t l = 0; l < W; ++l) {
+            op(p[l], p[W + l]);
+        }
+    }
+}
+
+// Same, with the chunks split between the OpenMP threads
+template <typename T, typename Op>
+void pairs_interleaved_parallel(T* pairs, std::ptrdiff_t t, Op op)
+{
+    constexpr std::ptrdiff_t W = interleave_width<T>;
+    const std::ptrdiff_t chunks = padded<T>(t) / W;
+
+    #pragma omp parallel for schedule(static)
+    for (std::ptrdiff_t c = 0; c < chunks; ++c) {
+        T* p = pairs + c*2*W;
+        #pragma omp simd
+        for (std::ptrdiff_t l = 0; l < W; ++l) {
+            op(p[l], p[W + l]);
+        }
+    }
+}
+
+} // namespace detail
+
+// Square matrix as in TriMatrix, with the triangles in the interleaved layout above instead of
+// two arrays. Transposition swaps the roles of both halves of every chunk with a flag, as
+// TriMatrix swaps its pointers, so it is O(1) and symmetrize() does not depend on it.
+template <typename T, typename Alloc = aligned_allocator<T>>
+class InterleavedTriMatrix
+{
+    static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
+
+public:
+    typedef T value_type;
+    typedef Alloc allocator_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::ptrdiff_t index_t;
+
+    InterleavedTriMatrix(index_t n, const Alloc& alloc = Alloc())
+        : _n(n), _t(n*(n-1) / 2), _alloc(alloc)
+    {
+        assert(n >= 1);
+        assert(n == 1 || n < std::numeric_limits<index_t>::max() / (n - 1));
+        _diag = _alloc.allocate(buffer_size());
+        _pairs = _diag + detail::padded<T>(_n);
+        std::fill(_diag, _diag + buffer_size(), T(0));
+    }
+
+    InterleavedTriMatrix(T* row_major, index_t length, const Alloc& alloc = Alloc())
+        : InterleavedTriMatrix(TriMatrix<T>(row_major, length), alloc)
+    {}
+
+    template <typename TriAlloc>
+    explicit InterleavedTriMatrix(const TriMatrix<T, TriAlloc>& packed, const Alloc& alloc = Alloc())
+        : InterleavedTriMatrix(packed.n(), alloc)
+    {
+        std::copy(packed.diag(), packed.diag() + _n, _diag);
+        detail::interleave(packed.lower(), packed.upper(), _t, _pairs);
+    }
+
+    InterleavedTriMatrix(const InterleavedTriMatrix&) = delete;
+    InterleavedTriMatrix& operator=(const InterleavedTriMatrix&) = delete;
+
+    InterleavedTriMatrix(InterleavedTriMatrix&& other) noexcept
+        : _n(other._n), _t(other._t), _alloc(std::move(other._alloc)), _transposed(other._transposed),
+          _diag(std::exchange(other._diag, nullptr)), _pairs(std::exchange(other._pairs, nullptr))
+    {}
+
+    InterleavedTriMatrix& operator=(InterleavedTriMatrix&& other) noexcept {
+        if (this != &other) {
+            if (_diag != nullptr) {
+                _alloc.deallocate(_diag, buffer_size());
+            }
+            _n = other._n;
+            _t = other._t;
+            _alloc = std::move(other._alloc);
+            _transposed = other._transposed;
+            _diag = std::exchange(other._diag, nullptr);
+            _pairs = std::exchange(other._pairs, nullptr);
+        }
+        return *this;
+    }
+
+    ~InterleavedTriMatrix() {
+        if (_diag != nullptr) {
+            _alloc.deallocate(_diag, buffer_size());
+        }
+    }
+
+    T operator()(index_t i, index_t j) const {
+        return const_cast<InterleavedTriMatrix&>(*this)(i, j);
+    }
+
+    T& operator()(index_t i, index_t j) {
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+
+        if (i == j) {
+            return _diag[i];
+        }
+        // a_ij and a_ji have the same offset k in their triangles
+        const index_t k = i > j ? detail::offset_lower_col_major(i, j, _n)
+                                : detail::offset_upper_row_major(i, j, _n);
+        const bool first = (i > j) != _transposed;
+        return _pairs[detail::interleaved_offset<T>(k) + (first ? 0 : detail::interleave_width<T>)];
+    }
+
+    void transpose() {
+        _transposed = !_transposed;
+    }
+
+    void symmetrize() {
+        detail::pairs_interleaved(_pairs, _t, detail::average_op());
+    }
+
+    void symmetrize_parallel() {
+        detail::pairs_interleaved_parallel(_pairs, _t, detail::average_op());
+    }
+
+    // Write all elements to the packed triangles of a TriMatrix of the same dimension
+    template <typename TriAlloc>
+    void unpack(TriMatrix<T, TriAlloc>& packed) const {
+        assert(packed.n() == _n);
+        std::copy(_diag, _diag + _n, packed.diag());
+        if (_transposed) {
+            detail::deinterleave(_pairs, _t, packed.upper(), packed.lower());
+        } else {
+            detail::deinterleave(_pairs, _t, packed.lower(), packed.upper());
+        }
+    }
+
+    index_t n() const noexcept { return _n; }
+    index_t t() const noexcept { return _t; }
+    bool transposed() const noexcept { return _transposed; }
+    T* diag() { return _diag; }
+    const T* diag() const { return _diag; }
+    // Interleaved array of detail::interleaved_size<T>(t()) elements; with transposed(), the
+    // first half of every chunk holds the upper triangle
+    T* pairs() { return _pairs; }
+    const T* pairs() const { return _pairs; }
+    allocator_type get_allocator() const { return _alloc; }
+
+private:
+    index_t buffer_size() const noexcept {
+        return detail::padded<T>(_n) + detail::interleaved_size<T>(_t);
+    }
+
+    index_t _n;
+    index_t _t;
+    Alloc _alloc;
+    bool _transposed = false;
+    T* _diag = nullptr;
+    T* _pairs = nullptr;
+};
+
+} // namespace asc::pad_ws20::project
+
+#endif // INTERLEAVED_H
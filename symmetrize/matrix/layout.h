@@ -0,0 +1,366 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "offsets.h"
+
+
+namespace asc::pad_ws20::project
+{
+// Distributions of an n x n matrix over P ranks, and the layout of the local part on each rank:
+// - row_block: rows [p*b, (p+1)*b), b = ceil(n/P), row-major;
+// - col_block: columns [p*b, (p+1)*b), column-major;
+// - block_cyclic: mb x nb blocks dealt cyclically over a pr x pc grid (rank = prow*pc + pcol),
+//   column-major with the number of local rows as leading dimension, as in ScaLAPACK;
+// - packed: diagonal, lower triangle (col-major) and upper triangle (row-major) as in TriMatrix,
+//   each split into contiguous chunks of ceil(len/P) elements; the local part is the diagonal
+//   chunk followed by the lower and upper chunk. This is the layout of symmetrize-upcxx.
+enum class dist_kind { row_block, col_block, block_cyclic, packed };
+
+struct distribution
+{
+    typedef std::ptrdiff_t index_t;
+
+    dist_kind kind;
+    index_t n;
+    int P;
+    int pr = 1, pc = 1;     // process grid (block_cyclic)
+    index_t mb = 1, nb = 1; // block size (block_cyclic)
+
+    static distribution row_block(index_t n, int P) {
+        return {dist_kind::row_block, n, P};
+    }
+    static distribution col_block(index_t n, int P) {
+        return {dist_kind::col_block, n, P};
+    }
+    static distribution block_cyclic(index_t n, int pr, int pc, index_t mb, index_t nb) {
+        return {dist_kind::block_cyclic, n, pr * pc, pr, pc, mb, nb};
+    }
+    static distribution packed(index_t n, int P) {
+        return {dist_kind::packed, n, P};
+    }
+
+    index_t t() const noexcept { return n*(n-1) / 2; }
+
+    // Rank owning element (i,j)
+    int owner(index_t i, index_t j) const {
+        switch (kind) {
+        case dist_kind::row_block:
+            return static_cast<int>(i / chunk(n));
+        case dist_kind::col_block:
+            return static_cast<int>(j / chunk(n));
+        case dist_kind::block_cyclic:
+            return static_cast<int>((i / mb) % pr) * pc + static_cast<int>((j / nb) % pc);
+        case dist_kind::packed:
+        default:
+            if (i == j) {
+                return static_cast<int>(i / chunk(n));
+            } else if (i > j) {
+                return static_cast<int>(detail::offset_lower_col_major(i, j, n) / chunk(t()));
+            } else {
+                return static_cast<int>(detail::offset_upper_row_major(i, j, n) / chunk(t()));
+            }
+        }
+    }
+
+    // Offset of element (i,j) in the local part of its owner
+    index_t local_offset(index_t i, index_t j) const {
+        switch (kind) {
+        case dist_kind::row_block:
+            return (i % chunk(n)) * n + j;
+        case dist_kind::col_block:
+            return (j % chunk(n)) * n + i;
+        case dist_kind::block_cyclic: {
+            const index_t li = (i / (mb * pr)) * mb + i % mb;
+            const index_t lj = (j / (nb * pc)) * nb + j % nb;
+            return lj * local_rows(owner(i, j) / pc) + li;
+        }
+        case dist_kind::packed:
+        default: {
+            const int p = owner(i, j);
+            if (i == j) {
+                return i - p * chunk(n);
+            } else if (i > j) {
+                return diag_size(p) + detail::offset_lower_col_major(i, j, n) - p * chunk(t());
+            } else {
+                return diag_size(p) + tri_size(p) + detail::offset_upper_row_major(i, j, n) - p * chunk(t());
+            }
+        }
+        }
+    }
+
+    // Number of elements owned by rank p
+    index_t local_size(int p) const {
+        switch (kind) {
+        case dist_kind::row_block:
+        case dist_kind::col_block:
+            return (range(n, p).second - range(n, p).first) * n;
+        case dist_kind::block_cyclic:
+            return p < pr * pc ? local_rows(p / pc) * local_cols(p % pc) : 0;
+        case dist_kind::packed:
+        default:
+            return diag_size(p) + 2 * tri_size(p);
+        }
+    }
+
+    // Call f(j0, j1) for every run of columns [j0, j1) of row i owned by rank p, in ascending order
+    template <typename F>
+    void for_each_run(int p, index_t i, F&& f) const {
+        switch (kind) {
+        case dist_kind::row_block:
+            if (i / chunk(n) == p) {
+                f(index_t(0), n);
+            }
+            break;
+        case dist_kind::col_block: {
+            auto [c0, c1] = range(n, p);
+            if (c0 < c1) {
+                f(c0, c1);
+            }
+            break;
+        }
+        case dist_kind::block_cyclic:
+            if (p < pr * pc && (i / mb) % pr == p / pc) {
+                for (index_t j0 = (p % pc) * nb; j0 < n; j0 += nb * pc) {
+                    f(j0, std::min(j0 + nb, n));
+                }
+            }
+            break;
+        case dist_kind::packed:
+        default: {
+            auto [k0, k1] = range(t(), p);
+            const index_t l0 = lower_column(i, k0), l1 = lower_column(i, k1);
+            if (l0 < l1) {
+                f(l0, l1);
+            }
+            if (i / chunk(n) == p) {
+                f(i, i + 1);
+            }
+            // Upper triangle: row i is contiguous
+            if (i + 1 < n) {
+                const index_t base = detail::offset_upper_row_major(i, i + 1, n) - (i + 1);
+                const index_t u0 = std::max(i + 1, k0 - base), u1 = std::min(n, k1 - base);
+                if (u0 < u1) {
+                    f(u0, u1);
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    // Call f(j0, j1, q) for every maximal run of columns [j0, j1) within [a, b) of row i owned by
+    // the same rank q, in ascending order
+    template <typename F>
+    void for_each_owner_run(index_t i, index_t a, index_t b, F&& f) const {
+        for (index_t j = a; j < b; ) {
+            const index_t e = std::min(b, run_end(i, j));
+            f(j, e, owner(i, j));
+            j = e;
+        }
+    }
+
+    // Offset of element (i,j+1) in the local part of its owner, given the offset of (i,j) in the
+    // same run
+    index_t next_offset(index_t offset, index_t i, index_t j) const noexcept {
+        switch (kind) {
+        case dist_kind::row_block:
+            return offset + 1;
+        case dist_kind::col_block:
+            return offset + n;
+        case dist_kind::block_cyclic:
+            return offset + local_rows((i / mb) % pr);
+        case dist_kind::packed:
+        default:
+            return j < i ? offset + (n - 2 - j) : offset + 1;
+        }
+    }
+
+    // Call f(i, j) for every element owned by rank p, in row-major order
+    template <typename F>
+    void for_each_owned(int p, F&& f) const {
+        for (index_t i = 0; i < n; ++i) {
+            for_each_run(p, i, [&](index_t j0, index_t j1) {
+                for (index_t j = j0; j < j1; ++j) {
+                    f(i, j);
+                }
+            });
+        }
+    }
+
+    // Sizes of the diagonal and triangle chunk of rank p (packed)
+    index_t diag_size(int p) const noexcept {
+        return range(n, p).second - range(n, p).first;
+    }
+    index_t tri_size(int p) const noexcept {
+        return range(t(), p).second - range(t(), p).first;
+    }
+
+    // Length of the contiguous chunk per rank of an array of length len
+    index_t chunk(index_t len) const noexcept {
+        return std::max(index_t(1), (len + P - 1) / P);
+    }
+
+    // Chunk [begin, end) of rank p of an array of length len: the rows of row_block, the
+    // columns of col_block, and the diagonal (len = n) and triangles (len = t()) of packed
+    std::pair<index_t, index_t> range(index_t len, int p) const noexcept {
+        const index_t c = chunk(len);
+        return {std::min(len, p * c), std::min(len, (p + 1) * c)};
+    }
+
+private:
+
+    // End of the run of columns of row i, with the same owner, which contains column j
+    index_t run_end(index_t i, index_t j) const {
+        switch (kind) {
+        case dist_kind::row_block:
+            return n;
+        case dist_kind::col_block:
+            return (j / chunk(n) + 1) * chunk(n);
+        case dist_kind::block_cyclic:
+            return (j / nb + 1) * nb;
+        case dist_kind::packed:
+        default: {
+            const index_t c = chunk(t());
+            if (j < i) {
+                const index_t k = detail::offset_lower_col_major(i, j, n);
+                return lower_column(i, (k / c + 1) * c);
+            } else if (j == i) {
+                return i + 1;
+            } else {
+                const index_t base = detail::offset_upper_row_major(i, i + 1, n) - (i + 1);
+                return ((base + j) / c + 1) * c - base;
+            }
+        }
+        }
+    }
+
+    // First column j <= i of row i with an offset of at least k in the lower triangle. Offsets of
+    // a row increase with j, so the columns within a chunk of the lower triangle are an interval.
+    index_t lower_column(index_t i, index_t k) const noexcept {
+        index_t lo = 0, hi = i;
+        while (lo < hi) {
+            index_t mid = (lo + hi) / 2;
+            if (detail::offset_lower_col_major(i, mid, n) < k) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // Number of rows (columns) owned by process row (column) q of the grid, as ScaLAPACK numroc
+    index_t local_rows(int q) const noexcept { return numroc(mb, q, pr); }
+    index_t local_cols(int q) const noexcept { return numroc(nb, q, pc); }
+
+    index_t numroc(index_t block, int q, int procs) const noexcept {
+        const index_t full_blocks = n / block;
+        index_t count = full_blocks / procs * block;
+        if (q < full_blocks % procs) {
+            count += block;
+        } else if (q == full_blocks % procs) {
+            count += n % block;
+        }
+        return count;
+    }
+};
+
+// Redistribution of a matrix from one distribution to another, in an all-to-all exchange: rank
+// p sends all elements owned by q in the target distribution as one contiguous message. Within
+// a message, elements are in row-major order, so that sender and receiver agree on the order
+// without exchanging indices.
+namespace detail
+{
+typedef std::ptrdiff_t index_t;
+
+// Call f(i, j0, j1, q) for every run of columns [j0, j1) of row i owned by rank p in
+// distribution `mine` and by rank q in distribution `other`, in row-major order
+template <typename F>
+void for_each_segment(const distribution& mine, int p, const distribution& other, F&& f)
+{
+    for (index_t i = 0; i < mine.n; ++i) {
+        mine.for_each_run(p, i, [&](index_t a, index_t b) {
+            other.for_each_owner_run(i, a, b, [&](index_t j0, index_t j1, int q) {
+                f(i, j0, j1, q);
+            });
+        });
+    }
+}
+
+// Number of elements of rank p in distribution `from` which are owned by each rank in `to`
+inline std::vector<index_t>
+send_counts(const distribution& from, const distribution& to, int p)
+{
+    std::vector<index_t> counts(to.P, 0);
+    for_each_segment(from, p, to, [&](index_t, index_t j0, index_t j1, int q) {
+        counts[q] += j1 - j0;
+    });
+    return counts;
+}
+
+// Number of elements of rank p in distribution `to` which are owned by each rank in `from`
+inline std::vector<index_t>
+recv_counts(const distribution& from, const distribution& to, int p)
+{
+    std::vector<index_t> counts(from.P, 0);
+    for_each_segment(to, p, from, [&](index_t, index_t j0, index_t j1, int q) {
+        counts[q] += j1 - j0;
+    });
+    return counts;
+}
+
+// Exclusive prefix sum, with the total as last element
+inline std::vector<index_t>
+displacements(const std::vector<index_t>& counts)
+{
+    std::vector<index_t> displs(counts.size() + 1, 0);
+    for (std::size_t q = 0; q < counts.size(); ++q) {
+        displs[q + 1] = displs[q] + counts[q];
+    }
+    return displs;
+}
+
+// Pack the local part `src` of rank p into `buf`, the message to rank q starting at displs[q]
+template <typename T>
+void pack_messages(const T* src, const distribution& from, const distribution& to, int p,
+                   const std::vector<index_t>& displs, T* buf)
+{
+    std::vector<index_t> pos(displs.begin(), displs.end() - 1);
+    for_each_segment(from, p, to, [&](index_t i, index_t j0, index_t j1, int q) {
+        T* msg = buf + pos[q];
+        index_t offset = from.local_offset(i, j0);
+        for (index_t j = j0; j < j1; ++j) {
+            *msg++ = src[offset];
+            offset = from.next_offset(offset, i, j);
+        }
+        pos[q] += j1 - j0;
+    });
+}
+
+// Unpack the messages received by rank p, the one from rank q starting at displs[q], into the
+// local part `dst`
+template <typename T>
+void unpack_messages(const T* buf, const std::vector<index_t>& displs,
+                     const distribution& from, const distribution& to, int p, T* dst)
+{
+    std::vector<index_t> pos(displs.begin(), displs.end() - 1);
+    for_each_segment(to, p, from, [&](index_t i, index_t j0, index_t j1, int q) {
+        const T* msg = buf + pos[q];
+        index_t offset = to.local_offset(i, j0);
+        for (index_t j = j0; j < j1; ++j) {
+            dst[offset] = *msg++;
+            offset = to.next_offset(offset, i, j);
+        }
+        pos[q] += j1 - j0;
+    });
+}
+
+} // namespace detail
+} // namespace asc::pad_ws20::project
+
+#endif // LAYOUT_H
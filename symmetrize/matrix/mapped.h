@@ -0,0 +1,240 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix.h"
+#include "trimatrix.h"
+
+
+namespace asc::pad_ws20::project
+{
+// Binary file format of a dense or packed n x n matrix, which is mapped into memory instead of
+// read: a header, followed by the elements of a SquareMatrix (row-major), or the diagonal,
+// lower triangle (col-major) and upper triangle (row-major) of a TriMatrix. Every array starts
+// on a page. Elements are stored in the byte order of the machine.
+//
+// The views of a mapped file share the memory with the page cache, so a matrix larger than the
+// main memory can be symmetrized in place, without a load step: pages are read on first access
+// and written back by the kernel (or by sync()).
+enum class file_dtype : std::uint32_t { float32 = 1, float64 = 2 };
+enum class file_layout : std::uint32_t { dense = 1, packed = 2 };
+
+struct matrix_file_header {
+    char magic[8];
+    std::uint32_t dtype;  // file_dtype
+    std::uint32_t layout; // file_layout
+    std::int64_t n;
+    std::int64_t offset[3]; // in bytes, of the elements (dense) or diagonal, lower, upper (packed)
+};
+
+namespace detail
+{
+constexpr char matrix_file_magic[8] = {'S', 'Y', 'M', 'M', 'A', 'T', '0', '1'};
+constexpr std::int64_t matrix_file_align = 4096;
+
+inline std::int64_t align_file_offset(std::int64_t offset) {
+    return (offset + matrix_file_align - 1) / matrix_file_align * matrix_file_align;
+}
+
+inline std::int64_t dtype_size(file_dtype dtype) {
+    return dtype == file_dtype::float32 ? 4 : 8;
+}
+
+// Header of an n x n matrix; returns the file size in bytes
+inline std::int64_t make_header(matrix_file_header& h, std::int64_t n, file_dtype dtype, file_layout layout) {
+    std::memcpy(h.magic, matrix_file_magic, sizeof(h.magic));
+    h.dtype = static_cast<std::uint32_t>(dtype);
+    h.layout = static_cast<std::uint32_t>(layout);
+    h.n = n;
+
+    const std::int64_t s = dtype_size(dtype);
+    const std::int64_t begin = align_file_offset(sizeof(matrix_file_header));
+    if (layout == file_layout::dense) {
+        h.offset[0] = begin;
+        h.offset[1] = h.offset[2] = 0;
+        return begin + n*n * s;
+    }
+    const std::int64_t t = n*(n-1) / 2;
+    h.offset[0] = begin;
+    h.offset[1] = align_file_offset(h.offset[0] + n * s);
+    h.offset[2] = align_file_offset(h.offset[1] + t * s);
+    return h.offset[2] + t * s;
+}
+
+} // namespace detail
+
+template <typename T>
+constexpr file_dtype dtype_of() {
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>);
+    return std::is_same_v<T, float> ? file_dtype::float32 : file_dtype::float64;
+}
+
+// Matrix file mapped into memory, shared with other processes mapping the same file. Opening
+// or creating a file fails (std::nullopt) if it cannot be mapped or has no valid header.
+class MatrixFile
+{
+public:
+    typedef std::ptrdiff_t index_t;
+
+    static std::optional<MatrixFile> open(const std::string& path, bool writable = true) {
+        const int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(matrix_file_header))) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        auto file = map(fd, st.st_size, writable);
+        if (file && !file->valid()) {
+            return std::nullopt;
+        }
+        return file;
+    }
+
+    // New file of an n x n matrix, with all elements zero; the file is sparse until written
+    static std::optional<MatrixFile> create(const std::string& path, index_t n, file_dtype dtype,
+                                            file_layout layout) {
+        assert(n >= 1);
+        matrix_file_header h;
+        const std::int64_t size = detail::make_header(h, n, dtype, layout);
+
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        if (ftruncate(fd, size) != 0 || pwrite(fd, &h, sizeof(h), 0) != sizeof(h)) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return map(fd, size, true);
+    }
+
+    MatrixFile(const MatrixFile&) = delete;
+    MatrixFile& operator=(const MatrixFile&) = delete;
+
+    MatrixFile(MatrixFile&& other) noexcept
+        : _base(std::exchange(other._base, nullptr)), _size(std::exchange(other._size, 0))
+    {}
+
+    MatrixFile& operator=(MatrixFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            _base = std::exchange(other._base, nullptr);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    ~MatrixFile() { unmap(); }
+
+    const matrix_file_header& header() const {
+        return *static_cast<const matrix_file_header*>(_base);
+    }
+
+    index_t n() const { return header().n; }
+    file_dtype dtype() const { return static_cast<file_dtype>(header().dtype); }
+    file_layout layout() const { return static_cast<file_layout>(header().layout); }
+
+    // Views of the elements, which must not outlive the file. Writing through a view of a file
+    // opened read-only is undefined.
+    template <typename T>
+    SquareMatrixView<T> square() const {
+        assert(dtype() == dtype_of<T>() && layout() == file_layout::dense);
+        return SquareMatrixView<T>(adopt_arrays, array<T>(0), n());
+    }
+
+    template <typename T>
+    TriMatrixView<T> packed() const {
+        assert(dtype() == dtype_of<T>() && layout() == file_layout::packed);
+        return TriMatrixView<T>(adopt_arrays, array<T>(0), array<T>(1), array<T>(2), n());
+    }
+
+    // Write modified pages back to the file; returns false on failure
+    bool sync() {
+        return msync(_base, _size, MS_SYNC) == 0;
+    }
+
+private:
+    MatrixFile(void* base, std::size_t size) : _base(base), _size(size) {}
+
+    static std::optional<MatrixFile> map(int fd, std::size_t size, bool writable) {
+        void* base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file open
+        if (base == MAP_FAILED) {
+            return std::nullopt;
+        }
+        return MatrixFile(base, size);
+    }
+
+    // Header matches the size of the file
+    bool valid() const {
+        const matrix_file_header& h = header();
+        if (std::memcmp(h.magic, detail::matrix_file_magic, sizeof(h.magic)) != 0 ||
+            h.n < 1 || h.n >= (std::int64_t(1) << 31) ||
+            (h.dtype != 1 && h.dtype != 2) || (h.layout != 1 && h.layout != 2)) {
+            return false;
+        }
+        matrix_file_header expected;
+        const std::int64_t size = detail::make_header(expected, h.n, dtype(), layout());
+        return size == static_cast<std::int64_t>(_size) &&
+               std::equal(h.offset, h.offset + 3, expected.offset);
+    }
+
+    template <typename T>
+    T* array(int k) const {
+        return reinterpret_cast<T*>(static_cast<char*>(_base) + header().offset[k]);
+    }
+
+    void unmap() {
+        if (_base != nullptr) {
+            munmap(_base, _size);
+        }
+    }
+
+    void* _base = nullptr;
+    std::size_t _size = 0;
+};
+
+// Write a matrix to a new file; returns false on failure
+template <typename T, typename Alloc>
+bool save_matrix_file(const std::string& path, const SquareMatrix<T, Alloc>& M) {
+    auto file = MatrixFile::create(path, M.n(), dtype_of<T>(), file_layout::dense);
+    if (!file) {
+        return false;
+    }
+    std::copy(M.elements(), M.elements() + M.n()*M.n(), file->template square<T>().elements());
+    return file->sync();
+}
+
+template <typename T, typename Alloc>
+bool save_matrix_file(const std::string& path, const TriMatrix<T, Alloc>& M) {
+    auto file = MatrixFile::create(path, M.n(), dtype_of<T>(), file_layout::packed);
+    if (!file) {
+        return false;
+    }
+    auto view = file->template packed<T>();
+    std::copy(M.diag(), M.diag() + M.n(), view.diag());
+    std::copy(M.lower(), M.lower() + M.t(), view.lower());
+    std::copy(M.upper(), M.upper() + M.t(), view.upper());
+    return file->sync();
+}
+
+} // namespace asc::pad_ws20::project
+
+#endif // MAPPED_H
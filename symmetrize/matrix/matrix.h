@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <cassert>
+#include <cmath>
 #include <memory>
 #include <limits>
 #include <type_traits>
@@ -10,62 +11,110 @@
 #include <iostream>
 #include <utility>
 
+#include "allocator.h"
+#include "blocked.h"
+#include "dirty.h"
+#include "trimatrix.h"
+
 
 namespace asc::pad_ws20::project
 {
-template <typename T>
+template <typename T, typename Alloc = aligned_allocator<T>>
 class SquareMatrix
 {
 public:
     static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
     typedef T value_type;
+    typedef Alloc allocator_type;
     typedef std::ptrdiff_t difference_type;
     typedef std::ptrdiff_t index_t;
 
-    SquareMatrix(index_t n)
-        : _n(n), _s(n*n)
+    SquareMatrix(index_t n, const Alloc& alloc = Alloc())
+        : _n(n), _s(n*n), _alloc(alloc)
     {
         assert(_n >= 1);
         assert(_n < std::numeric_limits<index_t>::max() / _n); // overflow check
-        _elements = std::unique_ptr<T>(new T[_s]);
+        _elements = _alloc.allocate(_s);
     }
 
-    SquareMatrix(T* row_major, index_t length) {
+    SquareMatrix(T* row_major, index_t length, const Alloc& alloc = Alloc())
+        : _alloc(alloc)
+    {
         assert(length >= 1);
         _n = static_cast<index_t>(std::sqrt(length));
 
         assert(length == _n*_n);
         _s = length;
-        _elements = std::unique_ptr<T>(new T[_s]);
+        _elements = _alloc.allocate(_s);
 
-        T* _e = _elements.get();
+        T* _e = _elements;
         for (index_t k = 0; k < length; ++k) {
             _e[k] = row_major[k];
         }
     }
 
+    // Take ownership of n*n elements in row-major order, obtained from alloc, without copying
+    SquareMatrix(adopt_arrays_t, T* elements, index_t n, const Alloc& alloc = Alloc())
+        : _n(n), _s(n*n), _alloc(alloc), _elements(elements)
+    {
+        assert(_n >= 1);
+        assert(_elements != nullptr);
+    }
+
+    // Unpack the triangles of a TriMatrix (see packing.h)
+    template <typename TriAlloc>
+    explicit SquareMatrix(const TriMatrix<T, TriAlloc>& packed, const Alloc& alloc = Alloc())
+        : SquareMatrix(packed.n(), alloc)
+    {
+        packed.unpack(_elements);
+    }
+
     SquareMatrix(const SquareMatrix&) = delete;
     SquareMatrix& operator=(const SquareMatrix&) = delete;
-    SquareMatrix(SquareMatrix&&) = default;
-    SquareMatrix& operator=(SquareMatrix&&) = default;
-    ~SquareMatrix() = default;
+
+    SquareMatrix(SquareMatrix&& other) noexcept
+        : _n(other._n), _s(other._s), _alloc(std::move(other._alloc)),
+          _elements(std::exchange(other._elements, nullptr))
+    {}
+
+    SquareMatrix& operator=(SquareMatrix&& other) noexcept {
+        if (this != &other) {
+            if (_elements != nullptr) {
+                _alloc.deallocate(_elements, _s);
+            }
+            _n = other._n;
+            _s = other._s;
+            _alloc = std::move(other._alloc);
+            _elements = std::exchange(other._elements, nullptr);
+        }
+        return *this;
+    }
+
+    ~SquareMatrix() {
+        if (_elements != nullptr) {
+            _alloc.deallocate(_elements, _s);
+        }
+    }
 
     T operator()(index_t i, index_t j) const {
         assert(i >= 0 && i < _n);
         assert(j >= 0 && j < _n);
 
-        return _elements.get()[_n*i + j];
+        return _elements[_n*i + j];
     }
 
     T& operator()(index_t i, index_t j) {
         assert(i >= 0 && i < _n);
         assert(j >= 0 && j < _n);
 
-        return _elements.get()[_n*i + j];
+        return _elements[_n*i + j];
     }
 
-    void transpose() {
-        T* elems = _elements.get();
+    // Element-wise traversal of the lower triangle, reading the upper triangle with stride n.
+    // Kept as reference for the blocked variants below.
+    void transpose_naive() {
+        T* elems = _elements;
 
         for (index_t i = 0; i < _n ; ++i) {
             // Iterate across lower triangle
@@ -79,8 +128,8 @@ public:
         }
     }
 
-    void symmetrize() {
-        T* elems = _elements.get();
+    void symmetrize_naive() {
+        T* elems = _elements;
 
         for (index_t i = 0; i < _n; ++i) {
             // Iterate across lower triangle
@@ -95,17 +144,67 @@ public:
         }
     }
 
+    // Cache-blocked over pairs of tiles (see blocked.h)
+    void transpose() {
+        detail::pairs_tiled(_elements, _n, detail::swap_op());
+    }
+
+    void symmetrize() {
+        detail::pairs_tiled(_elements, _n, detail::average_op());
+    }
+
+    // Cache-blocked, with tile pairs distributed over OpenMP threads
+    void transpose_parallel() {
+        detail::pairs_tiled_parallel(_elements, _n, detail::swap_op());
+    }
+
+    void symmetrize_parallel() {
+        detail::pairs_tiled_parallel(_elements, _n, detail::average_op());
+    }
+
+    // Only the tile pairs of which a tile is marked in dirty, e.g. after small updates of a
+    // symmetric matrix; tile pairs are distributed over the OpenMP threads.
+    void symmetrize(const DirtyTiles& dirty) {
+        assert(dirty.rows() == _n && dirty.cols() == _n);
+        const auto pairs = dirty.pairs();
+        const index_t b = dirty.tile_dim();
+
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t k = 0; k < pairs.size(); ++k) {
+            const index_t i = pairs[k].first * b;
+            const index_t j = pairs[k].second * b;
+            detail::pairs_block(_elements, _n, i, std::min(i + b, _n), j, std::min(j + b, _n),
+                                detail::average_op());
+        }
+    }
+
+    // Cache-oblivious, by recursive halving of the lower triangle
+    void transpose_recursive() {
+        detail::pairs_recursive(_elements, _n, 0, _n, detail::swap_op());
+    }
+
+    void symmetrize_recursive() {
+        detail::pairs_recursive(_elements, _n, 0, _n, detail::average_op());
+    }
+
     index_t n() const noexcept { return _n; }
     index_t t() const noexcept { return _n*(_n - 1) / 2; }
     index_t s() const noexcept { return _s; }
-    T* elements() { return _elements.get(); }
+    T* elements() { return _elements; }
+    const T* elements() const { return _elements; }
+    allocator_type get_allocator() const { return _alloc; }
 
 private:
     index_t _n;
     index_t _s;
-    std::unique_ptr<T> _elements; // row-major order
+    Alloc _alloc;
+    T* _elements = nullptr; // row-major order
 };
 
+// SquareMatrix over elements owned by someone else, e.g. a mapped file
+template <typename T>
+using SquareMatrixView = SquareMatrix<T, non_owning_allocator<T>>;
+
 } // namespace asc::pad_ws20::upcxx
 
 #endif // MATRIX_H
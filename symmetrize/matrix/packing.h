@@ -0,0 +1,154 @@
+#ifndef PACKING_H
+#define PACKING_H
+
+#include <algorithm>
+#include <cstddef>
+
+#include "blocked.h"
+#include "offsets.h"
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Conversion between a dense row-major n x n matrix and the packed triangles of TriMatrix
+// (diagonal; lower triangle in col-major order; upper triangle in row-major order).
+//
+// Rows of the upper triangle are contiguous in both layouts and are copied row by row. Columns
+// of the lower triangle are contiguous in the packed layout only, so the lower triangle is
+// traversed in tiles as in blocked.h: each 8x8 micro tile is read with unit stride on one side,
+// transposed in a local array, and written with unit stride on the other side. Offsets are
+// computed once per column instead of once per element.
+
+// Lower triangle of rows [i0,i1) and columns [j0,j1), j < i: row-major a -> packed lower
+template <typename T>
+void pack_lower_block(const T* a, std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t i1,
+                      std::ptrdiff_t j0, std::ptrdiff_t j1, T* lower)
+{
+    constexpr std::ptrdiff_t m = micro_tile;
+
+    for (std::ptrdiff_t i = i0; i < i1; i += m) {
+        for (std::ptrdiff_t j = j0; j < std::min(j1, i + m); j += m) {
+            if (i + m <= i1 && j + m <= j1 && j + m <= i) {
+                T loc[m][m];
+                for (std::ptrdiff_t r = 0; r < m; ++r) {
+                    for (std::ptrdiff_t c = 0; c < m; ++c) {
+                        loc[c][r] = a[(i + r)*n + j + c];
+                    }
+                }
+                for (std::ptrdiff_t c = 0; c < m; ++c) {
+                    T* col = lower + offset_lower_col_major(i, j + c, n);
+                    for (std::ptrdiff_t r = 0; r < m; ++r) {
+                        col[r] = loc[c][r];
+                    }
+                }
+            } else {
+                for (std::ptrdiff_t c = j; c < std::min({j + m, j1, i + m - 1}); ++c) {
+                    const std::ptrdiff_t r0 = std::max(i, c + 1);
+                    T* col = lower + offset_lower_col_major(r0, c, n);
+                    for (std::ptrdiff_t r = r0; r < std::min(i + m, i1); ++r) {
+                        col[r - r0] = a[r*n + c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Inverse of pack_lower_block(): packed lower -> row-major a
+template <typename T>
+void unpack_lower_block(const T* lower, std::ptrdiff_t n, std::ptrdiff_t i0, std::ptrdiff_t i1,
+                        std::ptrdiff_t j0, std::ptrdiff_t j1, T* a)
+{
+    constexpr std::ptrdiff_t m = micro_tile;
+
+    for (std::ptrdiff_t i = i0; i < i1; i += m) {
+        for (std::ptrdiff_t j = j0; j < std::min(j1, i + m); j += m) {
+            if (i + m <= i1 && j + m <= j1 && j + m <= i) {
+                T loc[m][m];
+                for (std::ptrdiff_t c = 0; c < m; ++c) {
+                    const T* col = lower + offset_lower_col_major(i, j + c, n);
+                    for (std::ptrdiff_t r = 0; r < m; ++r) {
+                        loc[r][c] = col[r];
+                    }
+                }
+                for (std::ptrdiff_t r = 0; r < m; ++r) {
+                    for (std::ptrdiff_t c = 0; c < m; ++c) {
+                        a[(i + r)*n + j + c] = loc[r][c];
+                    }
+                }
+            } else {
+                for (std::ptrdiff_t c = j; c < std::min({j + m, j1, i + m - 1}); ++c) {
+                    const std::ptrdiff_t r0 = std::max(i, c + 1);
+                    const T* col = lower + offset_lower_col_major(r0, c, n);
+                    for (std::ptrdiff_t r = r0; r < std::min(i + m, i1); ++r) {
+                        a[r*n + c] = col[r - r0];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Row-major a -> diag, lower, upper. Rows and tiles are distributed over OpenMP threads.
+template <typename T>
+void pack_row_major(const T* a, std::ptrdiff_t n, T* diag, T* lower, T* upper)
+{
+#pragma omp parallel
+{
+    #pragma omp for schedule(static) nowait
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+        diag[i] = a[i*n + i];
+    }
+    // Rows of the upper triangle get shorter, hence the dynamic schedule
+    #pragma omp for schedule(dynamic, 16) nowait
+    for (std::ptrdiff_t i = 0; i < n - 1; ++i) {
+        const T* src = a + i*n + i + 1;
+        T* dst = upper + offset_upper_row_major(i, i + 1, n);
+        #pragma omp simd
+        for (std::ptrdiff_t k = 0; k < n - 1 - i; ++k) {
+            dst[k] = src[k];
+        }
+    }
+    #pragma omp for schedule(dynamic)
+    for (std::ptrdiff_t i = 0; i < n; i += tile_size) {
+        for (std::ptrdiff_t j = 0; j <= i; j += tile_size) {
+            pack_lower_block(a, n, i, std::min(i + tile_size, n), j, std::min(j + tile_size, n), lower);
+        }
+    }
+} // barrier
+}
+
+// diag, lower, upper -> row-major a
+template <typename T>
+void unpack_row_major(const T* diag, const T* lower, const T* upper, std::ptrdiff_t n, T* a)
+{
+#pragma omp parallel
+{
+    #pragma omp for schedule(static) nowait
+    for (std::ptrdiff_t i = 0; i < n; ++i) {
+        a[i*n + i] = diag[i];
+    }
+    #pragma omp for schedule(dynamic, 16) nowait
+    for (std::ptrdiff_t i = 0; i < n - 1; ++i) {
+        const T* src = upper + offset_upper_row_major(i, i + 1, n);
+        T* dst = a + i*n + i + 1;
+        #pragma omp simd
+        for (std::ptrdiff_t k = 0; k < n - 1 - i; ++k) {
+            dst[k] = src[k];
+        }
+    }
+    #pragma omp for schedule(dynamic)
+    for (std::ptrdiff_t i = 0; i < n; i += tile_size) {
+        for (std::ptrdiff_t j = 0; j <= i; j += tile_size) {
+            unpack_lower_block(lower, n, i, std::min(i + tile_size, n), j, std::min(j + tile_size, n), a);
+        }
+    }
+} // barrier
+}
+
+} // namespace detail
+} // namespace asc::pad_ws20::project
+
+#endif // PACKING_H
@@ -0,0 +1,220 @@
+#ifndef PAIRWISE_H
+#define PAIRWISE_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Operations on the pairs (l, u) = (a_ij, a_ji) of the packed triangles of a matrix, i > j,
+// where l is the element of the lower triangle (col-major) and u its mirror in the upper
+// triangle (row-major), at the same offset. A map returns one value per output array; a
+// reduction returns a term which is summed over all pairs.
+
+// (A + A^T) / 2 into both triangles
+struct sym_part {
+    template <typename T>
+    std::array<T, 2> operator()(T l, T u) const {
+        T s = (l + u) / 2;
+        return {s, s};
+    }
+};
+
+// (A - A^T) / 2 into both triangles
+struct skew_part {
+    template <typename T>
+    std::array<T, 2> operator()(T l, T u) const {
+        T s = (l - u) / 2;
+        return {s, -s};
+    }
+};
+
+// A + A^T into both triangles
+struct sum_transpose {
+    template <typename T>
+    std::array<T, 2> operator()(T l, T u) const {
+        T s = l + u;
+        return {s, s};
+    }
+};
+
+// alpha A + beta A^T into both triangles
+template <typename T>
+struct axpby_transpose {
+    T alpha;
+    T beta;
+
+    std::array<T, 2> operator()(T l, T u) const {
+        return {alpha*l + beta*u, alpha*u + beta*l};
+    }
+};
+
+// No outputs, for reductions only
+struct no_map {
+    template <typename T>
+    std::array<T, 0> operator()(T, T) const {
+        return {};
+    }
+};
+
+struct no_reduction {
+    template <typename T>
+    double operator()(T, T) const {
+        return 0;
+    }
+};
+
+// Half of ||A - A^T||^2 (Frobenius); every pair appears twice in A - A^T
+struct asymmetry_sq {
+    template <typename T>
+    double operator()(T l, T u) const {
+        T d = l - u;
+        return d*d;
+    }
+};
+
+template <typename T, std::size_t N, std::size_t... I>
+inline void store_outputs(const std::array<T, N>& y, [[maybe_unused]] std::ptrdiff_t k,
+                          [[maybe_unused]] std::array<T*, N> out,
+                          std::index_sequence<I...>) {
+    ((out[I][k] = y[I]), ...);
+}
+
+// For k in [0, n): out_m[k] = map(lower[k], upper[k])[m] for every output array out_m, and
+// the sum of reduce(lower[k], upper[k]) (on the values before the map), which is returned.
+// Outputs may be lower and upper themselves, for an in-place update. The pairs are read once,
+// however many outputs and reductions there are, in a vectorized loop on the calling thread.
+template <typename T, typename Map, typename Reduce, typename... Out>
+double pairwise(const T* lower, const T* upper, std::ptrdiff_t n, Map map, Reduce reduce,
+                Out*... out)
+{
+    static_assert((std::is_same_v<Out, T> && ...));
+    const std::array<T*, sizeof...(Out)> outputs{out...};
+    double acc = 0;
+
+    #pragma omp simd reduction(+:acc)
+    for (std::ptrdiff_t k = 0; k < n; ++k) {
+        const T l = lower[k];
+        const T u = upper[k];
+        acc += reduce(l, u);
+        store_outputs(map(l, u), k, outputs, std::index_sequence_for<Out...>());
+    }
+    return acc;
+}
+
+// As pairwise(), with the pairs split between OpenMP threads
+template <typename T, typename Map, typename Reduce, typename... Out>
+double pairwise_parallel(const T* lower, const T* upper, std::ptrdiff_t n, Map map, Reduce reduce,
+                         Out*... out)
+{
+    static_assert((std::is_same_v<Out, T> && ...));
+    const std::array<T*, sizeof...(Out)> outputs{out...};
+    double acc = 0;
+
+    #pragma omp parallel for simd schedule(static) reduction(+:acc) firstprivate(map, reduce)
+    for (std::ptrdiff_t k = 0; k < n; ++k) {
+        const T l = lower[k];
+        const T u = upper[k];
+        acc += reduce(l, u);
+        store_outputs(map(l, u), k, outputs, std::index_sequence_for<Out...>());
+    }
+    return acc;
+}
+
+} // namespace detail
+
+// Operations on the packed triangles which can be selected at run time (e.g. with --op)
+enum class pair_op {
+    symmetrize,   // (A + A^T) / 2
+    skew,         // (A - A^T) / 2
+    sum,          // A + A^T
+    axpby,        // alpha A + beta A^T
+    asymmetry,    // ||A - A^T||, without modifying A
+    symmetrize_asymmetry // ||A - A^T|| and (A + A^T) / 2, in one pass
+};
+
+inline std::optional<pair_op> parse_pair_op(const std::string& name) {
+    const std::pair<const char*, pair_op> names[] = {
+        {"symmetrize", pair_op::symmetrize},
+        {"skew", pair_op::skew},
+        {"sum", pair_op::sum},
+        {"axpby", pair_op::axpby},
+        {"asymmetry", pair_op::asymmetry},
+        {"symmetrize-asymmetry", pair_op::symmetrize_asymmetry},
+    };
+    for (const auto& [n, op] : names) {
+        if (name == n) {
+            return op;
+        }
+    }
+    return std::nullopt;
+}
+
+inline bool pair_op_has_norm(pair_op op) {
+    return op == pair_op::asymmetry || op == pair_op::symmetrize_asymmetry;
+}
+
+namespace detail
+{
+// apply_pair_op() with pairwise(), or with pairwise_parallel() if Parallel
+template <bool Parallel, typename T>
+double apply_pair_op_with(pair_op op, T* lower, T* upper, std::ptrdiff_t n, T alpha, T beta)
+{
+    auto run = [=](auto map, auto reduce, auto*... out) {
+        if constexpr (Parallel) {
+            return pairwise_parallel(lower, upper, n, map, reduce, out...);
+        } else {
+            return pairwise(lower, upper, n, map, reduce, out...);
+        }
+    };
+
+    switch (op) {
+    case pair_op::symmetrize:
+        return run(sym_part(), no_reduction(), lower, upper);
+    case pair_op::skew:
+        return run(skew_part(), no_reduction(), lower, upper);
+    case pair_op::sum:
+        return run(sum_transpose(), no_reduction(), lower, upper);
+    case pair_op::axpby:
+        return run(axpby_transpose<T>{alpha, beta}, no_reduction(), lower, upper);
+    case pair_op::asymmetry:
+        return run(no_map(), asymmetry_sq());
+    case pair_op::symmetrize_asymmetry:
+        return run(sym_part(), asymmetry_sq(), lower, upper);
+    }
+    return 0;
+}
+
+} // namespace detail
+
+// Apply op in place to n pairs of the packed triangles. Returns the local part of
+// ||A - A^T||^2 / 2 for the operations with a norm, and 0 otherwise; see asymmetry_norm().
+template <typename T>
+double apply_pair_op(pair_op op, T* lower, T* upper, std::ptrdiff_t n, T alpha = 1, T beta = 1)
+{
+    return detail::apply_pair_op_with<false>(op, lower, upper, n, alpha, beta);
+}
+
+// As apply_pair_op(), with the pairs split between OpenMP threads
+template <typename T>
+double apply_pair_op_parallel(pair_op op, T* lower, T* upper, std::ptrdiff_t n, T alpha = 1, T beta = 1)
+{
+    return detail::apply_pair_op_with<true>(op, lower, upper, n, alpha, beta);
+}
+
+// ||A - A^T|| (Frobenius) from the sum of the partial results of apply_pair_op()
+inline double asymmetry_norm(double half_sq) {
+    return std::sqrt(2 * half_sq);
+}
+
+} // namespace asc::pad_ws20::project
+
+#endif // PAIRWISE_H
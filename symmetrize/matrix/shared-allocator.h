@@ -0,0 +1,55 @@
+#ifndef SHARED_ALLOCATOR_H
+#define SHARED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+#include <upcxx/upcxx.hpp>
+
+#include "allocator.h"
+
+
+namespace asc::pad_ws20::project
+{
+// Allocator placing matrices in the UPC++ shared segment of the calling rank, so that other
+// ranks can access them with rget/rput through upcxx::to_global_ptr(), e.g. of
+// TriMatrix::lower(). upcxx::allocate() is used instead of upcxx::new_array() to keep the
+// alignment. Requires upcxx::init(), and matrices must be destroyed before upcxx::finalize().
+template <typename T, std::size_t Alignment = cache_line_size>
+class shared_allocator
+{
+public:
+    typedef T value_type;
+    static constexpr std::size_t alignment = Alignment;
+
+    template <typename U>
+    struct rebind {
+        typedef shared_allocator<U, Alignment> other;
+    };
+
+    shared_allocator() noexcept = default;
+    template <typename U>
+    shared_allocator(const shared_allocator<U, Alignment>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        void* p = upcxx::allocate(n * sizeof(T), Alignment);
+        if (p == nullptr) {
+            throw std::bad_alloc(); // shared segment exhausted, see -shared-heap
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        upcxx::deallocate(p);
+    }
+};
+
+template <typename T, typename U, std::size_t A>
+bool operator==(const shared_allocator<T, A>&, const shared_allocator<U, A>&) { return true; }
+
+template <typename T, typename U, std::size_t A>
+bool operator!=(const shared_allocator<T, A>&, const shared_allocator<U, A>&) { return false; }
+
+} // namespace asc::pad_ws20::project
+
+#endif // SHARED_ALLOCATOR_H
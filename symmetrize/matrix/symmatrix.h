@@ -0,0 +1,230 @@
+#ifndef SYMMATRIX_H
+#define SYMMATRIX_H
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "allocator.h"
+#include "offsets.h"
+#include "trimatrix.h"
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+// Column of the packed lower triangle (col-major) containing offset k, for n >= 2
+inline std::ptrdiff_t lower_col_of_offset(std::ptrdiff_t k, std::ptrdiff_t n) {
+    std::ptrdiff_t lo = 0, hi = n - 1;
+    while (hi - lo > 1) {
+        std::ptrdiff_t mid = (lo + hi) / 2;
+        if (offset_lower_col_major(mid + 1, mid, n) <= k) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// y += L x + L^T x for the offsets [k0, k1) of the strictly lower triangle L of a symmetric
+// n x n matrix, packed in col-major order; a[k - k0] holds offset k. Each element a_ij is read
+// once and used for both y_i (axpy over a column) and y_j (dot product of a column).
+//
+// Any range of offsets can be passed, so that the triangle may be split evenly between threads
+// or ranks; each caller then needs its own y.
+template <typename T>
+void spmv_lower(const T* a, std::ptrdiff_t k0, std::ptrdiff_t k1, std::ptrdiff_t n,
+                const T* x, T* y)
+{
+    if (k0 >= k1) {
+        return;
+    }
+    std::ptrdiff_t j = lower_col_of_offset(k0, n);
+    std::ptrdiff_t k = k0;
+    while (k < k1) {
+        const std::ptrdiff_t start = offset_lower_col_major(j + 1, j, n);
+        const std::ptrdiff_t i0 = j + 1 + (k - start);
+        const std::ptrdiff_t i1 = std::min(n, j + 1 + (k1 - start));
+        const T* col = a + (start - (j + 1)) - k0; // col[i] holds a_ij
+        const T xj = x[j];
+        T s = 0;
+        #pragma omp simd reduction(+:s)
+        for (std::ptrdiff_t i = i0; i < i1; ++i) {
+            y[i] += col[i] * xj;
+            s += col[i] * x[i];
+        }
+        y[j] += s;
+        k += i1 - i0;
+        ++j;
+    }
+}
+
+} // namespace detail
+
+// Symmetric matrix, storing only the diagonal and the lower triangle (col-major, as in
+// TriMatrix). This halves the memory of a symmetrized TriMatrix, and the memory traffic of
+// kernels which read the whole matrix, such as the matrix-vector product.
+template <typename T, typename Alloc = aligned_allocator<T>>
+class SymMatrix
+{
+    static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
+
+public:
+    typedef T value_type;
+    typedef Alloc allocator_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::ptrdiff_t index_t;
+
+    SymMatrix(index_t n, const Alloc& alloc = Alloc())
+        : _n(n), _t(n*(n-1) / 2), _alloc(alloc)
+    {
+        assert(n >= 1);
+        assert(n == 1 || n < std::numeric_limits<index_t>::max() / (n - 1));
+        _diag = _alloc.allocate(buffer_size());
+        _lower = _diag + detail::padded<T>(_n);
+    }
+
+    // Symmetric part (A + A^T) / 2 of a TriMatrix, which equals A if it was symmetrized
+    template <typename TriAlloc>
+    explicit SymMatrix(const TriMatrix<T, TriAlloc>& packed, const Alloc& alloc = Alloc())
+        : SymMatrix(packed.n(), alloc)
+    {
+        std::copy(packed.diag(), packed.diag() + _n, _diag);
+        const T* l = packed.lower();
+        const T* u = packed.upper();
+
+        #pragma omp parallel for simd schedule(static)
+        for (index_t k = 0; k < _t; ++k) {
+            _lower[k] = (l[k] + u[k]) / 2.;
+        }
+    }
+
+    SymMatrix(const SymMatrix&) = delete;
+    SymMatrix& operator=(const SymMatrix&) = delete;
+
+    SymMatrix(SymMatrix&& other) noexcept
+        : _n(other._n), _t(other._t), _alloc(std::move(other._alloc)),
+          _diag(std::exchange(other._diag, nullptr)),
+          _lower(std::exchange(other._lower, nullptr))
+    {}
+
+    SymMatrix& operator=(SymMatrix&& other) noexcept {
+        if (this != &other) {
+            if (_diag != nullptr) {
+                _alloc.deallocate(_diag, buffer_size());
+            }
+            _n = other._n;
+            _t = other._t;
+            _alloc = std::move(other._alloc);
+            _diag = std::exchange(other._diag, nullptr);
+            _lower = std::exchange(other._lower, nullptr);
+        }
+        return *this;
+    }
+
+    ~SymMatrix() {
+        if (_diag != nullptr) {
+            _alloc.deallocate(_diag, buffer_size());
+        }
+    }
+
+    // (i,j) and (j,i) refer to the same element
+    T operator()(index_t i, index_t j) const
+    {
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+
+        if (i == j) {
+            return _diag[i];
+        }
+        return _lower[detail::offset_lower_col_major(std::max(i, j), std::min(i, j), _n)];
+    }
+
+    T& operator()(index_t i, index_t j)
+    {
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+
+        if (i == j) {
+            return _diag[i];
+        }
+        return _lower[detail::offset_lower_col_major(std::max(i, j), std::min(i, j), _n)];
+    }
+
+    // y = A x
+    void spmv(const T* x, T* y) const {
+        #pragma omp simd
+        for (index_t i = 0; i < _n; ++i) {
+            y[i] = _diag[i] * x[i];
+        }
+        detail::spmv_lower(_lower, 0, _t, _n, x, y);
+    }
+
+    // y = A x, with the lower triangle split evenly between threads. Every thread accumulates
+    // into its own partial y (padded to a cache line), which are summed at the end.
+    void spmv_parallel(const T* x, T* y) const {
+#ifdef _OPENMP
+        const int threads = omp_get_max_threads();
+#else
+        const int threads = 1;
+#endif
+        const index_t ld = detail::padded<T>(_n);
+        std::vector<T, aligned_allocator<T>> partial(threads * ld);
+
+        // One part of the triangle per requested thread, distributed with a loop as the team
+        // may have fewer threads (e.g. in a nested region or with OMP_DYNAMIC)
+        #pragma omp parallel num_threads(threads)
+        {
+            #pragma omp for schedule(static)
+            for (int p = 0; p < threads; ++p) {
+                const index_t k0 = _t * p / threads;
+                const index_t k1 = _t * (p + 1) / threads;
+                detail::spmv_lower(_lower + k0, k0, k1, _n, x, partial.data() + p * ld);
+            }
+
+            #pragma omp for simd schedule(static)
+            for (index_t i = 0; i < _n; ++i) {
+                T s = _diag[i] * x[i];
+                for (int p = 0; p < threads; ++p) {
+                    s += partial[p * ld + i];
+                }
+                y[i] = s;
+            }
+        }
+    }
+
+    T* diag()  { return _diag; }
+    T* lower() { return _lower; }
+    const T* diag()  const { return _diag; }
+    const T* lower() const { return _lower; }
+
+    index_t n() const noexcept { return _n; }
+    index_t t() const noexcept { return _t; }
+    index_t s() const noexcept { return _n + _t; }
+    allocator_type get_allocator() const { return _alloc; }
+
+private:
+    index_t buffer_size() const noexcept {
+        return detail::padded<T>(_n) + _t;
+    }
+
+    index_t _n;
+    index_t _t;
+    Alloc _alloc;
+    T* _diag = nullptr;
+    T* _lower = nullptr;
+};
+
+} // namespace asc::pad_ws20::project
+
+#endif // SYMMATRIX_H
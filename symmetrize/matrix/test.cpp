@@ -1,16 +1,40 @@
 #define CATCH_CONFIG_MAIN
 #include <catch.hpp>
 #include <iostream>
+#include <cstdint>
+#include <filesystem>
+#include <numeric>
 #include <random>
+#include <vector>
 
 #include "trimatrix.h"
 #include "matrix.h"
+#include "batch.h"
+#include "dirty.h"
+#include "interleaved.h"
+#include "layout.h"
+#include "mapped.h"
+#include "pairwise.h"
+#include "symmatrix.h"
+#include "tiled.h"
+#include "view.h"
 
 using namespace asc::pad_ws20::project;
 
 template <typename Matrix>
 using Value = typename Matrix::value_type;
 
+// Pseudo-random half-integers in [0.5, 99.5], as in the programs
+template <typename T>
+std::vector<T> random_elements(std::size_t count, int seed = 42) {
+    std::vector<T> v(count);
+    std::mt19937_64 rgen(seed);
+    for (auto& x : v) {
+        x = 0.5 + rgen() % 100;
+    }
+    return v;
+}
+
 TEST_CASE("TriMatrix to SquareMatrix conversion") {
     double diag[5] = {   // diagonal
         1, 7, 13, 19, 25
@@ -70,7 +94,8 @@ TEST_CASE("TriMatrix to SquareMatrix conversion") {
     CHECK(M2.s() == 25);
 }
 
-TEMPLATE_TEST_CASE("square matrix", "", TriMatrix<double>, SquareMatrix<double>) {
+TEMPLATE_TEST_CASE("square matrix", "", TriMatrix<double>, SquareMatrix<double>, TiledTriMatrix<double>,
+                   InterleavedTriMatrix<double>) {
     using Matrix = TestType;
 
     double diag[5] = {   // diagonal
@@ -167,3 +192,762 @@ TEMPLATE_TEST_CASE("square matrix", "", TriMatrix<double>, SquareMatrix<double>)
         }
     }
 }
+
+TEST_CASE("blocked transposition and symmetrization") {
+    // Sizes around multiples of the micro tile (8) and tile (64) size
+    auto n = GENERATE(1, 2, 7, 8, 9, 63, 64, 65, 130, 257);
+    CAPTURE(n);
+
+    auto elems = random_elements<float>(n*n);
+    SquareMatrix<float> R(elems.data(), n*n);
+    SquareMatrix<float> M(elems.data(), n*n);
+
+    auto require_equal = [&]() {
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i);
+                CAPTURE(j);
+                REQUIRE(M(i, j) == R(i, j));
+            }
+        }
+    };
+
+    SECTION("tiled") {
+        R.transpose_naive();
+        M.transpose();
+        require_equal();
+        R.symmetrize_naive();
+        M.symmetrize();
+        require_equal();
+    }
+    SECTION("tiled, parallel") {
+        R.transpose_naive();
+        M.transpose_parallel();
+        require_equal();
+        R.symmetrize_naive();
+        M.symmetrize_parallel();
+        require_equal();
+    }
+    SECTION("recursive") {
+        R.transpose_naive();
+        M.transpose_recursive();
+        require_equal();
+        R.symmetrize_naive();
+        M.symmetrize_recursive();
+        require_equal();
+    }
+}
+
+TEST_CASE("packing and unpacking of TriMatrix") {
+    auto n = GENERATE(1, 2, 7, 8, 9, 63, 64, 65, 130, 257);
+    CAPTURE(n);
+
+    auto elems = random_elements<float>(n*n);
+
+    // Packing: element-wise access through the offsets (see offsets.h)
+    TriMatrix<float> T(elems.data(), n*n);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            CAPTURE(i);
+            CAPTURE(j);
+            REQUIRE(T(i, j) == elems[n*i + j]);
+        }
+    }
+
+    // Unpacking: dense copy and row-major array
+    SquareMatrix<float> M(T);
+    std::vector<float> unpacked(n*n);
+    T.unpack(unpacked.data());
+    for (int k = 0; k < n*n; ++k) {
+        CAPTURE(k);
+        REQUIRE(M.elements()[k] == elems[k]);
+        REQUIRE(unpacked[k] == elems[k]);
+    }
+
+    // Adopting packed arrays, without copies
+    float* lower = T.lower();
+    aligned_allocator<float> alloc;
+    TriMatrix<float> U(adopt_arrays, alloc.allocate(n), T.t() > 0 ? alloc.allocate(T.t()) : nullptr,
+                       T.t() > 0 ? alloc.allocate(T.t()) : nullptr, n);
+    CHECK(U.n() == n);
+    CHECK(U.t() == T.t());
+    TriMatrix<float> V(std::move(T));
+    CHECK(V.lower() == lower);
+}
+
+TEMPLATE_TEST_CASE("aligned storage", "", float, double) {
+    using T = TestType;
+    auto n = GENERATE(1, 2, 17, 100);
+    CAPTURE(n);
+    auto aligned = [](const void* p) {
+        return reinterpret_cast<std::uintptr_t>(p) % cache_line_size == 0;
+    };
+
+    SquareMatrix<T> M(n);
+    CHECK(aligned(M.elements()));
+
+    // Single allocation, each array starting on a cache line
+    TriMatrix<T> C(n);
+    CHECK(C.layout() == tri_layout::contiguous);
+    CHECK(aligned(C.diag()));
+    if (n > 1) {
+        CHECK(aligned(C.lower()));
+        CHECK(aligned(C.upper()));
+        CHECK(C.lower() >= C.diag() + n);
+        CHECK(C.upper() >= C.lower() + C.t());
+    }
+
+    TriMatrix<T> S(n, tri_layout::separate);
+    CHECK(aligned(S.diag()));
+    if (n > 1) {
+        CHECK(aligned(S.lower()));
+        CHECK(aligned(S.upper()));
+    }
+
+    // Other allocators, and conversion between them
+    std::vector<T> elems(n*n);
+    std::iota(elems.begin(), elems.end(), T(1));
+    TriMatrix<T, huge_page_allocator<T>> H(n);
+    CHECK(reinterpret_cast<std::uintptr_t>(H.diag()) % huge_page_size == 0);
+    TriMatrix<T, std::allocator<T>> A(elems.data(), n*n);
+    SquareMatrix<T> D(A);
+    for (int k = 0; k < n*n; ++k) {
+        CAPTURE(k);
+        REQUIRE(D.elements()[k] == elems[k]);
+    }
+
+    // Moves transfer the buffer
+    const T* diag = C.diag();
+    TriMatrix<T> C2(std::move(C));
+    CHECK(C2.diag() == diag);
+    C = std::move(C2);
+    CHECK(C.diag() == diag);
+}
+
+TEST_CASE("tiled storage of TriMatrix") {
+    auto n = GENERATE(1, 7, 8, 64, 65, 130);
+    auto b = GENERATE(8, 13, 64);
+    CAPTURE(n, b);
+
+    std::vector<double> elems(n*n);
+    std::iota(elems.begin(), elems.end(), 1.0);
+    TriMatrix<double> P(elems.data(), n*n);
+    TiledTriMatrix<double> A(P, b);
+    REQUIRE(A.tiles() == (n + b - 1) / b);
+
+    // Tiles are contiguous and aligned, and agree with the packed triangles
+    for (int I = 0; I < A.tiles(); ++I) {
+        for (int J = 0; J < A.tiles(); ++J) {
+            CAPTURE(I, J);
+            CHECK(reinterpret_cast<std::uintptr_t>(A.tile(I, J)) % cache_line_size == 0);
+            for (int r = 0; r < std::min(b, n - I*b); ++r) {
+                for (int c = 0; c < std::min(b, n - J*b); ++c) {
+                    REQUIRE(A.tile(I, J)[r*b + c] == P(I*b + r, J*b + c));
+                }
+            }
+        }
+    }
+
+    SECTION("conversion") {
+        TiledTriMatrix<double> R(elems.data(), n*n, b);
+        TriMatrix<double> Q(n);
+        R.unpack(Q);
+        std::vector<double> dense(n*n);
+        A.unpack(dense.data());
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(R(i, j) == P(i, j));
+                REQUIRE(Q(i, j) == P(i, j));
+                REQUIRE(dense[i*n + j] == P(i, j));
+            }
+        }
+    }
+
+    SECTION("transposition and symmetrization") {
+        A.transpose();
+        P.transpose();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                REQUIRE(A(i, j) == P(i, j));
+            }
+        }
+        A.symmetrize();
+        P.symmetrize();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                REQUIRE(A(i, j) == P(i, j));
+            }
+        }
+    }
+
+    SECTION("matrix-vector product") {
+        std::vector<double> x(n), y(n);
+        std::iota(x.begin(), x.end(), -n / 2.);
+        A.matvec(x.data(), y.data());
+        for (int i = 0; i < n; ++i) {
+            double s = 0;
+            for (int j = 0; j < n; ++j) {
+                s += P(i, j) * x[j];
+            }
+            CAPTURE(i);
+            CHECK(y[i] == Approx(s));
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE("interleaved storage of TriMatrix", "", float, double) {
+    using T = TestType;
+    auto n = GENERATE(1, 2, 6, 7, 65);
+    CAPTURE(n);
+
+    auto elems = random_elements<T>(n*n);
+    TriMatrix<T> P(elems.data(), n*n);
+    InterleavedTriMatrix<T> M(P);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(M.pairs()) % cache_line_size == 0);
+
+    SECTION("conversion") {
+        TriMatrix<T> Q(n);
+        M.unpack(Q);
+        CHECK(std::equal(P.diag(), P.diag() + n, Q.diag()));
+        CHECK(std::equal(P.lower(), P.lower() + P.t(), Q.lower()));
+        CHECK(std::equal(P.upper(), P.upper() + P.t(), Q.upper()));
+    }
+
+    SECTION("transposition by flag") {
+        M.transpose();
+        P.transpose();
+        TriMatrix<T> Q(n);
+        M.unpack(Q);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(M(i, j) == P(i, j));
+                REQUIRE(Q(i, j) == P(i, j));
+            }
+        }
+    }
+
+    // Bitwise as the two-array kernel, also after transposition
+    SECTION("symmetrization") {
+        P.symmetrize();
+        M.transpose();
+        M.symmetrize_parallel();
+        InterleavedTriMatrix<T> S(elems.data(), n*n);
+        S.symmetrize();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(M(i, j) == P(i, j));
+                REQUIRE(S(i, j) == P(i, j));
+            }
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE("symmetrized view", "", TriMatrix<float>, SquareMatrix<float>) {
+    using Matrix = TestType;
+    auto n = GENERATE(1, 2, 7, 64, 65, 130);
+    CAPTURE(n);
+
+    auto elems = random_elements<float>(n*n);
+    Matrix M(elems.data(), n*n);
+    Matrix S(elems.data(), n*n);
+    S.symmetrize();
+    const SymmetrizedView V(M);
+
+    // The view agrees with symmetrize() bitwise, and leaves the matrix unchanged
+    SECTION("element and row access") {
+        std::vector<float> row(n);
+        for (int i = 0; i < n; ++i) {
+            V.row(i, row.data());
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(V(i, j) == S(i, j));
+                REQUIRE(row[j] == S(i, j));
+                REQUIRE(M(i, j) == elems[i*n + j]);
+            }
+        }
+    }
+
+    SECTION("tiles") {
+        const int b = 16;
+        int count = 0;
+        V.for_each_tile(b, [&](int I, int J, const float* tile) {
+            for (int r = 0; r < std::min(b, n - I*b); ++r) {
+                for (int c = 0; c < std::min(b, n - J*b); ++c) {
+                    REQUIRE(tile[r*b + c] == S(I*b + r, J*b + c));
+                }
+            }
+            ++count;
+        });
+        CHECK(count == ((n + b - 1) / b) * ((n + b - 1) / b));
+
+        // Tiles which the diagonal crosses off their corners
+        const int i0 = n / 3, j0 = n / 5, rows = n - i0, cols = std::min(n - j0, 11);
+        std::vector<float> tile(rows*cols);
+        V.tile(i0, j0, rows, cols, tile.data(), cols);
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                CAPTURE(r, c);
+                REQUIRE(tile[r*cols + c] == S(i0 + r, j0 + c));
+            }
+        }
+    }
+
+    SECTION("materialization") {
+        std::vector<float> dense(n*n);
+        V.materialize(dense.data());
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(dense[i*n + j] == S(i, j));
+            }
+        }
+    }
+}
+
+TEST_CASE("symmetrized view of TriMatrix, materialized as SymMatrix") {
+    const int n = 100;
+    std::vector<float> elems(n*n);
+    std::iota(elems.begin(), elems.end(), 0.5f);
+    TriMatrix<float> M(elems.data(), n*n);
+    SymMatrix<float> S(n);
+    SymmetrizedView(M).materialize(S.diag(), S.lower());
+    M.symmetrize();
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            CAPTURE(i, j);
+            REQUIRE(S(i, j) == M(i, j));
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE("incremental symmetrization", "", TriMatrix<float>, SquareMatrix<float>) {
+    using Matrix = TestType;
+    auto n = GENERATE(1, 7, 64, 130);
+    auto b = GENERATE(8, 64);
+    CAPTURE(n, b);
+
+    auto elems = random_elements<float>(n*n);
+    Matrix M(elems.data(), n*n);
+    Matrix R(elems.data(), n*n);
+    M.symmetrize();
+    R.symmetrize();
+    Tracked<Matrix> T(M, b);
+    REQUIRE(T.dirty().count() == 0);
+
+    // Updates of single elements on either side of the diagonal, and of a block
+    std::mt19937_64 rgen(43);
+    for (int k = 0; k < 5; ++k) {
+        const int i = rgen() % n;
+        const int j = rgen() % n;
+        const float v = 0.5 + rgen() % 100;
+        T.set(i, j, v);
+        R(i, j) = v;
+    }
+    const int rows = std::min(n, 10);
+    auto block = random_elements<float>(rows*rows, 44);
+    T.set(n - rows, 0, rows, rows, block.data(), rows);
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < rows; ++c) {
+            R(n - rows + r, c) = block[r*rows + c];
+        }
+    }
+    REQUIRE(T.dirty().count() >= 1);
+    REQUIRE(T.dirty().count() <= 5 + 4);
+
+    T.symmetrize();
+    R.symmetrize();
+    REQUIRE(T.dirty().count() == 0);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            CAPTURE(i, j);
+            REQUIRE(M(i, j) == R(i, j));
+        }
+    }
+}
+
+TEST_CASE("dirty tiles of a block of rows") {
+    // Rows [0, 20) of a 20 x 100 block, in tiles of 8
+    DirtyTiles D(20, 100, 8);
+    CHECK(D.tile_rows() == 3);
+    CHECK(D.tile_cols() == 13);
+
+    D.mark(19, 99);
+    D.mark(7, 8, 2, 8);
+    CHECK(D(2, 12));
+    CHECK(D(0, 1));
+    CHECK(D(1, 1));
+    CHECK_FALSE(D(0, 2));
+    CHECK(D.count() == 3);
+
+    D.clear();
+    CHECK(D.count() == 0);
+    D.mark_all();
+    CHECK(D.count() == 3 * 13);
+}
+
+TEST_CASE("batch of small matrices") {
+    auto n = GENERATE(1, 3, 5, 8);
+    auto count = GENERATE(1, 7, 100, 2049);
+    CAPTURE(n, count);
+
+    auto elems = random_elements<float>(n*n*count);
+    MatrixBatch<float> B(elems.data(), n, count);
+    REQUIRE(B.ld() % 16 == 0);
+    REQUIRE(B.ld() >= count);
+    REQUIRE(B.element(n - 1, 0)[count - 1] == elems[(count - 1)*n*n + (n - 1)*n]);
+
+    // Every matrix of the batch agrees with a SquareMatrix
+    auto check = [&](auto kernel) {
+        std::vector<float> out(n*n);
+        for (int m = 0; m < count; ++m) {
+            SquareMatrix<float> M(elems.data() + m*n*n, n*n);
+            kernel(M);
+            B.store(m, out.data());
+            for (int k = 0; k < n*n; ++k) {
+                CAPTURE(m, k);
+                REQUIRE(out[k] == M.elements()[k]);
+            }
+        }
+    };
+
+    SECTION("symmetrize") {
+        B.symmetrize();
+        check([](auto& M) { M.symmetrize_naive(); });
+    }
+
+    SECTION("symmetrize, parallel") {
+        B.symmetrize_parallel();
+        check([](auto& M) { M.symmetrize_naive(); });
+    }
+
+    SECTION("transpose") {
+        B.transpose();
+        check([](auto& M) { M.transpose_naive(); });
+    }
+
+    SECTION("transpose, parallel") {
+        B.transpose_parallel();
+        check([](auto& M) { M.transpose_naive(); });
+    }
+}
+
+TEST_CASE("pairwise operations on packed triangles") {
+    const int n = 50;
+    auto elems = random_elements<float>(n*n);
+    TriMatrix<float> A(elems.data(), n*n);
+    TriMatrix<float> B(elems.data(), n*n);
+    const auto t = A.t();
+
+    // Compare B after the operation with f(a_ij, a_ji) for every element of A
+    auto check = [&](auto f) {
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(B(i, j) == (i == j ? A(i, i) : f(A(i, j), A(j, i))));
+            }
+        }
+    };
+    double norm = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            norm += (A(i, j) - A(j, i)) * (A(i, j) - A(j, i));
+        }
+    }
+    norm = std::sqrt(norm);
+
+    SECTION("maps") {
+        CHECK(apply_pair_op(pair_op::symmetrize, B.lower(), B.upper(), t) == 0);
+        check([](float x, float y) { return (x + y) / 2; });
+
+        A.symmetrize();
+        CHECK(apply_pair_op(pair_op::skew, B.lower(), B.upper(), t) == 0);
+        check([](float, float) { return 0.f; });
+    }
+
+    SECTION("skew part, sum and axpby") {
+        apply_pair_op(pair_op::skew, B.lower(), B.upper(), t);
+        check([](float x, float y) { return (x - y) / 2; });
+
+        std::copy(A.lower(), A.lower() + t, B.lower());
+        std::copy(A.upper(), A.upper() + t, B.upper());
+        apply_pair_op(pair_op::sum, B.lower(), B.upper(), t);
+        check([](float x, float y) { return x + y; });
+
+        std::copy(A.lower(), A.lower() + t, B.lower());
+        std::copy(A.upper(), A.upper() + t, B.upper());
+        apply_pair_op(pair_op::axpby, B.lower(), B.upper(), t, 2.f, -0.5f);
+        check([](float x, float y) { return 2*x - 0.5f*y; });
+    }
+
+    SECTION("asymmetry norm, alone and fused with symmetrization") {
+        const double half = apply_pair_op(pair_op::asymmetry, B.lower(), B.upper(), t);
+        CHECK(asymmetry_norm(half) == Approx(norm));
+        check([](float x, float) { return x; });
+
+        const double fused = apply_pair_op(pair_op::symmetrize_asymmetry, B.lower(), B.upper(), t);
+        CHECK(fused == half);
+        check([](float x, float y) { return (x + y) / 2; });
+    }
+
+    SECTION("parallel") {
+        // Sums of half-integer differences are exact in double, whatever the order
+        const double half = apply_pair_op(pair_op::asymmetry, A.lower(), A.upper(), t);
+        CHECK(apply_pair_op_parallel(pair_op::symmetrize_asymmetry, B.lower(), B.upper(), t) == half);
+        check([](float x, float y) { return (x + y) / 2; });
+
+        std::copy(A.lower(), A.lower() + t, B.lower());
+        std::copy(A.upper(), A.upper() + t, B.upper());
+        apply_pair_op_parallel(pair_op::axpby, B.lower(), B.upper(), t, 2.f, -0.5f);
+        check([](float x, float y) { return 2*x - 0.5f*y; });
+    }
+
+    SECTION("several outputs") {
+        // Symmetric and skew part into separate arrays, in one pass over the pairs
+        std::vector<float> sym(t), skew(t);
+        detail::pairwise(A.lower(), A.upper(), t,
+            [](float l, float u) { return std::array<float, 2>{(l + u) / 2, (l - u) / 2}; },
+            detail::no_reduction(), sym.data(), skew.data());
+        for (int i = 1; i < n; ++i) {
+            for (int j = 0; j < i; ++j) {
+                const auto k = detail::offset_lower_col_major(i, j, n);
+                REQUIRE(sym[k] + skew[k] == A(i, j));
+                REQUIRE(sym[k] - skew[k] == A(j, i));
+            }
+        }
+    }
+
+    SECTION("names") {
+        CHECK(parse_pair_op("symmetrize-asymmetry") == pair_op::symmetrize_asymmetry);
+        CHECK(parse_pair_op("axpby") == pair_op::axpby);
+        CHECK_FALSE(parse_pair_op("transpose"));
+    }
+}
+
+TEST_CASE("symmetric matrix-vector product") {
+    auto n = GENERATE(1, 2, 7, 64, 65, 300);
+    CAPTURE(n);
+
+    auto elems = random_elements<double>(n*n);
+    TriMatrix<double> P(elems.data(), n*n);
+    SymMatrix<double> S(P);
+    CHECK(S.s() == n + n*(n-1)/2);
+
+    // Symmetric part of P, as a dense matrix
+    std::vector<double> x(n), ref(n, 0.0);
+    std::iota(x.begin(), x.end(), -n / 3.);
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            CAPTURE(i, j);
+            const double a = i == j ? P(i, i) : (P(i, j) + P(j, i)) / 2.;
+            REQUIRE(S(i, j) == a);
+            ref[i] += a * x[j];
+        }
+    }
+
+    SECTION("serial") {
+        std::vector<double> y(n);
+        S.spmv(x.data(), y.data());
+        for (int i = 0; i < n; ++i) {
+            CAPTURE(i);
+            CHECK(y[i] == Approx(ref[i]));
+        }
+    }
+
+    SECTION("threaded") {
+        std::vector<double> y(n);
+        S.spmv_parallel(x.data(), y.data());
+        for (int i = 0; i < n; ++i) {
+            CAPTURE(i);
+            CHECK(y[i] == Approx(ref[i]));
+        }
+    }
+
+    SECTION("split into chunks") {
+        // Chunks of the lower triangle as owned by ranks in symmetrize-upcxx, reduced by hand
+        auto P = GENERATE(2, 3, 8);
+        const int t = S.t();
+        std::vector<double> y(n);
+        for (int i = 0; i < n; ++i) {
+            y[i] = S(i, i) * x[i];
+        }
+        for (int p = 0; p < P; ++p) {
+            const int k0 = t * p / P, k1 = t * (p + 1) / P;
+            std::vector<double> chunk(S.lower() + k0, S.lower() + k1), yp(n, 0.0);
+            detail::spmv_lower(chunk.data(), k0, k1, n, x.data(), yp.data());
+            for (int i = 0; i < n; ++i) {
+                y[i] += yp[i];
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            CAPTURE(i);
+            CHECK(y[i] == Approx(ref[i]));
+        }
+    }
+}
+
+TEST_CASE("matrix redistribution") {
+    using index_t = distribution::index_t;
+    auto n = GENERATE(1, 2, 7, 16, 33);
+    CAPTURE(n);
+    const std::vector<distribution> dists = {
+        distribution::row_block(n, 1), distribution::row_block(n, 4),
+        distribution::col_block(n, 3), distribution::col_block(n, 4),
+        distribution::block_cyclic(n, 2, 2, 3, 2), distribution::block_cyclic(n, 2, 3, 4, 4),
+        distribution::packed(n, 1), distribution::packed(n, 4), distribution::packed(n, 5)
+    };
+
+    SECTION("ownership") {
+        for (std::size_t d = 0; d < dists.size(); ++d) {
+            CAPTURE(d);
+            const distribution& L = dists[d];
+            // Every element is enumerated once, by its owner, at a distinct local offset
+            std::vector<std::vector<int>> seen(L.P);
+            index_t total = 0;
+            for (int p = 0; p < L.P; ++p) {
+                seen[p].assign(L.local_size(p), 0);
+                total += L.local_size(p);
+                index_t prev = -1;
+                L.for_each_owned(p, [&](index_t i, index_t j) {
+                    REQUIRE(L.owner(i, j) == p);
+                    REQUIRE(i*n + j > prev); // row-major order
+                    prev = i*n + j;
+                    index_t k = L.local_offset(i, j);
+                    REQUIRE(k >= 0);
+                    REQUIRE(k < L.local_size(p));
+                    ++seen[p][k];
+                });
+                for (int c : seen[p]) {
+                    REQUIRE(c == 1);
+                }
+            }
+            CHECK(total == n*n);
+        }
+    }
+
+    SECTION("all-to-all exchange") {
+        // Element (i,j) holds i*n + j; exchange between all pairs of distributions, with the
+        // messages of all ranks concatenated in one buffer per receiver.
+        for (const distribution& from : dists) {
+            std::vector<std::vector<double>> src(from.P);
+            for (int p = 0; p < from.P; ++p) {
+                src[p].resize(from.local_size(p));
+                from.for_each_owned(p, [&](index_t i, index_t j) {
+                    src[p][from.local_offset(i, j)] = i*n + j;
+                });
+            }
+            for (const distribution& to : dists) {
+                std::vector<std::vector<index_t>> recv_displs(to.P);
+                std::vector<std::vector<double>> recv(to.P);
+                for (int q = 0; q < to.P; ++q) {
+                    recv_displs[q] = detail::displacements(detail::recv_counts(from, to, q));
+                    recv[q].resize(recv_displs[q].back());
+                    REQUIRE(recv_displs[q].back() == to.local_size(q));
+                }
+                for (int p = 0; p < from.P; ++p) {
+                    auto displs = detail::displacements(detail::send_counts(from, to, p));
+                    std::vector<double> buf(displs.back());
+                    detail::pack_messages(src[p].data(), from, to, p, displs, buf.data());
+                    for (int q = 0; q < to.P; ++q) {
+                        REQUIRE(displs[q+1] - displs[q] == recv_displs[q][p+1] - recv_displs[q][p]);
+                        std::copy(buf.begin() + displs[q], buf.begin() + displs[q+1],
+                                  recv[q].begin() + recv_displs[q][p]);
+                    }
+                }
+                for (int q = 0; q < to.P; ++q) {
+                    std::vector<double> dst(to.local_size(q));
+                    detail::unpack_messages(recv[q].data(), recv_displs[q], from, to, q, dst.data());
+                    to.for_each_owned(q, [&](index_t i, index_t j) {
+                        REQUIRE(dst[to.local_offset(i, j)] == i*n + j);
+                    });
+                }
+            }
+        }
+    }
+
+    SECTION("packed layout of a single rank is that of TriMatrix") {
+        TriMatrix<double> T(n, tri_layout::separate);
+        const distribution L = distribution::packed(n, 1);
+        std::vector<double> local(L.local_size(0));
+        L.for_each_owned(0, [&](index_t i, index_t j) {
+            local[L.local_offset(i, j)] = T(i, j) = i*n + j;
+        });
+        CHECK(std::equal(T.diag(), T.diag() + n, local.begin()));
+        CHECK(std::equal(T.lower(), T.lower() + T.t(), local.begin() + n));
+        CHECK(std::equal(T.upper(), T.upper() + T.t(), local.begin() + n + T.t()));
+    }
+}
+
+TEST_CASE("mapped matrix files") {
+    auto n = GENERATE(1, 7, 130);
+    CAPTURE(n);
+    const std::string path = (std::filesystem::temp_directory_path() / "matrix-test.bin").string();
+
+    auto elems = random_elements<double>(n*n);
+
+    SECTION("dense") {
+        SquareMatrix<double> M(elems.data(), n*n);
+        REQUIRE(save_matrix_file(path, M));
+        M.symmetrize();
+        {
+            auto file = MatrixFile::open(path);
+            REQUIRE(file);
+            REQUIRE(file->n() == n);
+            REQUIRE(file->dtype() == file_dtype::float64);
+            REQUIRE(file->layout() == file_layout::dense);
+
+            // The view symmetrizes the file in place
+            SquareMatrixView<double> V = file->square<double>();
+            V.symmetrize();
+        }
+        auto file = MatrixFile::open(path, false);
+        REQUIRE(file);
+        const SquareMatrixView<double> V = file->square<double>();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(V(i, j) == M(i, j));
+            }
+        }
+    }
+
+    SECTION("packed") {
+        TriMatrix<double> M(elems.data(), n*n);
+        REQUIRE(save_matrix_file(path, M));
+        M.symmetrize();
+        {
+            auto file = MatrixFile::open(path);
+            REQUIRE(file);
+            REQUIRE(file->layout() == file_layout::packed);
+            TriMatrixView<double> V = file->packed<double>();
+            V.symmetrize();
+            REQUIRE(file->sync());
+        }
+        auto file = MatrixFile::open(path, false);
+        REQUIRE(file);
+        const TriMatrixView<double> V = file->packed<double>();
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                CAPTURE(i, j);
+                REQUIRE(V(i, j) == M(i, j));
+            }
+        }
+    }
+
+    SECTION("invalid files") {
+        {
+            std::ofstream ofs(path, std::ofstream::trunc);
+            ofs << "DIM: " << n << "x" << n << std::endl;
+        }
+        CHECK_FALSE(MatrixFile::open(path));
+        CHECK_FALSE(MatrixFile::open(path + ".missing"));
+
+        // Truncated file
+        REQUIRE(save_matrix_file(path, SquareMatrix<double>(elems.data(), n*n)));
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+        CHECK_FALSE(MatrixFile::open(path));
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,284 @@
+#ifndef TILED_H
+#define TILED_H
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "allocator.h"
+#include "blocked.h"
+#include "offsets.h"
+#include "trimatrix.h"
+
+
+namespace asc::pad_ws20::project
+{
+// Square matrix in packed b x b tiles, with the same split as TriMatrix one level up: the
+// diagonal tiles, the tiles below the diagonal in col-major order and the tiles above the
+// diagonal in row-major order, so that tile (I,J) of the lower and (J,I) of the upper triangle
+// have the same index. Each tile is stored contiguously in row-major order, starting on a cache
+// line; tiles at the matrix edge are padded with zeros to b x b.
+//
+// Tiled kernels thereby see contiguous, aligned blocks, as in a dense matrix, while the
+// elementwise kernels of TriMatrix apply to the packed triangles.
+template <typename T, typename Alloc = aligned_allocator<T>>
+class TiledTriMatrix
+{
+    static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
+
+public:
+    typedef T value_type;
+    typedef Alloc allocator_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::ptrdiff_t index_t;
+
+    static constexpr index_t default_tile = detail::tile_size;
+
+    TiledTriMatrix(index_t n, index_t b = default_tile, const Alloc& alloc = Alloc())
+        : _n(n), _b(b), _nt((n + b - 1) / b), _ld(detail::padded<T>(b*b)), _alloc(alloc)
+    {
+        assert(n >= 1);
+        assert(b >= 1);
+        assert(_nt < std::numeric_limits<index_t>::max() / _nt / _ld); // overflow check
+        _tiles = _alloc.allocate(_nt*_nt * _ld);
+        std::fill(_tiles, _tiles + _nt*_nt * _ld, T(0));
+    }
+
+    TiledTriMatrix(T* row_major, index_t length, index_t b = default_tile, const Alloc& alloc = Alloc())
+        : TiledTriMatrix(static_cast<index_t>(std::sqrt(length)), b, alloc)
+    {
+        assert(length == _n*_n);
+
+        #pragma omp parallel for collapse(2) schedule(static)
+        for (index_t I = 0; I < _nt; ++I) {
+            for (index_t J = 0; J < _nt; ++J) {
+                T* t = tile(I, J);
+                for (index_t r = 0; r < rows(I); ++r) {
+                    const T* src = row_major + (I*_b + r)*_n + J*_b;
+                    std::copy(src, src + rows(J), t + r*_b);
+                }
+            }
+        }
+    }
+
+    // Conversion from the packed triangles: upper tiles are copied row by row, lower tiles
+    // column by column, as columns of the lower triangle are contiguous in TriMatrix.
+    template <typename TriAlloc>
+    explicit TiledTriMatrix(const TriMatrix<T, TriAlloc>& packed, index_t b = default_tile,
+                            const Alloc& alloc = Alloc())
+        : TiledTriMatrix(packed.n(), b, alloc)
+    {
+        const T* lower = packed.lower();
+        const T* upper = packed.upper();
+
+        #pragma omp parallel for schedule(dynamic)
+        for (index_t I = 0; I < _nt; ++I) {
+            for (index_t J = 0; J < _nt; ++J) {
+                T* t = tile(I, J);
+                if (I == J) {
+                    for (index_t r = 0; r < rows(I); ++r) {
+                        for (index_t c = 0; c < rows(J); ++c) {
+                            t[r*_b + c] = packed(I*_b + r, J*_b + c);
+                        }
+                    }
+                } else if (I > J) {
+                    for (index_t c = 0; c < rows(J); ++c) {
+                        const T* col = lower + detail::offset_lower_col_major(I*_b, J*_b + c, _n);
+                        for (index_t r = 0; r < rows(I); ++r) {
+                            t[r*_b + c] = col[r];
+                        }
+                    }
+                } else {
+                    for (index_t r = 0; r < rows(I); ++r) {
+                        const T* row = upper + detail::offset_upper_row_major(I*_b + r, J*_b, _n);
+                        std::copy(row, row + rows(J), t + r*_b);
+                    }
+                }
+            }
+        }
+    }
+
+    TiledTriMatrix(const TiledTriMatrix&) = delete;
+    TiledTriMatrix& operator=(const TiledTriMatrix&) = delete;
+
+    TiledTriMatrix(TiledTriMatrix&& other) noexcept
+        : _n(other._n), _b(other._b), _nt(other._nt), _ld(other._ld), _alloc(std::move(other._alloc)),
+          _tiles(std::exchange(other._tiles, nullptr))
+    {}
+
+    TiledTriMatrix& operator=(TiledTriMatrix&& other) noexcept {
+        if (this != &other) {
+            if (_tiles != nullptr) {
+                _alloc.deallocate(_tiles, _nt*_nt * _ld);
+            }
+            _n = other._n;
+            _b = other._b;
+            _nt = other._nt;
+            _ld = other._ld;
+            _alloc = std::move(other._alloc);
+            _tiles = std::exchange(other._tiles, nullptr);
+        }
+        return *this;
+    }
+
+    ~TiledTriMatrix() {
+        if (_tiles != nullptr) {
+            _alloc.deallocate(_tiles, _nt*_nt * _ld);
+        }
+    }
+
+    T operator()(index_t i, index_t j) const
+    {
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+        return tile(i / _b, j / _b)[(i % _b)*_b + j % _b];
+    }
+
+    T& operator()(index_t i, index_t j)
+    {
+        assert(i >= 0 && i < _n);
+        assert(j >= 0 && j < _n);
+        return tile(i / _b, j / _b)[(i % _b)*_b + j % _b];
+    }
+
+    // Tile (I,J): b x b elements in row-major order, aligned to a cache line
+    T* tile(index_t I, index_t J) { return _tiles + tile_index(I, J) * _ld; }
+    const T* tile(index_t I, index_t J) const { return _tiles + tile_index(I, J) * _ld; }
+
+    // Each tile pair (I,J), (J,I) is transposed through 8x8 micro tiles (see blocked.h)
+    void transpose() {
+        pairs(detail::swap_op());
+    }
+
+    void symmetrize() {
+        pairs(detail::average_op());
+    }
+
+    // y = A x, tile by tile
+    void matvec(const T* x, T* y) const {
+        #pragma omp parallel for schedule(static)
+        for (index_t I = 0; I < _nt; ++I) {
+            T* yI = y + I*_b;
+            std::fill(yI, yI + rows(I), T(0));
+            for (index_t J = 0; J < _nt; ++J) {
+                const T* t = tile(I, J);
+                const T* xJ = x + J*_b;
+                for (index_t r = 0; r < rows(I); ++r) {
+                    T s = 0;
+                    #pragma omp simd reduction(+:s)
+                    for (index_t c = 0; c < rows(J); ++c) {
+                        s += t[r*_b + c] * xJ[c];
+                    }
+                    yI[r] += s;
+                }
+            }
+        }
+    }
+
+    // Write all elements in row-major order to row_major, of length n*n
+    void unpack(T* row_major) const {
+        #pragma omp parallel for collapse(2) schedule(static)
+        for (index_t I = 0; I < _nt; ++I) {
+            for (index_t J = 0; J < _nt; ++J) {
+                const T* t = tile(I, J);
+                for (index_t r = 0; r < rows(I); ++r) {
+                    std::copy(t + r*_b, t + r*_b + rows(J), row_major + (I*_b + r)*_n + J*_b);
+                }
+            }
+        }
+    }
+
+    // Write all elements to the packed triangles of a TriMatrix of the same dimension
+    template <typename TriAlloc>
+    void unpack(TriMatrix<T, TriAlloc>& packed) const {
+        assert(packed.n() == _n);
+        T* lower = packed.lower();
+        T* upper = packed.upper();
+
+        #pragma omp parallel for schedule(dynamic)
+        for (index_t I = 0; I < _nt; ++I) {
+            for (index_t J = 0; J < _nt; ++J) {
+                const T* t = tile(I, J);
+                if (I == J) {
+                    for (index_t r = 0; r < rows(I); ++r) {
+                        for (index_t c = 0; c < rows(J); ++c) {
+                            packed(I*_b + r, J*_b + c) = t[r*_b + c];
+                        }
+                    }
+                } else if (I > J) {
+                    for (index_t c = 0; c < rows(J); ++c) {
+                        T* col = lower + detail::offset_lower_col_major(I*_b, J*_b + c, _n);
+                        for (index_t r = 0; r < rows(I); ++r) {
+                            col[r] = t[r*_b + c];
+                        }
+                    }
+                } else {
+                    for (index_t r = 0; r < rows(I); ++r) {
+                        T* row = upper + detail::offset_upper_row_major(I*_b + r, J*_b, _n);
+                        std::copy(t + r*_b, t + r*_b + rows(J), row);
+                    }
+                }
+            }
+        }
+    }
+
+    index_t n() const noexcept { return _n; }
+    index_t tile_dim() const noexcept { return _b; }
+    index_t tiles() const noexcept { return _nt; }
+    allocator_type get_allocator() const { return _alloc; }
+
+private:
+    // Diagonal tiles, then lower tiles (col-major), then upper tiles (row-major)
+    index_t tile_index(index_t I, index_t J) const {
+        assert(I >= 0 && I < _nt);
+        assert(J >= 0 && J < _nt);
+        const index_t t = _nt*(_nt-1) / 2;
+        if (I == J) {
+            return I;
+        } else if (I > J) {
+            return _nt + detail::offset_lower_col_major(I, J, _nt);
+        } else {
+            return _nt + t + detail::offset_upper_row_major(I, J, _nt);
+        }
+    }
+
+    // Rows (or columns) of tile row I which are within the matrix
+    index_t rows(index_t I) const noexcept {
+        return std::min(_b, _n - I*_b);
+    }
+
+    // op(a_ij, a_ji) for all i > j. Padding of edge tiles is only ever combined with padding.
+    template <typename Op>
+    void pairs(Op op) {
+        const index_t t = _nt*(_nt-1) / 2;
+        T* lower = _tiles + _nt*_ld;
+        T* upper = lower + t*_ld;
+
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(static) nowait
+            for (index_t I = 0; I < _nt; ++I) {
+                detail::pairs_block(_tiles + I*_ld, _b, index_t(0), _b, index_t(0), _b, op);
+            }
+            #pragma omp for schedule(static)
+            for (index_t k = 0; k < t; ++k) {
+                detail::pairs_rect(lower + k*_ld, _b, upper + k*_ld, _b, _b, _b, op);
+            }
+        }
+    }
+
+    index_t _n;
+    index_t _b;  // tile dimension
+    index_t _nt; // tiles per row or column
+    index_t _ld; // distance between tiles
+    Alloc _alloc;
+    T* _tiles = nullptr;
+};
+
+} // namespace asc::pad_ws20::project
+
+#endif // TILED_H
@@ -1,62 +1,64 @@
 #ifndef TRIMATRIX_H
 #define TRIMATRIX_H
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <memory>
 #include <type_traits>
 #include <limits>
 #include <iostream>
+#include <utility>
 
+#include "allocator.h"
+#include "dirty.h"
 #include "offsets.h"
+#include "packing.h"
 
 
 namespace asc::pad_ws20::project
 {
-template <typename T>
+// Storage of diagonal, lower and upper triangle: one allocation, with every array starting on
+// a cache line (default), or one allocation per array.
+enum class tri_layout { contiguous, separate };
+
+// Tag for constructing a TriMatrix from arrays it takes ownership of
+struct adopt_arrays_t {};
+inline constexpr adopt_arrays_t adopt_arrays{};
+
+template <typename T, typename Alloc = aligned_allocator<T>>
 class TriMatrix
 {
     static_assert(std::is_arithmetic_v<T>);
+    static_assert(std::is_same_v<typename Alloc::value_type, T>);
 
 public:
     typedef T value_type;
+    typedef Alloc allocator_type;
     typedef std::ptrdiff_t difference_type;
     typedef std::ptrdiff_t index_t;
 
-    TriMatrix(index_t n) 
-        : _n(n), _t(n*(n-1) / 2)
+    TriMatrix(index_t n, tri_layout layout = tri_layout::contiguous, const Alloc& alloc = Alloc())
+        : _n(n), _t(n*(n-1) / 2), _layout(layout), _alloc(alloc)
     {
         assert(n >= 1);
-        assert(n < std::numeric_limits<index_t>::max() / (n - 1));
-        _diag = std::unique_ptr<T>(new T[_n]);
-
-        if (_t > 0) {
-            _lower = std::unique_ptr<T>(new T[_t]);
-            _upper = std::unique_ptr<T>(new T[_t]);
-        }
+        assert(n == 1 || n < std::numeric_limits<index_t>::max() / (n - 1));
+        allocate();
     }
- 
+
     TriMatrix(T* diag, index_t n, T* lower, T* upper, index_t t)
         : _n(n), _t(t)
     {
         assert(_n >= 1);
         assert(_t == _n*(_n-1) / 2);
-        _diag = std::unique_ptr<T>(new T[_n]);
+        allocate();
 
-        T* _d = _diag.get();
         for (index_t i = 0; i < _n; ++i) {
-            _d[i] = diag[i];
+            _diag[i] = diag[i];
         }
-        
-        if (_t > 0) {
-            _lower = std::unique_ptr<T>(new T[_t]);
-            _upper = std::unique_ptr<T>(new T[_t]);
-
-            T* _l = _lower.get();
-            T* _u = _upper.get();
-            for (index_t k = 0; k < _t; ++k) {
-                _l[k] = lower[k];
-                _u[k] = upper[k];
-            }
+        for (index_t k = 0; k < _t; ++k) {
+            _lower[k] = lower[k];
+            _upper[k] = upper[k];
         }
     }
 
@@ -64,43 +66,51 @@ public:
     {
         assert(length >= 1);
         _n = static_cast<index_t>(std::sqrt(length));
-        
+
         assert(length == _n*_n);
+        assert(_n == 1 || _n < std::numeric_limits<index_t>::max() / (_n - 1));
         _t = _n*(_n-1) / 2;
-        _diag = std::unique_ptr<T>(new T[_n]);
+        allocate();
 
-        if (_n >= 2) {
-            assert(_n < std::numeric_limits<index_t>::max() / (_n - 1));
-            _lower = std::unique_ptr<T>(new T[_t]);
-            _upper = std::unique_ptr<T>(new T[_t]);
-        } else {
-            _diag.get()[0] = row_major[0];
-            return;
-        }
-        
-        T* _l = _lower.get();
-        T* _d = _diag.get();
-        T* _u = _upper.get();
-
-        for (index_t k = 0; k < length; ++k) {
-            index_t j = k % _n;
-            index_t i = (k - j) / _n;
-
-            if (i == j) {
-                _d[i] = row_major[k];
-            } else if (j < i) {
-                _l[detail::offset_lower_col_major(i, j, _n)] = row_major[k];
-            } else {
-                _u[detail::offset_upper_row_major(i, j, _n)] = row_major[k];
-            }
-        }
+        detail::pack_row_major(row_major, _n, _diag, _lower, _upper);
+    }
+
+    // Take ownership of already packed arrays, without copying: diag of length n, lower
+    // (col-major) and upper (row-major) of length n*(n-1)/2, each obtained from alloc.
+    TriMatrix(adopt_arrays_t, T* diag, T* lower, T* upper, index_t n, const Alloc& alloc = Alloc())
+        : _n(n), _t(n*(n-1) / 2), _layout(tri_layout::separate), _alloc(alloc),
+          _diag(diag), _lower(lower), _upper(upper)
+    {
+        assert(_n >= 1);
+        assert(_diag != nullptr);
+        assert(_t == 0 || (_lower != nullptr && _upper != nullptr));
     }
 
     TriMatrix(const TriMatrix&) = delete;
     TriMatrix& operator=(const TriMatrix&) = delete;
-    TriMatrix(TriMatrix&&) = default;
-    TriMatrix& operator=(TriMatrix&&) = default;
-    ~TriMatrix() = default;
+
+    TriMatrix(TriMatrix&& other) noexcept
+        : _n(other._n), _t(other._t), _layout(other._layout), _alloc(std::move(other._alloc)),
+          _diag(std::exchange(other._diag, nullptr)),
+          _lower(std::exchange(other._lower, nullptr)),
+          _upper(std::exchange(other._upper, nullptr))
+    {}
+
+    TriMatrix& operator=(TriMatrix&& other) noexcept {
+        if (this != &other) {
+            deallocate();
+            _n = other._n;
+            _t = other._t;
+            _layout = other._layout;
+            _alloc = std::move(other._alloc);
+            _diag = std::exchange(other._diag, nullptr);
+            _lower = std::exchange(other._lower, nullptr);
+            _upper = std::exchange(other._upper, nullptr);
+        }
+        return *this;
+    }
+
+    ~TriMatrix() { deallocate(); }
 
     T operator()(index_t i, index_t j) const
     {
@@ -108,11 +118,11 @@ public:
         assert(j >= 0 && j < _n);
 
         if (i == j) {
-            return _diag.get()[i];
+            return _diag[i];
         } else if (i > j) { // row-major order
-            return _lower.get()[detail::offset_lower_col_major(i, j, _n)];
+            return _lower[detail::offset_lower_col_major(i, j, _n)];
         } else { // j > i
-            return _upper.get()[detail::offset_upper_row_major(i, j, _n)];
+            return _upper[detail::offset_upper_row_major(i, j, _n)];
         }
     }
 
@@ -122,21 +132,21 @@ public:
         assert(j >= 0 && j < _n);
 
         if (i == j) {
-            return _diag.get()[i];
+            return _diag[i];
         } else if (i > j) { // row-major order
-            return _lower.get()[detail::offset_lower_col_major(i, j, _n)];
+            return _lower[detail::offset_lower_col_major(i, j, _n)];
         } else { // j > i
-            return _upper.get()[detail::offset_upper_row_major(i, j, _n)];
+            return _upper[detail::offset_upper_row_major(i, j, _n)];
         }
     }
 
     void transpose() {
-        _lower.swap(_upper);
+        std::swap(_lower, _upper);
     }
 
     void symmetrize() {
-        T* _l = _lower.get();
-        T* _u = _upper.get();
+        T* _l = _lower;
+        T* _u = _upper;
 
         for (index_t i = 0; i < _t; ++i) {
             T s = (_l[i] + _u[i]) / 2.;
@@ -144,28 +154,113 @@ public:
             _u[i] = s;
         }
     }
-    
-    T* diag()  { return _diag.get(); }
-    T* lower() { return _lower.get(); }
-    T* upper() { return _upper.get(); }
+
+    // Only the tile pairs of which a tile is marked in dirty. Columns of a tile in the lower
+    // triangle, and the matching rows of its mirror in the upper triangle, are contiguous.
+    void symmetrize(const DirtyTiles& dirty) {
+        assert(dirty.rows() == _n && dirty.cols() == _n);
+        const auto pairs = dirty.pairs();
+        const index_t b = dirty.tile_dim();
+        T* _l = _lower;
+        T* _u = _upper;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t p = 0; p < pairs.size(); ++p) {
+            const index_t i0 = pairs[p].first * b;
+            const index_t j0 = pairs[p].second * b;
+            const index_t i1 = std::min(i0 + b, _n);
+            const index_t j1 = std::min(j0 + b, _n);
+
+            for (index_t j = j0; j < j1; ++j) {
+                // Rows below the diagonal only, for diagonal tiles
+                const index_t i = std::max(i0, j + 1);
+                if (i >= i1) {
+                    continue;
+                }
+                const index_t k0 = detail::offset_lower_col_major(i, j, _n);
+                #pragma omp simd
+                for (index_t k = k0; k < k0 + (i1 - i); ++k) {
+                    T s = (_l[k] + _u[k]) / 2.;
+                    _l[k] = s;
+                    _u[k] = s;
+                }
+            }
+        }
+    }
+
+    // Write all elements in row-major order to row_major, of length n*n
+    void unpack(T* row_major) const {
+        detail::unpack_row_major(_diag, _lower, _upper, _n, row_major);
+    }
+
+    T* diag()  { return _diag; }
+    T* lower() { return _lower; }
+    T* upper() { return _upper; }
+    const T* diag()  const { return _diag; }
+    const T* lower() const { return _lower; }
+    const T* upper() const { return _upper; }
 
     index_t n() const noexcept { return _n; }
     index_t t() const noexcept { return _t; }
     index_t s() const noexcept { return _n + 2*_t; }
+    tri_layout layout() const noexcept { return _layout; }
+    allocator_type get_allocator() const { return _alloc; }
 
 private:
+    // Size of the single allocation in the contiguous layout
+    index_t buffer_size() const noexcept {
+        return detail::padded<T>(_n) + 2*detail::padded<T>(_t);
+    }
+
+    void allocate() {
+        if (_layout == tri_layout::contiguous) {
+            _diag = _alloc.allocate(buffer_size());
+            if (_t > 0) {
+                _lower = _diag + detail::padded<T>(_n);
+                _upper = _lower + detail::padded<T>(_t);
+            }
+        } else {
+            _diag = _alloc.allocate(_n);
+            if (_t > 0) {
+                _lower = _alloc.allocate(_t);
+                _upper = _alloc.allocate(_t);
+            }
+        }
+    }
+
+    void deallocate() noexcept {
+        if (_diag == nullptr) {
+            return; // moved from
+        }
+        if (_layout == tri_layout::contiguous) {
+            _alloc.deallocate(_diag, buffer_size());
+        } else {
+            _alloc.deallocate(_diag, _n);
+            if (_t > 0) {
+                _alloc.deallocate(_lower, _t);
+                _alloc.deallocate(_upper, _t);
+            }
+        }
+    }
+
     index_t _n;
     index_t _t;
+    tri_layout _layout = tri_layout::contiguous;
+    Alloc _alloc;
 
     // For symmetrization of a square matrix, we consider three arrays:
     // - one holding the lower triangle, in col-major order;
     // - one holding the upper triangle, in row-major order;
     // - one holding the diagonal.
-    std::unique_ptr<T> _diag;
-    std::unique_ptr<T> _lower;
-    std::unique_ptr<T> _upper;
+    T* _diag = nullptr;
+    T* _lower = nullptr;
+    T* _upper = nullptr;
 };
 
+// TriMatrix over arrays owned by someone else, e.g. a mapped file
+template <typename T>
+using TriMatrixView = TriMatrix<T, non_owning_allocator<T>>;
+
 } // namespace asc::pad_ws20::upcxx
 
 #endif // TRIMATRIX_H
@@ -0,0 +1,217 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <vector>
+
+#include "blocked.h"
+#include "matrix.h"
+#include "offsets.h"
+#include "trimatrix.h"
+
+
+namespace asc::pad_ws20::project
+{
+namespace detail
+{
+template <typename Matrix>
+struct is_trimatrix : std::false_type {};
+
+template <typename T, typename Alloc>
+struct is_trimatrix<TriMatrix<T, Alloc>> : std::true_type {};
+
+// Assign the mirror a_ji to every a_ij with j < i
+struct mirror_op {
+    template <typename T>
+    void operator()(T& lower, T& upper) const {
+        lower = upper;
+    }
+};
+
+} // namespace detail
+
+// Read-only view of the symmetric part (A + A^T) / 2 of a TriMatrix or SquareMatrix, which is
+// computed on access instead of being written back to the matrix. Pipelines which read the
+// symmetrized matrix once thereby save the write pass of symmetrize(), and may read only the
+// parts they need. The view does not own the matrix, which must outlive it.
+template <typename Matrix>
+class SymmetrizedView
+{
+public:
+    typedef typename Matrix::value_type value_type;
+    typedef std::ptrdiff_t index_t;
+
+    explicit SymmetrizedView(const Matrix& M) : _mat(M), _n(M.n()) {}
+
+    value_type operator()(index_t i, index_t j) const
+    {
+        if (i == j) {
+            return _mat(i, i);
+        }
+        return (_mat(i, j) + _mat(j, i)) / 2;
+    }
+
+    // Columns [j0, j1) of row i, written to out
+    void row(index_t i, value_type* out, index_t j0, index_t j1) const
+    {
+        assert(i >= 0 && i < _n);
+        assert(j0 >= 0 && j0 <= j1 && j1 <= _n);
+        using T = value_type;
+
+        if constexpr (detail::is_trimatrix<Matrix>::value) {
+            // Left of the diagonal, (i,j) and (j,i) have the same offset in lower and upper,
+            // which is strided along a row
+            const T* lower = _mat.lower();
+            const T* upper = _mat.upper();
+            const index_t left = std::min(j1, i);
+            for (index_t j = j0; j < left; ++j) {
+                const index_t k = detail::offset_lower_col_major(i, j, _n);
+                out[j - j0] = (lower[k] + upper[k]) / 2;
+            }
+            row_right(i, out, j0, j1);
+        } else {
+            const T* a = _mat.elements();
+            const T* r = a + i*_n;
+            #pragma omp simd
+            for (index_t j = j0; j < j1; ++j) {
+                out[j - j0] = (r[j] + a[j*_n + i]) / 2;
+            }
+            if (j0 <= i && i < j1) {
+                out[i - j0] = r[i];
+            }
+        }
+    }
+
+    void row(index_t i, value_type* out) const { row(i, out, 0, _n); }
+
+    // Block of rows [i0, i0+rows) and columns [j0, j0+cols), written to out with row stride ld.
+    // For a TriMatrix, the part left of the diagonal is filled column by column, as columns of
+    // the lower triangle (and the same offsets of the upper one) are contiguous.
+    void tile(index_t i0, index_t j0, index_t rows, index_t cols, value_type* out, index_t ld) const
+    {
+        if constexpr (detail::is_trimatrix<Matrix>::value) {
+            using T = value_type;
+            const T* lower = _mat.lower();
+            const T* upper = _mat.upper();
+            const index_t i1 = i0 + rows;
+            const index_t j1 = j0 + cols;
+
+            for (index_t i = i0; i < i1; ++i) {
+                row_right(i, out + (i - i0)*ld, j0, j1);
+            }
+            for (index_t j = j0; j < std::min(j1, i1 - 1); ++j) {
+                const index_t begin = std::max(i0, j + 1);
+                const index_t k0 = detail::offset_lower_col_major(begin, j, _n);
+                T* o = out + (begin - i0)*ld + (j - j0);
+                for (index_t k = 0; k < i1 - begin; ++k) {
+                    o[k*ld] = (lower[k0 + k] + upper[k0 + k]) / 2;
+                }
+            }
+        } else {
+            for (index_t r = 0; r < rows; ++r) {
+                row(i0 + r, out + r*ld, j0, j0 + cols);
+            }
+        }
+    }
+
+    // Call f(i, row) for every row i, with the symmetrized row in a buffer reused between calls.
+    // For a TriMatrix, the part of each row left of the diagonal is gathered with stride;
+    // for_each_tile() reads the lower triangle by contiguous columns instead.
+    template <typename F>
+    void for_each_row(F&& f) const
+    {
+        std::vector<value_type> buf(_n);
+        for (index_t i = 0; i < _n; ++i) {
+            row(i, buf.data());
+            f(i, static_cast<const value_type*>(buf.data()));
+        }
+    }
+
+    // Call f(I, J, tile) for every b x b tile (smaller at the edge), in row-major order of tiles;
+    // tile has row stride b.
+    template <typename F>
+    void for_each_tile(index_t b, F&& f) const
+    {
+        std::vector<value_type> buf(b*b);
+        for (index_t i0 = 0; i0 < _n; i0 += b) {
+            for (index_t j0 = 0; j0 < _n; j0 += b) {
+                tile(i0, j0, std::min(b, _n - i0), std::min(b, _n - j0), buf.data(), b);
+                f(i0 / b, j0 / b, static_cast<const value_type*>(buf.data()));
+            }
+        }
+    }
+
+    // Write the whole symmetrized matrix in row-major order to row_major, of length n*n. For a
+    // TriMatrix, the upper triangle is computed row by row from contiguous rows and columns, and
+    // mirrored into the lower triangle in tiles. For a SquareMatrix, the matrix is copied and
+    // symmetrized in place: averaging tile pairs directly into a second array is about 3 times
+    // slower for n = 4096, as rows of both arrays compete for the same cache sets.
+    void materialize(value_type* row_major) const
+    {
+        if constexpr (detail::is_trimatrix<Matrix>::value) {
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (index_t i = 0; i < _n; ++i) {
+                row(i, row_major + i*_n + i, i, _n);
+            }
+            detail::pairs_tiled_parallel(row_major, _n, detail::mirror_op());
+        } else {
+            const value_type* a = _mat.elements();
+
+            #pragma omp parallel for schedule(static)
+            for (index_t i = 0; i < _n; ++i) {
+                std::copy(a + i*_n, a + (i + 1)*_n, row_major + i*_n);
+            }
+            detail::pairs_tiled_parallel(row_major, _n, detail::average_op());
+        }
+    }
+
+    // Write the diagonal and the symmetrized lower triangle (col-major), as stored by SymMatrix
+    template <typename M = Matrix, typename = std::enable_if_t<detail::is_trimatrix<M>::value>>
+    void materialize(value_type* diag, value_type* lower) const
+    {
+        const value_type* l = _mat.lower();
+        const value_type* u = _mat.upper();
+        const index_t t = _mat.t();
+        std::copy(_mat.diag(), _mat.diag() + _n, diag);
+
+        #pragma omp parallel for simd schedule(static)
+        for (index_t k = 0; k < t; ++k) {
+            lower[k] = (l[k] + u[k]) / 2;
+        }
+    }
+
+    index_t n() const noexcept { return _n; }
+
+private:
+    // Columns [max(j0, i), j1) of row i of a TriMatrix, on and right of the diagonal, written to
+    // out[j - j0]; row i of the upper and column i of the lower triangle are both contiguous.
+    void row_right(index_t i, value_type* out, index_t j0, index_t j1) const
+    {
+        using T = value_type;
+        if (j0 <= i && i < j1) {
+            out[i - j0] = _mat.diag()[i];
+        }
+        const index_t right = std::max(j0, i + 1);
+        if (right < j1) {
+            const T* l = _mat.lower() + detail::offset_lower_col_major(right, i, _n);
+            const T* u = _mat.upper() + detail::offset_upper_row_major(i, right, _n);
+            T* o = out + (right - j0);
+            #pragma omp simd
+            for (index_t k = 0; k < j1 - right; ++k) {
+                o[k] = (l[k] + u[k]) / 2;
+            }
+        }
+    }
+
+    const Matrix& _mat;
+    index_t _n;
+};
+
+template <typename Matrix>
+SymmetrizedView(const Matrix&) -> SymmetrizedView<Matrix>;
+
+} // namespace asc::pad_ws20::project
+
+#endif // VIEW_H
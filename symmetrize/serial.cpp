@@ -8,10 +8,16 @@
 #include <vector>
 #include <chrono>
 #include <filesystem>
+#include <iomanip>
+#include <optional>
 
 #include <cstdlib>
 #include <lyra/lyra.hpp>
 
+#include "matrix/mapped.h"
+#include "matrix/pairwise.h"
+#include "matrix/symmatrix.h"
+
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
 
@@ -20,26 +26,38 @@ using timePoint = std::chrono::time_point<T>;
 using index_t = std::ptrdiff_t;
 
 template <typename T>
-std::ostream& dump_vector(std::ostream& stream, const std::vector<T>& v, const char* label) {
-    size_t n = v.size();
+std::ostream& dump_array(std::ostream& stream, const T* a, size_t n, const char* label) {
     if (stream) {
         stream << label;
         for (size_t i = 0; i < n - 1; ++i) {
-            stream << v[i] << " ";
+            stream << a[i] << " ";
         }
-        stream << v[n - 1] << std::endl;
+        stream << a[n - 1] << std::endl;
     }
     return stream;
 }
 
+template <typename T>
+std::ostream& dump_vector(std::ostream& stream, const std::vector<T>& v, const char* label) {
+    return dump_array(stream, v.data(), v.size(), label);
+}
+
 int main(int argc, char** argv) {
     index_t dim = 0;   // amount of rows/columns
     int seed = 42;  // seed for pseudo-random generator
     bool bench = false;
     bool write = false;
+    bool spmv = false;
+    std::string op_name = "symmetrize";
+    float alpha = 1, beta = 1; // coefficients of --op axpby
+    std::string input_path; // binary matrix file, operated on in place
+    std::string save_path;  // binary matrix file, written before the operation
+    bool save_dense = false;
     bool show_help = false;
     std::filesystem::path file_path("serial_matrix.txt");
     std::filesystem::path file_path_sym("serial_matrix_symmetrized.txt");
+    std::filesystem::path file_path_spmv("serial_spmv.txt");
+    std::filesystem::path file_path_norm("serial_norm.txt");
 
     auto cli = lyra::help(show_help) |
         lyra::opt(dim, "dim")["-N"]["--dim"](
@@ -49,7 +67,21 @@ int main(int argc, char** argv) {
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(write)["--write"](
-            "Serialize matrix before and after symmetrization");
+            "Serialize matrix before and after symmetrization") |
+        lyra::opt(spmv)["--spmv"](
+            "Compute y = A x with the symmetrized matrix, and serialize y (with --write)") |
+        lyra::opt(op_name, "op")["--op"](
+            "Operation on the triangles: symmetrize (default), skew, sum, axpby, asymmetry or symmetrize-asymmetry; the norm ||A - A^T|| of the last two is serialized with --write") |
+        lyra::opt(alpha, "alpha")["--alpha"](
+            "Coefficient of A for --op axpby, default is 1") |
+        lyra::opt(beta, "beta")["--beta"](
+            "Coefficient of A^T for --op axpby, default is 1") |
+        lyra::opt(input_path, "file")["--input"](
+            "Operate in place on the matrix in file (binary format, float elements, mapped into memory) instead of a generated one; the dimension is that of the file") |
+        lyra::opt(save_path, "file")["--save"](
+            "Write the generated matrix to file in binary format (packed triangles) before the operation") |
+        lyra::opt(save_dense)["--dense"](
+            "Write the matrix of --save as a dense row-major matrix");
     auto result = cli.parse({argc, argv});
 
     if (!result) {
@@ -61,10 +93,42 @@ int main(int argc, char** argv) {
 		std::cout << cli << std::endl;
 		exit(0);
 	}
+    if (!input_path.empty() && !save_path.empty()) {
+        std::cerr << "--input cannot be combined with --save" << std::endl;
+        std::exit(1);
+    }
+    std::optional<asc::pad_ws20::project::MatrixFile> input;
+    if (!input_path.empty()) {
+        input = asc::pad_ws20::project::MatrixFile::open(input_path);
+        if (!input) {
+            std::cerr << "cannot map matrix file " << input_path << std::endl;
+            std::exit(1);
+        }
+        if (input->dtype() != asc::pad_ws20::project::file_dtype::float32) {
+            std::cerr << "matrix file " << input_path << " does not hold float elements" << std::endl;
+            std::exit(1);
+        }
+        dim = input->n();
+    }
     if (dim <= 0) {
         std::cerr << "positive dimension required (specify with --dim)" << std::endl;
         std::exit(1);
     }
+    // A dense file is symmetrized with the tiled kernel of SquareMatrix
+    const bool dense = input && input->layout() == asc::pad_ws20::project::file_layout::dense;
+    const auto op = asc::pad_ws20::project::parse_pair_op(op_name);
+    if (!op) {
+        std::cerr << "unknown operation " << op_name << std::endl;
+        std::exit(1);
+    }
+    if (spmv && *op != asc::pad_ws20::project::pair_op::symmetrize) {
+        std::cerr << "--spmv requires --op symmetrize" << std::endl;
+        std::exit(1);
+    }
+    if (dense && (spmv || *op != asc::pad_ws20::project::pair_op::symmetrize)) {
+        std::cerr << "a dense matrix file can only be symmetrized" << std::endl;
+        std::exit(1);
+    }
     const index_t triangle_size = dim*(dim - 1) / 2;
     const index_t diag_size = dim;
     
@@ -74,17 +138,58 @@ int main(int argc, char** argv) {
     // - one holding the diagonal.
     //
     // Symmetrization does not modify the diagonal, so it could be left out.
-    std::vector<float> lower(triangle_size);
-    std::vector<float> upper(triangle_size);
-    std::vector<float> diag(diag_size);
-    
-    std::mt19937_64 rgen(seed);
-    for (index_t i = 0; i < triangle_size; ++i) {
-        lower[i] = 0.5 + rgen() % 100;
-        upper[i] = 1.0 + rgen() % 100;
+    //
+    // With --input, the arrays are those of the mapped file (packed), or of a copy of the
+    // dense matrix in the file for --write.
+    std::vector<float> lower_v, upper_v, diag_v;
+    float* lower = nullptr;
+    float* upper = nullptr;
+    float* diag = nullptr;
+    std::optional<asc::pad_ws20::project::TriMatrixView<float>> packed_view;
+    std::optional<asc::pad_ws20::project::SquareMatrixView<float>> dense_view;
+    std::optional<asc::pad_ws20::project::TriMatrix<float>> dense_copy;
+
+    if (dense) {
+        dense_view.emplace(input->square<float>());
+        if (write) {
+            dense_copy.emplace(dense_view->elements(), dim*dim);
+            lower = dense_copy->lower();
+            upper = dense_copy->upper();
+            diag = dense_copy->diag();
+        }
+    } else if (input) {
+        packed_view.emplace(input->packed<float>());
+        lower = packed_view->lower();
+        upper = packed_view->upper();
+        diag = packed_view->diag();
+    } else {
+        lower_v.resize(triangle_size);
+        upper_v.resize(triangle_size);
+        diag_v.resize(diag_size);
+        lower = lower_v.data();
+        upper = upper_v.data();
+        diag = diag_v.data();
+
+        std::mt19937_64 rgen(seed);
+        for (index_t i = 0; i < triangle_size; ++i) {
+            lower[i] = 0.5 + rgen() % 100;
+            upper[i] = 1.0 + rgen() % 100;
+        }
+        for (index_t i = 0; i < diag_size; ++i) {
+            diag[i] = i + 1;
+        }
     }
-    for (index_t i = 0; i < diag_size; ++i) {
-        diag[i] = i + 1;
+
+    if (!save_path.empty()) {
+        asc::pad_ws20::project::TriMatrixView<float> M(asc::pad_ws20::project::adopt_arrays,
+                                                       diag, lower, upper, dim);
+        bool saved = save_dense
+            ? asc::pad_ws20::project::save_matrix_file(save_path, asc::pad_ws20::project::SquareMatrix<float>(M))
+            : asc::pad_ws20::project::save_matrix_file(save_path, M);
+        if (!saved) {
+            std::cerr << "cannot write matrix file " << save_path << std::endl;
+            std::exit(1);
+        }
     }
 
     // Seralize original matrix
@@ -93,9 +198,9 @@ int main(int argc, char** argv) {
 
         if (stream) {
             stream << "DIM: " << dim << "x" << dim << std::endl;
-            dump_vector(stream, lower, "LOWER (C-m): ");
-            dump_vector(stream, diag, "DIAG: ");
-            dump_vector(stream, upper, "UPPER (R-m): ");
+            dump_array(stream, lower, triangle_size, "LOWER (C-m): ");
+            dump_array(stream, diag, diag_size, "DIAG: ");
+            dump_array(stream, upper, triangle_size, "UPPER (R-m): ");
         }
     }
 
@@ -103,12 +208,13 @@ int main(int argc, char** argv) {
     timePoint<Clock> t = Clock::now();
 
     // Because lower and upper triangle and stored symmetricaly, we can symmetrize
-    // the matrix as a SAXPY operation (over the lower and upper triangle) in a
-    // single for loop.
-    for (index_t i = 0; i < triangle_size; ++i) {
-        double s = (lower[i] + upper[i]) / 2;
-        lower[i] = s;
-        upper[i] = s;
+    // the matrix (or apply another operation on pairs a_ij, a_ji) in a single loop
+    // over the lower and upper triangle.
+    double half_sq = 0;
+    if (dense) {
+        dense_view->symmetrize();
+    } else {
+        half_sq = asc::pad_ws20::project::apply_pair_op(*op, lower, upper, triangle_size, alpha, beta);
     }
 
     Duration d = Clock::now() - t;
@@ -118,13 +224,40 @@ int main(int argc, char** argv) {
 
     // Serialize new (symmetrized) matrix
     if (write) {
+        if (dense) {
+            dense_copy.emplace(dense_view->elements(), dim*dim);
+            lower = dense_copy->lower();
+            upper = dense_copy->upper();
+            diag = dense_copy->diag();
+        }
         std::ofstream stream{file_path_sym.c_str()};
 
         if (stream) {
             stream << "DIM: " << dim << "x" << dim << std::endl;
-            dump_vector(stream, lower, "LOWER (C-m): ");
-            dump_vector(stream, diag, "DIAG: ");
-            dump_vector(stream, upper, "UPPER (R-m): ");
+            dump_array(stream, lower, triangle_size, "LOWER (C-m): ");
+            dump_array(stream, diag, diag_size, "DIAG: ");
+            dump_array(stream, upper, triangle_size, "UPPER (R-m): ");
         }
     }
-}
\ No newline at end of file
+
+    if (write && asc::pad_ws20::project::pair_op_has_norm(*op)) {
+        std::ofstream stream{file_path_norm.c_str()};
+        stream << "NORM: " << std::setprecision(17) << asc::pad_ws20::project::asymmetry_norm(half_sq) << std::endl;
+    }
+
+    // Product with the symmetrized matrix, using only diagonal and lower triangle. x is chosen
+    // as in the parallel implementation, so that the results can be compared.
+    if (spmv) {
+        std::vector<float> x(dim), y(dim);
+        for (index_t i = 0; i < dim; ++i) {
+            x[i] = i % 10;
+            y[i] = diag[i] * x[i];
+        }
+        asc::pad_ws20::project::detail::spmv_lower(lower, 0, triangle_size, dim, x.data(), y.data());
+
+        if (write) {
+            std::ofstream stream{file_path_spmv.c_str()};
+            dump_vector(stream, y, "Y: ");
+        }
+    }
+}
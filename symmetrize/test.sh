@@ -15,11 +15,20 @@ mkdir build-test
 cd build-test
 
 UPCXX_NETWORK=smp cmake -DCMAKE_BUILD_TYPE=Release ../..
-ninja -v symmetrize symmetrize-upcxx symmetrize-upcxx-openmp
+ninja -v symmetrize symmetrize-upcxx symmetrize-upcxx-dense symmetrize-upcxx-openmp
 
 for exp in {5..14}; do
     dim=$((1<<exp))
-    symmetrize/symmetrize --dim "$dim" --write
+    symmetrize/symmetrize --dim "$dim" --write --spmv
+
+    # Binary files, symmetrized in place through a mapping
+    cp 'serial_matrix_symmetrized.txt' 'serial_matrix_symmetrized_ref.txt'
+    for layout in '' '--dense'; do
+        symmetrize/symmetrize --dim "$dim" --save 'serial_matrix.bin' $layout
+        symmetrize/symmetrize --input 'serial_matrix.bin' --write
+
+        diff -q 'serial_matrix_symmetrized_ref.txt' 'serial_matrix_symmetrized.txt'
+    done
 
     for i in $(seq 1 "$num_repeats"); do
         printf >&2 'symmetrize-upcxx, dimension %d, iteration %d\n' "$dim" "$i"
@@ -29,11 +38,78 @@ for exp in {5..14}; do
         diff -q 'serial_matrix.txt' 'upcxx_matrix.txt'
         diff -q 'serial_matrix_symmetrized.txt' 'upcxx_matrix_symmetrized.txt'
 
+        for dist in '--scatter' '--broadcast'; do
+            upcxx-run -n 4 -shared-heap 50% \
+                symmetrize/symmetrize-upcxx --dim "$dim" --write $dist
+
+            diff -q 'serial_matrix.txt' 'upcxx_matrix.txt'
+            diff -q 'serial_matrix_symmetrized.txt' 'upcxx_matrix_symmetrized.txt'
+        done
+
+        # Products are exact (independent of summation order) up to dimension 4096
+        if ((exp <= 12)); then
+            upcxx-run -n 4 -shared-heap 50% \
+                symmetrize/symmetrize-upcxx --dim "$dim" --write --spmv
+
+            diff -q 'serial_spmv.txt' 'upcxx_spmv.txt'
+        fi
+
+        printf >&2 'symmetrize-upcxx-dense, dimension %d, iteration %d\n' "$dim" "$i"
+        upcxx-run -n 4 -shared-heap 50% \
+            symmetrize/symmetrize-upcxx-dense --dim "$dim" --write
+
+        diff -q 'serial_matrix.txt' 'upcxx_dense_matrix.txt'
+        diff -q 'serial_matrix_symmetrized.txt' 'upcxx_dense_matrix_symmetrized.txt'
+
+        upcxx-run -n 4 -shared-heap 50% \
+            symmetrize/symmetrize-upcxx-dense --dim "$dim" --write --packed
+
+        diff -q 'serial_matrix_symmetrized.txt' 'upcxx_dense_matrix_symmetrized.txt'
+
+        for dist in '--scatter' '--broadcast'; do
+            upcxx-run -n 4 -shared-heap 50% \
+                symmetrize/symmetrize-upcxx-dense --dim "$dim" --write $dist
+
+            diff -q 'serial_matrix.txt' 'upcxx_dense_matrix.txt'
+            diff -q 'serial_matrix_symmetrized.txt' 'upcxx_dense_matrix_symmetrized.txt'
+        done
+
+        # Incremental symmetrization, compared with a full one of the same updated matrix
+        upcxx-run -n 4 -shared-heap 50% \
+            symmetrize/symmetrize-upcxx-dense --dim "$dim" --update 0.05 --iterations 3 --check
+
         printf >&2 'symmetrize-upcxx-openmp, dimension %d, iteration %d\n' "$dim" "$i"
         upcxx-run -n 4 -shared-heap 50% \
             env OMP_NUM_THREADS=4 symmetrize/symmetrize-upcxx-openmp --dim "$dim" --write
 
         diff -q 'serial_matrix.txt' 'openmp_matrix.txt' # assumes implicit rounding by output stream
         diff -q 'serial_matrix_symmetrized.txt' 'openmp_matrix_symmetrized.txt'
+
+        upcxx-run -n 4 -shared-heap 50% \
+            env OMP_NUM_THREADS=4 symmetrize/symmetrize-upcxx-openmp --dim "$dim" --write --interleaved
+
+        diff -q 'serial_matrix_symmetrized.txt' 'openmp_matrix_symmetrized.txt'
+    done
+done
+
+# Other operations on the triangles; norms of half-integer differences are exact in double
+for exp in {5..10}; do
+    dim=$((1<<exp))
+    for op in skew axpby symmetrize-asymmetry; do
+        printf >&2 'operation %s, dimension %d\n' "$op" "$dim"
+        symmetrize/symmetrize --dim "$dim" --write --op "$op" --alpha 2 --beta 0.5
+
+        upcxx-run -n 4 -shared-heap 50% \
+            symmetrize/symmetrize-upcxx --dim "$dim" --write --op "$op" --alpha 2 --beta 0.5
+        diff -q 'serial_matrix_symmetrized.txt' 'upcxx_matrix_symmetrized.txt'
+
+        upcxx-run -n 4 -shared-heap 50% \
+            env OMP_NUM_THREADS=4 symmetrize/symmetrize-upcxx-openmp --dim "$dim" --write --op "$op" --alpha 2 --beta 0.5
+        diff -q 'serial_matrix_symmetrized.txt' 'openmp_matrix_symmetrized.txt'
+
+        if [[ $op == symmetrize-asymmetry ]]; then
+            diff -q 'serial_norm.txt' 'upcxx_norm.txt'
+            diff -q 'serial_norm.txt' 'openmp_norm.txt'
+        fi
     done
 done
@@ -9,12 +9,23 @@
 #include <fstream>
 #include <chrono>
 #include <vector>
+#include <optional>
 #include <algorithm>
 #include <filesystem>
+#include <iomanip>
 
 #include <upcxx/upcxx.hpp>
 #include <lyra/lyra.hpp>
 
+#include "include/scatter-upcxx.hpp"
+#include "include/spmv-upcxx.hpp"
+#include "matrix/pairwise.h"
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
 
@@ -22,18 +33,36 @@ template <typename T>
 using time_point = std::chrono::time_point<T>;
 using index_t = std::ptrdiff_t;
 
+namespace project = asc::pad_ws20::project;
+
 template <typename T>
-std::ostream& 
-dump_vector(std::ostream& stream, const std::vector<T> &vec, index_t n) {
+std::ostream&
+dump_array(std::ostream& stream, const T* a, index_t n) {
     if (stream) {
         for (index_t i = 0; i < n - 1; ++i) {
-            stream << vec[i] << " ";
+            stream << a[i] << " ";
         }
-        stream << vec[n - 1];
+        stream << a[n - 1];
     }
     return stream;
 }
 
+template <typename T>
+std::ostream& 
+dump_vector(std::ostream& stream, const std::vector<T> &vec, index_t n) {
+    return dump_array(stream, vec.data(), n);
+}
+
+// Whole matrix held by a single rank, in the same format as the distributed dump below
+template <typename T, typename Alloc>
+void dump_matrix(const std::filesystem::path &path, const project::TriMatrix<T, Alloc> &M) {
+    std::ofstream ofs(path.c_str(), std::ofstream::trunc);
+    ofs << "DIM: " << M.n() << "x" << M.n() << std::endl;
+    dump_array(ofs << "LOWER (C-m): ", M.lower(), M.t()) << std::endl;
+    dump_array(ofs << "DIAG: ", M.diag(), M.n()) << std::endl;
+    dump_array(ofs << "UPPER (R-m): ", M.upper(), M.t()) << std::endl;
+}
+
 template <typename T>
 void dump_vector_in_rank_order(std::ostream &stream, const std::vector<T> &vec, index_t n,
                                const char *label) {
@@ -57,26 +86,63 @@ void dump_vector_in_rank_order(std::ostream &stream, const std::vector<T> &vec,
 
 int main(int argc, char **argv)
 {
-    index_t dim = 0;  // amount of rows/columns
+    index_t dimension = 0;  // amount of rows/columns
     int seed = 42; // seed for pseudo-random generator
     int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
     bool write = false;
     bool bench = false;
+    bool spmv = false;
+    bool scatter = false;
+    bool broadcast = false;
+    std::string op_name = "symmetrize";
+    float alpha = 1, beta = 1; // coefficients of --op axpby
     bool show_help = false;
     std::filesystem::path file_path("upcxx_matrix.txt");
     std::filesystem::path file_path_sym("upcxx_matrix_symmetrized.txt");
+    std::filesystem::path file_path_spmv("upcxx_spmv.txt");
+    std::filesystem::path file_path_norm("upcxx_norm.txt");
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
 
     auto cli = lyra::help(show_help) |
-        lyra::opt(dim, "dim")["-N"]["--dim"](
+        lyra::opt(dimension, "dim")["-N"]["--dim"](
             "Size of reduced vec, must be specified") |
         lyra::opt(iterations, "iterations")["--iterations"](
             "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all dimensions from min to max (multiplied by factor, default 2) in a single run") |
         lyra::opt(seed, "seed")["--seed"](
             "Seed for pseudo-random number generation, default is 42") |
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(write)["--write"](
-            "Serialize matrix before and after symmetrization");
+            "Serialize matrix before and after symmetrization") |
+        lyra::opt(spmv)["--spmv"](
+            "Benchmark the product y = A x with the symmetrized matrix (diagonal and lower triangle) instead of symmetrization") |
+        lyra::opt(scatter)["--scatter"](
+            "Generate the whole matrix on rank 0 and scatter it to all ranks, and gather it back to rank 0 for --write") |
+        lyra::opt(broadcast)["--broadcast"](
+            "Generate the whole matrix on rank 0 and broadcast it to all ranks, which keep their chunks; for --write, the input is written from the copy of the last rank (returned to rank 0 by rpc) and the result gathered as with --scatter") |
+        lyra::opt(op_name, "op")["--op"](
+            "Operation on the triangles: symmetrize (default), skew, sum, axpby, asymmetry or symmetrize-asymmetry; the norm ||A - A^T|| of the last two is reduced over all ranks and serialized with --write") |
+        lyra::opt(alpha, "alpha")["--alpha"](
+            "Coefficient of A for --op axpby, default is 1") |
+        lyra::opt(beta, "beta")["--beta"](
+            "Coefficient of A^T for --op axpby, default is 1") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
     auto result = cli.parse({argc, argv});
 
     if (!result) {
@@ -88,116 +154,341 @@ int main(int argc, char **argv)
 		std::cout << cli << std::endl;
 		exit(0);
 	}
-    if (dim <= 0) {
+
+    // Matrix dimensions, a single one unless --sweep is given
+    std::vector<index_t> dims{dimension};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        if (write) {
+            std::cerr << "--write cannot be combined with --sweep" << std::endl;
+            std::exit(1);
+        }
+        dims = *swept;
+    } else if (dimension <= 0) {
         std::cerr << "positive dimension required (specify with --dim)" << std::endl;
         std::exit(1);
     }
-    
+    const auto op = project::parse_pair_op(op_name);
+    if (!op) {
+        std::cerr << "unknown operation " << op_name << std::endl;
+        std::exit(1);
+    }
+    if (spmv && *op != project::pair_op::symmetrize) {
+        std::cerr << "--spmv requires --op symmetrize" << std::endl;
+        std::exit(1);
+    }
+    if (scatter && broadcast) {
+        std::cerr << "--scatter cannot be combined with --broadcast" << std::endl;
+        std::exit(1);
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
     // BEGIN PARALLEL REGION
     upcxx::init();
     int nproc = upcxx::rank_n();
     int proc_id = upcxx::rank_me();
-
-    // Block size for each process
-    const index_t N = dim * (dim - 1) / 2;
-    const index_t triangle_n = N / nproc;
-    assert(triangle_n % 2 == 0);
-    assert(N == triangle_n * nproc);
-
-    const index_t diagonal_n = dim / nproc;
-    assert(dim == diagonal_n * nproc);
-
-    // For symmetrization of a square matrix, we consider three arrays:
-    // - one holding the lower triangle, in col-major order;
-    // - one holding the upper triangle, in row-major order;
-    // - one holding the diagonal.
-    //
-    // Symmetrization does not modify the diagonal, so it could be left out.
-    std::vector<float> lower(triangle_n);
-    std::vector<float> upper(triangle_n);
-    std::vector<float> diag(diagonal_n);
-
-    // Initialize upper and lower triangle with pseudo-random values
-    std::mt19937_64 rgen(seed);
-    rgen.discard(proc_id * triangle_n * 2);
-    for (index_t i = 0; i < triangle_n; ++i) {
-        lower[i] = 0.5 + rgen() % 100;
-        upper[i] = 1.0 + rgen() % 100;
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
     }
-    
-    // Initialize diagonal (optional)
-    index_t offset_diag = proc_id * diagonal_n; // offset for diagonal
-    for (index_t i = 0; i < diagonal_n; ++i) {
-        diag[i] = offset_diag + i + 1;
+    if (!trace_path.empty()) {
+        trace_start();
     }
 
-    if (write) {
-        if (proc_id == 0) {
-            std::ofstream ofs(file_path.c_str(), std::ofstream::trunc);
-            ofs << "DIM: " << dim << "x" << dim << std::endl;
-        };
-        upcxx::barrier();
-        std::ofstream ofs(file_path.c_str(), std::ofstream::app);
+    for (const index_t dim : dims) {
+        // Block size for each process
+        const index_t N = dim * (dim - 1) / 2;
+        const index_t triangle_n = N / nproc;
+        assert(triangle_n % 2 == 0);
+        assert(N == triangle_n * nproc);
 
-        dump_vector_in_rank_order(ofs, lower, triangle_n, "LOWER (C-m): ");
-        dump_vector_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
-        dump_vector_in_rank_order(ofs, upper, triangle_n, "UPPER (R-m): ");
-    }
+        const index_t diagonal_n = dim / nproc;
+        assert(dim == diagonal_n * nproc);
+
+        // For symmetrization of a square matrix, we consider three arrays:
+        // - one holding the lower triangle, in col-major order;
+        // - one holding the upper triangle, in row-major order;
+        // - one holding the diagonal.
+        //
+        // Symmetrization does not modify the diagonal, so it could be left out.
+        timer.start(phase::init);
+        std::vector<float> lower(triangle_n);
+        std::vector<float> upper(triangle_n);
+        std::vector<float> diag(diagonal_n);
+        index_t offset_diag = proc_id * diagonal_n; // offset for diagonal
+
+        // With --scatter or --broadcast, the whole matrix on rank 0, as if read from a file by an
+        // I/O rank. It lives in the shared segment, so that the result can be gathered into it.
+        const auto layout = project::distribution::packed(dim, nproc);
+        std::optional<project::TriMatrix<float, project::shared_allocator<float>>> whole;
+
+        if (!scatter && !broadcast) {
+            // Initialize upper and lower triangle with pseudo-random values
+            std::mt19937_64 rgen(seed);
+            rgen.discard(proc_id * triangle_n * 2);
+            for (index_t i = 0; i < triangle_n; ++i) {
+                lower[i] = 0.5 + rgen() % 100;
+                upper[i] = 1.0 + rgen() % 100;
+            }
+
+            // Initialize diagonal (optional)
+            for (index_t i = 0; i < diagonal_n; ++i) {
+                diag[i] = offset_diag + i + 1;
+            }
+        } else if (proc_id == 0) {
+            // Same values as the chunks generated by every rank
+            whole.emplace(dim);
+            std::mt19937_64 rgen(seed);
+            for (index_t k = 0; k < N; ++k) {
+                whole->lower()[k] = 0.5 + rgen() % 100;
+                whole->upper()[k] = 1.0 + rgen() % 100;
+            }
+            for (index_t i = 0; i < dim; ++i) {
+                whole->diag()[i] = i + 1;
+            }
+        }
+
+        // Input vector of the product, replicated on all ranks. With small integers, products and
+        // sums of symmetrized elements (multiples of 0.25) are exact in float for dimensions up
+        // to 4096, so that the result does not depend on the order of summation.
+        std::vector<float> x(spmv ? dim : 0);
+        std::vector<float> y(spmv ? dim : 0);
+        for (index_t i = 0; i < static_cast<index_t>(x.size()); ++i) {
+            x[i] = i % 10;
+        }
+        timer.stop(phase::init);
+
+        if (scatter) {
+            // The chunks land in the shared segment of every rank
+            timer.start(phase::exchange);
+            upcxx::global_ptr<float> part = upcxx::new_array<float>(layout.local_size(proc_id));
+            scatter_packed(whole ? &*whole : nullptr, 0, layout, part, part + diagonal_n,
+                           part + diagonal_n + triangle_n);
+            timer.stop(phase::exchange);
+
+            timer.start(phase::init);
+            const float* p = part.local();
+            std::copy(p, p + diagonal_n, diag.begin());
+            std::copy(p + diagonal_n, p + diagonal_n + triangle_n, lower.begin());
+            std::copy(p + diagonal_n + triangle_n, p + diagonal_n + 2*triangle_n, upper.begin());
+            upcxx::delete_array(part);
+            timer.stop(phase::init);
+        }
 
-    // Timings for different iterations, of which the mean is taken.
-    std::vector<double> vt;
-    vt.reserve(iterations);
+        if (broadcast) {
+            // Every rank receives the whole matrix in its shared segment, and keeps its chunks
+            timer.start(phase::exchange);
+            if (proc_id != 0) {
+                whole.emplace(dim);
+            }
+            broadcast_matrix(*whole, 0);
+            timer.stop(phase::exchange);
+
+            timer.start(phase::init);
+            const auto [i0, i1] = layout.range(dim, proc_id);
+            const auto [k0, k1] = layout.range(N, proc_id);
+            std::copy(whole->diag() + i0, whole->diag() + i1, diag.begin());
+            std::copy(whole->lower() + k0, whole->lower() + k1, lower.begin());
+            std::copy(whole->upper() + k0, whole->upper() + k1, upper.begin());
+            timer.stop(phase::init);
+        }
+
+        if (write && broadcast) {
+            // The copy of the last rank, sent to rank 0 as an rpc argument, so that the input
+            // written below went through both the broadcast and the serialization
+            timer.start(phase::exchange);
+            using matrix_type = project::TriMatrix<float, project::shared_allocator<float>>;
+            upcxx::dist_object<std::optional<matrix_type>> returned(std::nullopt);
+            if (proc_id == nproc - 1) {
+                upcxx::rpc(0, [](upcxx::dist_object<std::optional<matrix_type>> &r, matrix_type &&M) {
+                    r->emplace(std::move(M));
+                }, returned, *whole).wait();
+            }
+            upcxx::barrier();
+            timer.stop(phase::exchange);
+
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                dump_matrix(file_path, **returned);
+            }
+            timer.stop(phase::io);
+        } else if (write && scatter) {
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                dump_matrix(file_path, *whole);
+            }
+            timer.stop(phase::io);
+        } else if (write) {
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                std::ofstream ofs(file_path.c_str(), std::ofstream::trunc);
+                ofs << "DIM: " << dim << "x" << dim << std::endl;
+            };
+            upcxx::barrier();
+            std::ofstream ofs(file_path.c_str(), std::ofstream::app);
+
+            dump_vector_in_rank_order(ofs, lower, triangle_n, "LOWER (C-m): ");
+            dump_vector_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
+            dump_vector_in_rank_order(ofs, upper, triangle_n, "UPPER (R-m): ");
+            timer.stop(phase::io);
+        }
+
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
     
-    // Copies for multiple iterations (in-place transposition)
-    std::vector<float> lower_cp(triangle_n);
-    std::vector<float> upper_cp(triangle_n);
+        // Copies for multiple iterations (in-place transposition)
+        std::vector<float> lower_cp(triangle_n);
+        std::vector<float> upper_cp(triangle_n);
+
+        // The product only reads the lower triangle, which is symmetrized once beforehand
+        if (spmv) {
+            project::apply_pair_op(project::pair_op::symmetrize, lower.data(), upper.data(), triangle_n);
+        }
+        double norm = 0; // ||A - A^T|| of the last iteration, for operations with a norm
     
-    // Symmetrization
-    for (int iter = 1; iter <= iterations; ++iter) {
-        std::copy(lower.begin(), lower.end(), lower_cp.begin());
-        std::copy(upper.begin(), upper.end(), upper_cp.begin());
+        // Symmetrization
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            timer.start(phase::init);
+            std::copy(lower.begin(), lower.end(), lower_cp.begin());
+            std::copy(upper.begin(), upper.end(), upper_cp.begin());
+            timer.stop(phase::init);
 
-        // Set up a barrier before doing any timing
-        upcxx::barrier();
-        time_point<Clock> t = Clock::now();
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+            counters.start();
 
-        // Symmetrize matrix (SAXPY over lower and upper triangle). We only require 
-        // a single for loop because lower and upper triangle are stored symmetrically 
-        // (in col-major and row-major, respectively)
-        for (index_t i = 0; i < triangle_n; ++i) {
-            float s = (lower_cp[i] + upper_cp[i]) / 2.;
-            lower_cp[i] = s;
-            upper_cp[i] = s;
-        }
-        upcxx::barrier(); // ensure symmetrization is complete
+            if (spmv) {
+                // Partial products of the local chunks, summed over all ranks
+                spmv_packed(diag.data(), offset_diag, diagonal_n, lower_cp.data(), proc_id * triangle_n,
+                            triangle_n, dim, x.data(), y.data(), timer);
+            } else {
+                timer.start(phase::compute);
+                // Symmetrize matrix (or apply another operation on pairs a_ij, a_ji). We only
+                // require a single loop because lower and upper triangle are stored
+                // symmetrically (in col-major and row-major, respectively)
+                double half_sq = project::apply_pair_op(*op, lower_cp.data(), upper_cp.data(),
+                                                        triangle_n, alpha, beta);
+                timer.stop(phase::compute);
+
+                if (project::pair_op_has_norm(*op)) {
+                    timer.start(phase::collective);
+                    TraceScope ts("reduce_all");
+                    norm = project::asymmetry_norm(upcxx::reduce_all(half_sq, upcxx::op_fast_add).wait());
+                    timer.stop(phase::collective);
+                }
+            }
+            counters.stop();
+
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier(); // ensure symmetrization is complete
+            }
+            timer.stop(phase::collective);
         
-        if (proc_id == 0) {
-            Duration d = Clock::now() - t;
-            double time = d.count(); // time in seconds
-            vt.push_back(time);
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
         }
-    }
-    if (proc_id == 0) {
-        double time = std::accumulate(vt.begin(), vt.end(), 0.);
-        time /= iterations;
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean;
         
-        double throughput = dim * (dim-1) * sizeof(float) * 1e-9 / time;
-        std::fprintf(stdout, "%ld,%.12f,%.12f\n", dim, time, throughput);
-    }
+            // The product reads diagonal and lower triangle once
+            double bytes = spmv ? (dim + dim * (dim-1) / 2) * sizeof(float) : dim * (dim-1) * sizeof(float);
+            double throughput = bytes * 1e-9 / time;
+            std::fprintf(stdout, "%ld,%.12f,%.12f", dim, time, throughput);
+            bench_print_stats(stdout, stats);
+            if (machine) {
+                // Roofline of all nodes, assuming the same amount of ranks on every node
+                int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                auto kernel = spmv ? roofline_spmv(dim) : roofline_symmetrize(dim * (dim - 1) / 2);
+                roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+            }
+            std::fprintf(stdout, "\n");
+        }
     
-    if (write) {
-        if (proc_id == 0) {
-            std::ofstream ofs(file_path_sym.c_str(), std::ofstream::trunc);
-            ofs << "DIM: " << dim << "x" << dim << std::endl;
-        };
-        upcxx::barrier();
-        std::ofstream ofs(file_path_sym.c_str(), std::ofstream::app);
+        if (write && (scatter || broadcast)) {
+            // Gather the result into the matrix of rank 0, which writes it on its own
+            timer.start(phase::exchange);
+            gather_packed(diag.data(), lower_cp.data(), upper_cp.data(), layout,
+                          whole ? &*whole : nullptr, 0);
+            timer.stop(phase::exchange);
+        }
+        if (write) {
+            timer.start(phase::io);
+            if (scatter || broadcast) {
+                if (proc_id == 0) {
+                    dump_matrix(file_path_sym, *whole);
+                }
+            } else {
+                if (proc_id == 0) {
+                    std::ofstream ofs(file_path_sym.c_str(), std::ofstream::trunc);
+                    ofs << "DIM: " << dim << "x" << dim << std::endl;
+                };
+                upcxx::barrier();
+                std::ofstream ofs(file_path_sym.c_str(), std::ofstream::app);
 
-        dump_vector_in_rank_order(ofs, lower_cp, triangle_n, "LOWER (C-m): ");
-        dump_vector_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
-        dump_vector_in_rank_order(ofs, upper_cp, triangle_n, "UPPER (R-m): ");
-    }
+                dump_vector_in_rank_order(ofs, lower_cp, triangle_n, "LOWER (C-m): ");
+                dump_vector_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
+                dump_vector_in_rank_order(ofs, upper_cp, triangle_n, "UPPER (R-m): ");
+            }
+            if (project::pair_op_has_norm(*op) && proc_id == 0) {
+                std::ofstream ofs_norm(file_path_norm.c_str(), std::ofstream::trunc);
+                ofs_norm << "NORM: " << std::setprecision(17) << norm << std::endl;
+            }
+            if (spmv && proc_id == 0) {
+                std::ofstream ofs_y(file_path_spmv.c_str(), std::ofstream::trunc);
+                ofs_y << "Y: ";
+                dump_vector(ofs_y, y, dim) << std::endl;
+            }
+            timer.stop(phase::io);
+        }
+        const std::string program = spmv ? "symmetrize-upcxx-spmv"
+            : *op == project::pair_op::symmetrize ? "symmetrize-upcxx" : "symmetrize-upcxx-" + op_name;
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
+
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, program.c_str(), {{"dim", dim}, {"iterations", iterations}}, stats);
+            }
+        }
     
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, program.c_str(), {{"dim", dim}, {"iterations", iterations}},
+                                counters, timer.elapsed(phase::compute));
+        }
+        timer.reset();
+        counters.reset();
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
     upcxx::finalize();
     // END PARALLEL REGION
 }
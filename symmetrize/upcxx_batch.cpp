@@ -0,0 +1,259 @@
+
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <optional>
+
+#include <omp.h>
+#include <lyra/lyra.hpp>
+#include <upcxx/upcxx.hpp>
+
+#include "matrix/batch.h"
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+
+using Clock = std::chrono::high_resolution_clock;
+using Duration = std::chrono::duration<double>;
+
+template <typename T>
+using time_point = std::chrono::time_point<T>;
+using index_t = std::ptrdiff_t;
+
+namespace project = asc::pad_ws20::project;
+
+// Value of element k of all matrices of the batch (splitmix64 of seed and k, scaled to the
+// half-integers of the other programs). Every rank computes the values of its own matrices
+// directly, instead of advancing a sequential generator past those of all lower ranks.
+inline float
+batch_value(std::uint64_t seed, std::uint64_t k)
+{
+    std::uint64_t z = seed + (k + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return 0.5 + z % 100;
+}
+
+// Symmetrization (or transposition) of a batch of small matrices of the same dimension. The
+// batch is split in contiguous blocks over the ranks, and every rank stores its block in a
+// MatrixBatch, whose chunks are distributed over the OpenMP threads. Matrices are independent,
+// so there is no communication besides the barriers around the timed region.
+int main(int argc, char** argv) {
+    index_t dimension = 0;  // amount of rows/columns of every matrix
+    index_t count = 1 << 20; // matrices in the batch, over all ranks
+    index_t elements = 0; // elements in the batch, over all ranks (replaces count if positive)
+    int seed = 42;  // seed for pseudo-random generator
+    int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
+    bool bench = false;
+    bool transpose = false;
+    bool show_help = false;
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
+
+    auto cli = lyra::help(show_help) |
+        lyra::opt(dimension, "dim")["-N"]["--dim"](
+            "Amount of rows and columns of every matrix, must be specified") |
+        lyra::opt(count, "count")["--count"](
+            "Amount of matrices in the batch, over all processes, default is 1048576") |
+        lyra::opt(elements, "elements")["--elements"](
+            "Amount of elements in the batch, over all processes; replaces --count by elements / dim^2 for every dimension, so that a sweep uses the same memory for all dimensions") |
+        lyra::opt(iterations, "iterations")["--iterations"](
+            "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all dimensions from min to max (multiplied by factor, default 2) in a single run") |
+        lyra::opt(seed, "seed")["--seed"](
+            "Seed for pseudo-random number generation, default is 42") |
+        lyra::opt(bench)["--bench"](
+            "Print benchmarks to standard output") |
+        lyra::opt(transpose)["--transpose"](
+            "Transpose the matrices instead of symmetrizing them") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
+    auto result = cli.parse({argc, argv});
+
+    if (!result) {
+		std::cerr << "Error in command line: " << result.errorMessage()
+			  << std::endl;
+		exit(1);
+	}
+	if (show_help) {
+		std::cout << cli << std::endl;
+		exit(0);
+	}
+
+    // Matrix dimensions, a single one unless --sweep is given
+    std::vector<index_t> dims{dimension};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        dims = *swept;
+    } else if (dimension <= 0) {
+        std::cerr << "positive dimension required (specify with --dim)" << std::endl;
+        std::exit(1);
+    }
+    if (count <= 0 && elements <= 0) {
+        std::cerr << "positive amount of matrices required (specify with --count or --elements)" << std::endl;
+        std::exit(1);
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // BEGIN PARALLEL REGION
+    upcxx::init();
+    upcxx::intrank_t nproc = upcxx::rank_n();
+    upcxx::intrank_t proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
+
+    for (const index_t dim : dims) {
+        const index_t elems = dim * dim;
+        const index_t matrices = elements > 0 ? std::max<index_t>(elements / elems, 1) : count;
+
+        // Matrices [first, first + local) of the batch; the first matrices % nproc ranks hold
+        // one more
+        const index_t local = matrices / nproc + (proc_id < matrices % nproc ? 1 : 0);
+        const index_t first = proc_id * (matrices / nproc) + std::min<index_t>(proc_id, matrices % nproc);
+        if (local == 0) {
+            if (proc_id == 0) {
+                std::cerr << "fewer matrices (" << matrices << ") than processes (" << nproc << ")" << std::endl;
+            }
+            upcxx::finalize();
+            std::exit(1);
+        }
+
+        // The value of every element depends only on its index in the batch of consecutive
+        // row-major matrices, so the batch does not depend on the amount of ranks.
+        timer.start(phase::init);
+        project::MatrixBatch<float> orig(dim, local);
+        for (index_t k = 0; k < elems; ++k) {
+            float *e = orig.elements() + k * orig.ld();
+            for (index_t m = 0; m < local; ++m) {
+                e[m] = batch_value(seed, (first + m) * elems + k);
+            }
+        }
+        project::MatrixBatch<float> batch(dim, local);
+        timer.stop(phase::init);
+
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            timer.start(phase::init);
+            std::copy(orig.elements(), orig.elements() + elems * orig.ld(), batch.elements());
+            timer.stop(phase::init);
+
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+            timer.start(phase::compute);
+            counters.start();
+            {
+                TraceScope ts(transpose ? "transpose" : "symmetrize");
+                if (transpose) {
+                    batch.transpose_parallel();
+                } else {
+                    batch.symmetrize_parallel();
+                }
+            }
+            counters.stop();
+            timer.stop(phase::compute);
+
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
+        }
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean;
+
+            // Elements of both triangles of all matrices, read and written once
+            double throughput = matrices * dim * (dim-1) * sizeof(float) * 1e-9 / time;
+            std::fprintf(stdout, "%ld,%.12f,%.12f", dim, time, throughput);
+            bench_print_stats(stdout, stats);
+            if (machine) {
+                // Roofline of all nodes, assuming the same amount of ranks on every node
+                int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                auto kernel = roofline_symmetrize(double(matrices) * dim * (dim - 1) / 2);
+                roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+            }
+            std::fprintf(stdout, "\n");
+        }
+
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
+
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, "symmetrize-upcxx-batch",
+                                  {{"dim", dim}, {"count", matrices}, {"iterations", iterations}, {"threads", omp_get_max_threads()}}, stats);
+            }
+        }
+
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, "symmetrize-upcxx-batch", {{"dim", dim}, {"count", matrices}, {"iterations", iterations}, {"threads", omp_get_max_threads()}},
+                                counters, timer.elapsed(phase::compute));
+        }
+        timer.reset();
+        counters.reset();
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
+    upcxx::finalize();
+    // END PARALLEL REGION
+}
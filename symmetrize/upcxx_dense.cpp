@@ -0,0 +1,510 @@
+
+#include <random>
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <utility>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+
+#include <upcxx/upcxx.hpp>
+#include <lyra/lyra.hpp>
+
+#include "include/redistribute-upcxx.hpp"
+#include "include/scatter-upcxx.hpp"
+#include "include/symmetrize-upcxx.hpp"
+#include "matrix/offsets.h"
+#include "matrix/pairwise.h"
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+
+using Clock = std::chrono::high_resolution_clock;
+using Duration = std::chrono::duration<double>;
+
+template <typename T>
+using time_point = std::chrono::time_point<T>;
+
+namespace project = asc::pad_ws20::project;
+using project::distribution;
+using shared_matrix = project::SquareMatrix<float, project::shared_allocator<float>>;
+
+template <typename T>
+std::ostream&
+dump_vector(std::ostream& stream, const std::vector<T> &vec, const char *label) {
+    if (stream && !vec.empty()) {
+        stream << label;
+        for (std::size_t i = 0; i < vec.size() - 1; ++i) {
+            stream << vec[i] << " ";
+        }
+        stream << vec[vec.size() - 1] << std::endl;
+    }
+    return stream;
+}
+
+// Write a whole matrix (row-major) in the format of the serial program (lower triangle in
+// col-major order, diagonal, upper triangle in row-major order).
+void dump_matrix(const std::filesystem::path &file_path, const float *elems, index_t dim)
+{
+    const index_t t = dim * (dim - 1) / 2;
+    std::vector<float> lower(t), diag(dim), upper(t);
+    for (index_t i = 0; i < dim; ++i) {
+        for (index_t j = 0; j < dim; ++j) {
+            if (i == j) {
+                diag[i] = elems[i*dim + j];
+            } else if (j < i) {
+                lower[project::detail::offset_lower_col_major(i, j, dim)] = elems[i*dim + j];
+            } else {
+                upper[project::detail::offset_upper_row_major(i, j, dim)] = elems[i*dim + j];
+            }
+        }
+    }
+    std::ofstream ofs(file_path.c_str(), std::ofstream::trunc);
+    ofs << "DIM: " << dim << "x" << dim << std::endl;
+    dump_vector(ofs, lower, "LOWER (C-m): ");
+    dump_vector(ofs, diag, "DIAG: ");
+    dump_vector(ofs, upper, "UPPER (R-m): ");
+}
+
+// Values of rows [row0, row0 + count) of the matrix (row-major). With `serial`, the same values
+// as the serial program, which draws the lower and upper triangle alternately in packed order;
+// this walks the whole random sequence, and is only used for verification. Otherwise the
+// elements are drawn in row-major order.
+void init_rows(float *rows, index_t row0, index_t count, index_t dim, int seed, bool serial)
+{
+    std::mt19937_64 rgen(seed);
+    if (serial) {
+        const index_t t = dim * (dim - 1) / 2;
+        std::vector<float> lower(t), upper(t);
+        for (index_t k = 0; k < t; ++k) {
+            lower[k] = 0.5 + rgen() % 100;
+            upper[k] = 1.0 + rgen() % 100;
+        }
+        for (index_t i = row0; i < row0 + count; ++i) {
+            for (index_t j = 0; j < dim; ++j) {
+                float &a = rows[(i - row0)*dim + j];
+                if (i == j) {
+                    a = i + 1;
+                } else if (j < i) {
+                    a = lower[project::detail::offset_lower_col_major(i, j, dim)];
+                } else {
+                    a = upper[project::detail::offset_upper_row_major(i, j, dim)];
+                }
+            }
+        }
+    } else {
+        rgen.discard(row0 * dim);
+        for (index_t k = 0; k < count * dim; ++k) {
+            rows[k] = 0.5 + rgen() % 100;
+        }
+    }
+}
+
+// Gather the distributed matrix on rank 0 and write it in the format of the serial program
+void write_matrix(const std::filesystem::path &file_path, dist_rows<float> &rows_g, index_t dim)
+{
+    const upcxx::intrank_t proc_n = upcxx::rank_n();
+    const index_t b = dim / proc_n;
+
+    if (upcxx::rank_me() == 0) {
+        std::vector<float> elems(dim * dim);
+        for (upcxx::intrank_t k = 0; k < proc_n; ++k) {
+            upcxx::global_ptr<float> rows = rows_g.fetch(k).wait();
+            upcxx::rget(rows, elems.data() + k * b * dim, b * dim).wait();
+        }
+        dump_matrix(file_path, elems.data(), dim);
+    }
+    upcxx::barrier();
+}
+
+int main(int argc, char **argv)
+{
+    index_t dimension = 0;  // amount of rows/columns
+    int seed = 42; // seed for pseudo-random generator
+    int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
+    bool write = false;
+    bool bench = false;
+    bool packed = false;
+    bool scatter = false;
+    bool broadcast = false;
+    double update = 0; // fraction of tiles updated before incremental symmetrization
+    bool check = false;
+    bool show_help = false;
+    std::filesystem::path file_path("upcxx_dense_matrix.txt");
+    std::filesystem::path file_path_sym("upcxx_dense_matrix_symmetrized.txt");
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
+
+    auto cli = lyra::help(show_help) |
+        lyra::opt(dimension, "dim")["-N"]["--dim"](
+            "Amount of rows and columns, must be specified and divisible by the amount of processes") |
+        lyra::opt(iterations, "iterations")["--iterations"](
+            "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all dimensions from min to max (multiplied by factor, default 2) in a single run") |
+        lyra::opt(seed, "seed")["--seed"](
+            "Seed for pseudo-random number generation, default is 42") |
+        lyra::opt(bench)["--bench"](
+            "Print benchmarks to standard output") |
+        lyra::opt(scatter)["--scatter"](
+            "Generate the whole matrix on rank 0 and scatter its row blocks to all ranks, and gather them back to rank 0 for --write") |
+        lyra::opt(broadcast)["--broadcast"](
+            "Generate the whole matrix on rank 0 and broadcast it to all ranks, which keep their row blocks; for --write, the input is written from the copy of the last rank (returned to rank 0 by rpc) and the result gathered as with --scatter") |
+        lyra::opt(packed)["--packed"](
+            "Redistribute to the packed triangle layout of symmetrize-upcxx, symmetrize there and redistribute back") |
+        lyra::opt(update, "fraction")["--update"](
+            "Symmetrize incrementally after overwriting the given fraction of tiles of a symmetric matrix (e.g. 0.01); throughput refers to the whole matrix") |
+        lyra::opt(check)["--check"](
+            "With --update, compare the result of every iteration with a full symmetrization of the same updated matrix, and fail on any difference") |
+        lyra::opt(write)["--write"](
+            "Serialize matrix before and after symmetrization, in the format of the serial program") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
+    auto result = cli.parse({argc, argv});
+
+    if (!result) {
+		std::cerr << "Error in command line: " << result.errorMessage()
+			  << std::endl;
+		exit(1);
+	}
+	if (show_help) {
+		std::cout << cli << std::endl;
+		exit(0);
+	}
+
+    // Matrix dimensions, a single one unless --sweep is given
+    std::vector<index_t> dims{dimension};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        if (write) {
+            std::cerr << "--write cannot be combined with --sweep" << std::endl;
+            std::exit(1);
+        }
+        dims = *swept;
+    } else if (dimension <= 0) {
+        std::cerr << "positive dimension required (specify with --dim)" << std::endl;
+        std::exit(1);
+    }
+
+    if (update < 0 || update > 1) {
+        std::cerr << "invalid update fraction " << update << " (expected 0 to 1)" << std::endl;
+        std::exit(1);
+    }
+    if (update > 0 && (packed || write)) {
+        std::cerr << "--update cannot be combined with --packed or --write" << std::endl;
+        std::exit(1);
+    }
+    if (check && update == 0) {
+        std::cerr << "--check requires --update" << std::endl;
+        std::exit(1);
+    }
+    if (scatter && broadcast) {
+        std::cerr << "--scatter cannot be combined with --broadcast" << std::endl;
+        std::exit(1);
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
+
+    // BEGIN PARALLEL REGION
+    upcxx::init();
+    int nproc = upcxx::rank_n();
+    int proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
+
+    for (const index_t dim : dims) {
+        // Block of rows for each process
+        const index_t block_rows = dim / nproc;
+        if (dim != block_rows * nproc) {
+            if (proc_id == 0) {
+                std::cerr << "dimension " << dim << " is not divisible by " << nproc << " processes" << std::endl;
+            }
+            upcxx::finalize();
+            std::exit(1);
+        }
+        const index_t block_size = block_rows * dim;
+
+        // The row block of this process is kept in the shared segment, so that partners can
+        // access their mirror tiles; a second row block holds the original values for
+        // multiple iterations.
+        timer.start(phase::init);
+        dist_rows<float> rows_g(upcxx::new_array<float>(block_size));
+        float *rows = rows_g->local();
+        std::vector<float> rows_orig(block_size);
+
+        const distribution row_layout = distribution::row_block(dim, nproc);
+        const index_t row0 = proc_id * block_rows;
+
+        // With --scatter or --broadcast, the whole matrix on rank 0, as if read from a file by
+        // an I/O rank. It lives in the shared segment, so that the result can be gathered into it.
+        std::optional<shared_matrix> whole;
+        if (!scatter && !broadcast) {
+            init_rows(rows_orig.data(), row0, block_rows, dim, seed, write);
+        } else if (proc_id == 0) {
+            whole.emplace(dim);
+            init_rows(whole->elements(), 0, dim, dim, seed, write);
+        }
+        timer.stop(phase::init);
+
+        if (scatter) {
+            // The row blocks land in the shared segment of every rank
+            timer.start(phase::exchange);
+            scatter_rows(whole ? &*whole : nullptr, 0, row_layout, *rows_g);
+            timer.stop(phase::exchange);
+            std::copy(rows, rows + block_size, rows_orig.begin());
+        } else if (broadcast) {
+            // Every rank receives the whole matrix in its shared segment, and keeps its rows
+            timer.start(phase::exchange);
+            if (proc_id != 0) {
+                whole.emplace(dim);
+            }
+            broadcast_matrix(*whole, 0);
+            timer.stop(phase::exchange);
+            std::copy(whole->elements() + row0*dim, whole->elements() + (row0 + block_rows)*dim,
+                      rows_orig.begin());
+        }
+
+        timer.start(phase::init);
+        std::copy(rows_orig.begin(), rows_orig.end(), rows);
+
+        const distribution packed_layout = distribution::packed(dim, nproc);
+        std::vector<float> packed_elems(packed ? packed_layout.local_size(proc_id) : 0);
+
+        // With --update, a symmetric matrix of which random tiles of every row block are
+        // overwritten in each iteration
+        project::DirtyTiles dirty(block_rows, dim, symmetrize_dirty_tile(block_rows));
+        std::vector<float> rows_sym;
+        std::vector<float> rows_updated; // input of the incremental kernel, for --check
+        if (update > 0) {
+            symmetrize_block_rows(rows_g, dim, timer);
+            rows_sym.assign(rows, rows + block_size);
+        }
+        timer.stop(phase::init);
+
+        if (write && broadcast) {
+            // The copy of the last rank, sent to rank 0 as an rpc argument, so that the input
+            // written below went through both the broadcast and the serialization
+            timer.start(phase::exchange);
+            upcxx::dist_object<std::optional<shared_matrix>> returned(std::nullopt);
+            if (proc_id == nproc - 1) {
+                upcxx::rpc(0, [](upcxx::dist_object<std::optional<shared_matrix>> &r, shared_matrix &&M) {
+                    r->emplace(std::move(M));
+                }, returned, *whole).wait();
+            }
+            upcxx::barrier();
+            timer.stop(phase::exchange);
+
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                dump_matrix(file_path, (*returned)->elements(), dim);
+            }
+            timer.stop(phase::io);
+        } else if (write && scatter) {
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                dump_matrix(file_path, whole->elements(), dim);
+            }
+            timer.stop(phase::io);
+        } else if (write) {
+            timer.start(phase::io);
+            write_matrix(file_path, rows_g, dim);
+            timer.stop(phase::io);
+        }
+
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
+
+        // Symmetrization
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            timer.start(phase::init);
+            if (update > 0) {
+                std::copy(rows_sym.begin(), rows_sym.end(), rows);
+                std::mt19937_64 rgen(seed + iter * nproc + proc_id);
+                std::bernoulli_distribution pick(update);
+                const index_t tb = dirty.tile_dim();
+                for (index_t I = 0; I < dirty.tile_rows(); ++I) {
+                    for (index_t J = 0; J < dirty.tile_cols(); ++J) {
+                        if (!pick(rgen)) {
+                            continue;
+                        }
+                        for (index_t i = I*tb; i < (I + 1)*tb; ++i) {
+                            for (index_t j = J*tb; j < (J + 1)*tb; ++j) {
+                                rows[i*dim + j] = 0.5 + rgen() % 100;
+                            }
+                        }
+                        dirty.mark(I*tb, J*tb, tb, tb);
+                    }
+                }
+                if (check) {
+                    rows_updated.assign(rows, rows + block_size);
+                }
+            } else {
+                std::copy(rows_orig.begin(), rows_orig.end(), rows);
+            }
+            timer.stop(phase::init);
+
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+            counters.start();
+
+            if (packed) {
+                // Lower and upper triangle are split in the same chunks, so that symmetrization
+                // is local; both redistributions end with a barrier.
+                timer.start(phase::exchange);
+                redistribute(rows, row_layout, packed_elems.data(), packed_layout);
+                timer.stop(phase::exchange);
+
+                timer.start(phase::compute);
+                float *lower = packed_elems.data() + packed_layout.diag_size(proc_id);
+                float *upper = lower + packed_layout.tri_size(proc_id);
+                project::apply_pair_op(project::pair_op::symmetrize, lower, upper,
+                                       packed_layout.tri_size(proc_id));
+                timer.stop(phase::compute);
+
+                timer.start(phase::exchange);
+                redistribute(packed_elems.data(), packed_layout, rows, row_layout);
+                timer.stop(phase::exchange);
+            } else if (update > 0) {
+                // Only the overwritten tiles and their mirrors; clears the flags
+                symmetrize_block_rows(rows_g, dim, dirty, timer);
+            } else {
+                // Exchange and average mirrored tiles; includes a barrier at the end
+                symmetrize_block_rows(rows_g, dim, timer);
+            }
+            counters.stop();
+
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
+
+            if (check) {
+                // Full symmetrization of the updated matrix, with its own timer so that the
+                // phases only cover the incremental kernel
+                std::vector<float> rows_inc(rows, rows + block_size);
+                std::copy(rows_updated.begin(), rows_updated.end(), rows);
+                PhaseTimer check_timer;
+                symmetrize_block_rows(rows_g, dim, check_timer);
+
+                // Tiles which were not written are symmetric, so that both results are exact
+                index_t differ = 0;
+                for (index_t k = 0; k < block_size; ++k) {
+                    differ += rows_inc[k] != rows[k];
+                }
+                differ = upcxx::reduce_all(differ, upcxx::op_fast_add).wait();
+                if (differ > 0) {
+                    if (proc_id == 0) {
+                        std::cerr << "incremental symmetrization differs from full symmetrization in "
+                                  << differ << " elements (dimension " << dim << ", iteration "
+                                  << iter << ")" << std::endl;
+                    }
+                    upcxx::finalize();
+                    std::exit(1);
+                }
+            }
+        }
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean;
+
+            double throughput = dim * (dim-1) * sizeof(float) * 1e-9 / time;
+            std::fprintf(stdout, "%ld,%.12f,%.12f", dim, time, throughput);
+            bench_print_stats(stdout, stats);
+            if (machine) {
+                // Roofline of all nodes, assuming the same amount of ranks on every node
+                int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                auto kernel = roofline_symmetrize(dim * (dim - 1) / 2);
+                roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+            }
+            std::fprintf(stdout, "\n");
+        }
+
+        if (write && (scatter || broadcast)) {
+            // Gather the result into the matrix of rank 0, which writes it on its own
+            timer.start(phase::exchange);
+            gather_rows(rows, row_layout, whole ? &*whole : nullptr, 0);
+            timer.stop(phase::exchange);
+
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                dump_matrix(file_path_sym, whole->elements(), dim);
+            }
+            timer.stop(phase::io);
+        } else if (write) {
+            timer.start(phase::io);
+            write_matrix(file_path_sym, rows_g, dim);
+            timer.stop(phase::io);
+        }
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
+
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, "symmetrize-upcxx-dense", {{"dim", dim}, {"iterations", iterations}}, stats);
+            }
+        }
+
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, "symmetrize-upcxx-dense", {{"dim", dim}, {"iterations", iterations}},
+                                counters, timer.elapsed(phase::compute));
+        }
+        timer.reset();
+        counters.reset();
+
+        // Partners may still read the row block until all have finished
+        upcxx::barrier();
+        upcxx::delete_array(*rows_g);
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
+    upcxx::finalize();
+    // END PARALLEL REGION
+}
@@ -9,12 +9,22 @@
 #include <chrono>
 #include <algorithm>
 #include <vector>
+#include <optional>
 #include <filesystem>
+#include <iomanip>
 
 #include <omp.h>
 #include <lyra/lyra.hpp>
 #include <upcxx/upcxx.hpp>
 
+#include "matrix/interleaved.h"
+#include "matrix/pairwise.h"
+#include "../common/bench-stats.hpp"
+#include "../common/perf-counters.hpp"
+#include "../common/phase-timer.hpp"
+#include "../common/roofline.hpp"
+#include "../common/trace.hpp"
+
 using Clock = std::chrono::high_resolution_clock;
 using Duration = std::chrono::duration<double>;
 
@@ -22,6 +32,8 @@ template <typename T>
 using time_point = std::chrono::time_point<T>;
 using index_t = std::ptrdiff_t;
 
+namespace project = asc::pad_ws20::project;
+
 template <typename T>
 std::ostream& dump_array(std::ostream& stream, T array[], index_t n) {
     if (stream) {
@@ -54,26 +66,56 @@ void dump_array_in_rank_order(std::ostream &stream, T array[], index_t n,
 }
 
 int main(int argc, char** argv) {
-    index_t dim = 0;   // amount of rows/columns
+    index_t dimension = 0;   // amount of rows/columns
     int seed = 42;  // seed for pseudo-random generator
     int iterations = 1;
+    int warmup = 0; // untimed iterations before timing
+    std::string sweep; // min:max:factor
     bool bench = false;
     bool write = false;
+    bool interleaved = false;
+    std::string op_name = "symmetrize";
+    float alpha = 1, beta = 1; // coefficients of --op axpby
     bool show_help = false;
     std::filesystem::path file_path("openmp_matrix.txt");
     std::filesystem::path file_path_sym("openmp_matrix_symmetrized.txt");
+    std::filesystem::path file_path_norm("openmp_norm.txt");
+    std::string phases_path; // per-phase timings (JSON lines)
+    std::string trace_path;  // timeline in Chrome trace event format
+    std::string counters_path; // hardware counters of the timed kernels (JSON lines)
+    std::string roofline_path; // machine calibration written by the roofline program
 
     auto cli = lyra::help(show_help) |
-        lyra::opt(dim, "dim")["-N"]["--dim"](
+        lyra::opt(dimension, "dim")["-N"]["--dim"](
             "Size of reduced array, must be specified") |
         lyra::opt(iterations, "iterations")["--iterations"](
             "Number of iterations, default is 1") |
+        lyra::opt(warmup, "warmup")["--warmup"](
+            "Number of untimed iterations before timing, default is 0") |
+        lyra::opt(sweep, "min:max:factor")["--sweep"](
+            "Benchmark all dimensions from min to max (multiplied by factor, default 2) in a single run") |
         lyra::opt(seed, "seed")["--seed"](
             "Seed for pseudo-random number generation, default is 42") |
         lyra::opt(bench)["--bench"](
             "Print benchmarks to standard output") |
         lyra::opt(write)["--write"](
-            "Serialize matrix before and after symmetrization");
+            "Serialize matrix before and after symmetrization") |
+        lyra::opt(interleaved)["--interleaved"](
+            "Symmetrize the triangles in the interleaved layout (alternating cache lines of lower and upper triangle), a single stream instead of two") |
+        lyra::opt(op_name, "op")["--op"](
+            "Operation on the triangles: symmetrize (default), skew, sum, axpby, asymmetry or symmetrize-asymmetry; the norm ||A - A^T|| of the last two is reduced over all ranks and serialized with --write") |
+        lyra::opt(alpha, "alpha")["--alpha"](
+            "Coefficient of A for --op axpby, default is 1") |
+        lyra::opt(beta, "beta")["--beta"](
+            "Coefficient of A^T for --op axpby, default is 1") |
+        lyra::opt(phases_path, "file")["--phases"](
+            "Append per-phase timings across ranks (min/mean/max) to file, as JSON") |
+        lyra::opt(trace_path, "file")["--trace"](
+            "Write a timeline of all ranks and threads to file (Chrome trace event format)") |
+        lyra::opt(counters_path, "file")["--counters"](
+            "Append hardware counters of the timed kernels (cycles, instructions, LLC misses, DRAM traffic) to file, per rank and in total") |
+        lyra::opt(roofline_path, "file")["--roofline"](
+            "Append the achieved fraction of the roofline to the benchmark output, using the calibration in file");
     auto result = cli.parse({argc, argv});
 
     if (!result) {
@@ -85,139 +127,270 @@ int main(int argc, char** argv) {
 		std::cout << cli << std::endl;
 		exit(0);
 	}
-    if (dim <= 0) {
+
+    // Matrix dimensions, a single one unless --sweep is given
+    std::vector<index_t> dims{dimension};
+    if (!sweep.empty()) {
+        auto swept = bench_sweep_sizes(sweep);
+        if (!swept) {
+            std::cerr << "invalid sweep " << sweep << " (expected min:max:factor)" << std::endl;
+            std::exit(1);
+        }
+        if (write) {
+            std::cerr << "--write cannot be combined with --sweep" << std::endl;
+            std::exit(1);
+        }
+        dims = *swept;
+    } else if (dimension <= 0) {
         std::cerr << "positive dimension required (specify with --dim)" << std::endl;
         std::exit(1);
     }
+    const auto op = project::parse_pair_op(op_name);
+    if (!op) {
+        std::cerr << "unknown operation " << op_name << std::endl;
+        std::exit(1);
+    }
+    if (interleaved && *op != project::pair_op::symmetrize) {
+        std::cerr << "--interleaved requires --op symmetrize" << std::endl;
+        std::exit(1);
+    }
+
+    std::optional<roofline_domain> machine;
+    if (!roofline_path.empty()) {
+        machine = roofline_read_csv(roofline_path);
+        if (!machine) {
+            std::cerr << "no calibration for the whole node (\"all\") in " << roofline_path << std::endl;
+            std::exit(1);
+        }
+    }
 
     // BEGIN PARALLEL REGION
     upcxx::init();
     upcxx::intrank_t nproc = upcxx::rank_n();
     upcxx::intrank_t proc_id = upcxx::rank_me();
+    PhaseTimer timer;
+    // Opened before any OpenMP parallel region, so that counters include all threads.
+    // Uncore (memory controller) counters cover the whole node and are read by one rank only.
+    PerfCounters counters;
+    if (!counters_path.empty()) {
+        counters.open(upcxx::local_team().rank_me() == 0);
+    }
+    if (!trace_path.empty()) {
+        trace_start();
+    }
 
-    // Block size for each process
-    const index_t N = dim * (dim - 1) / 2;
-    const index_t triangle_n = N / nproc;
-    assert(triangle_n % 2 == 0);
-    assert(N == triangle_n * nproc);
-
-    const index_t diagonal_n = dim / nproc;
-    assert(dim == diagonal_n * nproc);
-
-    // For symmetrization of a square matrix, we consider three arrays:
-    // - one holding the lower triangle, in col-major order;
-    // - one holding the upper triangle, in row-major order;
-    // - one holding the diagonal.
-    //
-    // Symmetrization does not modify the diagonal, so it could be left out.
-    float* lower = new float[triangle_n];
-    float* upper = new float[triangle_n];
-    float* diag = new float[diagonal_n];
-
-    // Initialize pseudo-random number generator
-    std::mt19937_64 rgen(seed);
-
-// XXX: integrate with upcxx
-#pragma omp parallel firstprivate(rgen)
-{
-    int threads = omp_get_num_threads();
-
-    index_t block_size = triangle_n / threads;
-    assert(triangle_n == threads * block_size);
-
-    rgen.discard(2 * (proc_id * threads + omp_get_thread_num()) * block_size);
-
-#pragma omp for schedule(static)
-    for (index_t i = 0; i < triangle_n; ++i) {
-        lower[i] = 0.5 + rgen() % 100;
-        upper[i] = 1.0 + rgen() % 100;
-    } // barrier
-
-    index_t offset_diag = proc_id * diagonal_n;
-#pragma omp for schedule(static)
-    for (index_t i = 0; i < diagonal_n; ++i) {
-        diag[i] = offset_diag + i + 1;
-    } // barrier
-}
+    for (const index_t dim : dims) {
+        // Block size for each process
+        const index_t N = dim * (dim - 1) / 2;
+        const index_t triangle_n = N / nproc;
+        assert(triangle_n % 2 == 0);
+        assert(N == triangle_n * nproc);
 
-    if (write) {
-        if (proc_id == 0) {
-            std::ofstream ofs(file_path.c_str(), std::ofstream::trunc);
-            ofs << "DIM: " << dim << "x" << dim << std::endl;
-        };
-        upcxx::barrier();
-        std::ofstream ofs(file_path.c_str(), std::ofstream::app);
+        const index_t diagonal_n = dim / nproc;
+        assert(dim == diagonal_n * nproc);
 
-        dump_array_in_rank_order(ofs, lower, triangle_n, "LOWER (C-m): ");
-        dump_array_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
-        dump_array_in_rank_order(ofs, upper, triangle_n, "UPPER (R-m): ");
-    }
+        // For symmetrization of a square matrix, we consider three arrays:
+        // - one holding the lower triangle, in col-major order;
+        // - one holding the upper triangle, in row-major order;
+        // - one holding the diagonal.
+        //
+        // Symmetrization does not modify the diagonal, so it could be left out.
+        timer.start(phase::init);
+        float* lower = new float[triangle_n];
+        float* upper = new float[triangle_n];
+        float* diag = new float[diagonal_n];
 
+        // Initialize pseudo-random number generator
+        std::mt19937_64 rgen(seed);
 
-    // Timings for different iterations, of which the mean is taken.
-    std::vector<double> vt;
-    vt.reserve(iterations);
-    
-    // Copies for multiple iterations (in-place transposition)
-    float* lower_cp = new float[triangle_n];
-    float* upper_cp = new float[triangle_n];
+    // XXX: integrate with upcxx
+    #pragma omp parallel firstprivate(rgen)
+    {
+        int threads = omp_get_num_threads();
 
-    for (int iter = 1; iter <= iterations; ++iter) {
-        // Initialize matrix
-#pragma omp parallel for schedule(static)
+        index_t block_size = triangle_n / threads;
+        assert(triangle_n == threads * block_size);
+
+        rgen.discard(2 * (proc_id * threads + omp_get_thread_num()) * block_size);
+
+    #pragma omp for schedule(static)
         for (index_t i = 0; i < triangle_n; ++i) {
-            lower_cp[i] = lower[i];
-            upper_cp[i] = upper[i];
+            lower[i] = 0.5 + rgen() % 100;
+            upper[i] = 1.0 + rgen() % 100;
+        } // barrier
+
+        index_t offset_diag = proc_id * diagonal_n;
+    #pragma omp for schedule(static)
+        for (index_t i = 0; i < diagonal_n; ++i) {
+            diag[i] = offset_diag + i + 1;
+        } // barrier
+    }
+
+        timer.stop(phase::init);
+
+        if (write) {
+            timer.start(phase::io);
+            if (proc_id == 0) {
+                std::ofstream ofs(file_path.c_str(), std::ofstream::trunc);
+                ofs << "DIM: " << dim << "x" << dim << std::endl;
+            };
+            upcxx::barrier();
+            std::ofstream ofs(file_path.c_str(), std::ofstream::app);
+
+            dump_array_in_rank_order(ofs, lower, triangle_n, "LOWER (C-m): ");
+            dump_array_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
+            dump_array_in_rank_order(ofs, upper, triangle_n, "UPPER (R-m): ");
+            timer.stop(phase::io);
         }
+
+
+        // Timings for different iterations, of which the mean is taken.
+        std::vector<double> vt;
+        vt.reserve(iterations);
     
-        // Set up a barrier before doing any timing
-        upcxx::barrier();
-        time_point<Clock> t = Clock::now();
+        // Copies for multiple iterations (in-place transposition)
+        float* lower_cp = new float[triangle_n];
+        float* upper_cp = new float[triangle_n];
+        double norm = 0; // ||A - A^T|| of the last iteration, for operations with a norm
 
-        // Because lower and upper triangle and stored symmetricaly, we can symmetrize
-        // the matrix as a SAXPY operation (over the lower and upper triangle) using a
-        // single for loop.
-#pragma omp parallel for simd schedule(static)
-        for (index_t i = 0; i < triangle_n; ++i) {
-            double s = (lower_cp[i] + upper_cp[i]) / 2;
-            lower_cp[i] = s;
-            upper_cp[i] = s;
+        // With --interleaved, both triangles in a single array, and its copy
+        std::vector<float, project::aligned_allocator<float>> pairs, pairs_cp;
+        if (interleaved) {
+            timer.start(phase::init);
+            pairs.resize(project::detail::interleaved_size<float>(triangle_n));
+            pairs_cp.resize(pairs.size());
+            project::detail::interleave(lower, upper, triangle_n, pairs.data());
+            timer.stop(phase::init);
         }
-        upcxx::barrier();
 
-        if (proc_id == 0) {
-            Duration d = Clock::now() - t;
-            double time = d.count(); // time in seconds
-            vt.push_back(time);
+        for (int iter = 1 - warmup; iter <= iterations; ++iter) {
+            // Initialize matrix
+            timer.start(phase::init);
+            if (interleaved) {
+    #pragma omp parallel for schedule(static)
+                for (std::size_t i = 0; i < pairs.size(); ++i) {
+                    pairs_cp[i] = pairs[i];
+                }
+            } else {
+    #pragma omp parallel for schedule(static)
+                for (index_t i = 0; i < triangle_n; ++i) {
+                    lower_cp[i] = lower[i];
+                    upper_cp[i] = upper[i];
+                }
+            }
+            timer.stop(phase::init);
+    
+            // Set up a barrier before doing any timing
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+            time_point<Clock> t = Clock::now();
+            timer.start(phase::compute);
+            counters.start();
+
+            // Because lower and upper triangle and stored symmetricaly, we can symmetrize
+            // the matrix (or apply another operation on pairs a_ij, a_ji) using a single
+            // loop, split between the OpenMP threads.
+            double half_sq = 0;
+            if (interleaved) {
+                TraceScope ts("symmetrize-interleaved");
+                project::detail::pairs_interleaved_parallel(pairs_cp.data(), triangle_n,
+                                                            project::detail::average_op());
+            } else {
+                TraceScope ts(op_name.c_str());
+                half_sq = project::apply_pair_op_parallel(*op, lower_cp, upper_cp, triangle_n, alpha, beta);
+            }
+            counters.stop();
+            timer.stop(phase::compute);
+
+            if (project::pair_op_has_norm(*op)) {
+                timer.start(phase::collective);
+                TraceScope ts("reduce_all");
+                norm = project::asymmetry_norm(upcxx::reduce_all(half_sq, upcxx::op_fast_add).wait());
+                timer.stop(phase::collective);
+            }
+
+            timer.start(phase::collective);
+            {
+                TraceScope ts("barrier");
+                upcxx::barrier();
+            }
+            timer.stop(phase::collective);
+
+            if (proc_id == 0 && iter > 0) {
+                Duration d = Clock::now() - t;
+                double time = d.count(); // time in seconds
+                vt.push_back(time);
+            }
         }
-    }
-    if (proc_id == 0) {
-        double time = std::accumulate(vt.begin(), vt.end(), 0.);
-        time /= iterations;
+        if (proc_id == 0) {
+            BenchStats stats = bench_stats(vt);
+            double time = stats.mean;
 
-        double throughput = dim * (dim-1) * sizeof(float) * 1e-9 / time;
-        std::fprintf(stdout, "%ld,%.12f,%.12f\n", dim, time, throughput);
-    }  
+            double throughput = dim * (dim-1) * sizeof(float) * 1e-9 / time;
+            std::fprintf(stdout, "%ld,%.12f,%.12f", dim, time, throughput);
+            bench_print_stats(stdout, stats);
+            if (machine) {
+                // Roofline of all nodes, assuming the same amount of ranks on every node
+                int nodes = upcxx::rank_n() / upcxx::local_team().rank_n();
+                auto kernel = roofline_symmetrize(dim * (dim - 1) / 2);
+                roofline_print_columns(stdout, roofline_evaluate(kernel, time, *machine, nodes));
+            }
+            std::fprintf(stdout, "\n");
+        }  
     
-    if (write) {
-        if (proc_id == 0) {
-            std::ofstream ofs(file_path_sym.c_str(), std::ofstream::trunc);
-            ofs << "DIM: " << dim << "x" << dim << std::endl;
-        };
-        upcxx::barrier();
-        std::ofstream ofs(file_path_sym.c_str(), std::ofstream::app);
+        if (write) {
+            timer.start(phase::io);
+            if (interleaved) {
+                project::detail::deinterleave(pairs_cp.data(), triangle_n, lower_cp, upper_cp);
+            }
+            if (proc_id == 0) {
+                std::ofstream ofs(file_path_sym.c_str(), std::ofstream::trunc);
+                ofs << "DIM: " << dim << "x" << dim << std::endl;
+            };
+            upcxx::barrier();
+            std::ofstream ofs(file_path_sym.c_str(), std::ofstream::app);
 
-        dump_array_in_rank_order(ofs, lower_cp, triangle_n, "LOWER (C-m): ");
-        dump_array_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
-        dump_array_in_rank_order(ofs, upper_cp, triangle_n, "UPPER (R-m): ");
-    }
+            dump_array_in_rank_order(ofs, lower_cp, triangle_n, "LOWER (C-m): ");
+            dump_array_in_rank_order(ofs, diag, diagonal_n, "DIAG: ");
+            dump_array_in_rank_order(ofs, upper_cp, triangle_n, "UPPER (R-m): ");
+            if (project::pair_op_has_norm(*op) && proc_id == 0) {
+                std::ofstream ofs_norm(file_path_norm.c_str(), std::ofstream::trunc);
+                ofs_norm << "NORM: " << std::setprecision(17) << norm << std::endl;
+            }
+            timer.stop(phase::io);
+        }
+        const std::string program = interleaved ? "symmetrize-upcxx-openmp-interleaved"
+            : *op == project::pair_op::symmetrize ? "symmetrize-upcxx-openmp" : "symmetrize-upcxx-openmp-" + op_name;
+        if (!phases_path.empty()) {
+            auto stats = reduce_phases(timer);
+
+            if (proc_id == 0) {
+                std::ofstream ofs(phases_path, std::ofstream::app);
+                write_phases_json(ofs, program.c_str(), 
+                                  {{"dim", dim}, {"iterations", iterations}, {"threads", omp_get_max_threads()}}, stats);
+            }
+        }
 
-    delete[] lower;
-    delete[] upper;
-    delete[] diag;
-    delete[] lower_cp;
-    delete[] upper_cp;
+        delete[] lower;
+        delete[] upper;
+        delete[] diag;
+        delete[] lower_cp;
+        delete[] upper_cp;
 
+        if (!counters_path.empty()) {
+            write_counters_json(counters_path, program.c_str(), {{"dim", dim}, {"iterations", iterations}, {"threads", omp_get_max_threads()}},
+                                counters, timer.elapsed(phase::compute));
+        }
+        timer.reset();
+        counters.reset();
+    }
+    if (!trace_path.empty()) {
+        trace_write(trace_path);
+    }
     upcxx::finalize();
     // END PARALLEL REGION
 }